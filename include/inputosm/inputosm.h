@@ -16,18 +16,39 @@
 
 #include "span.h"
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace input_osm
 {
 
+/**
+ * @brief Key and value of a tag
+ * @details Both are NUL terminated; the lengths exclude the NUL, so consumers do not need strlen. The lengths grew
+ * tag_t from 16 to 24 bytes, code built against the two pointer layout must be recompiled.
+ */
 struct tag_t
 {
     const char* key = nullptr;
     const char* value = nullptr;
+    uint32_t key_length = 0;
+    uint32_t value_length = 0;
 };
+static_assert(sizeof(tag_t) == 24);
 
+/**
+ * @brief A node as delivered to the node handler
+ * @details Coordinates are fixed point 1e-7 degrees and timestamps seconds since the epoch, whatever granularity,
+ * offsets and date granularity the PBF blocks use.
+ */
 struct node_t
 {
     int64_t id = 0;
@@ -40,6 +61,20 @@ struct node_t
 };
 static_assert(sizeof(node_t) <= 64);
 
+/**
+ * @brief A node without metadata, with 32 bit coordinates
+ * @details 1e-7 degree fixed point fits int32 over the whole coordinate range, so half the bytes of node_t are
+ * written per node. Delivered by input_file_as<compact_node_t>.
+ */
+struct compact_node_t
+{
+    int64_t id = 0;
+    int32_t raw_latitude = 0;
+    int32_t raw_longitude = 0;
+    span_t<tag_t> tags;
+};
+static_assert(sizeof(compact_node_t) == 32);
+
 struct way_t
 {
     int64_t id = 0;
@@ -73,6 +108,30 @@ struct relation_t
 };
 static_assert(sizeof(relation_t) <= 64);
 
+/**
+ * @brief A batch of nodes as separate contiguous columns
+ * @details id has size() values, raw_latitude and raw_longitude too unless set_projection leaves out the coordinates;
+ * latitude and longitude hold the same coordinates in degrees if PROJECT_DEGREES is projected, else they are empty.
+ * The tags of node i are tags[tag_offsets[i]] .. tags[tag_offsets[i + 1] - 1]; tag_offsets has size() + 1 values,
+ * or none if no node of the batch has tags. version, timestamp and changeset have size() values when they are
+ * decoded and present, else none. Like the other batches, the columns are valid only in the scope of the callback.
+ */
+struct node_columns_t
+{
+    span_t<int64_t> id;
+    span_t<int64_t> raw_latitude;
+    span_t<int64_t> raw_longitude;
+    span_t<double> latitude;
+    span_t<double> longitude;
+    span_t<uint32_t> tag_offsets;
+    span_t<tag_t> tags;
+    span_t<uint64_t> version;
+    span_t<int64_t> timestamp;
+    span_t<int64_t> changeset;
+
+    size_t size() const { return id.size(); }
+};
+
 enum class file_type_t
 {
     pbf,
@@ -87,6 +146,65 @@ enum class mode_t
     destroy
 };
 
+template <typename Signature>
+class function_ref_t;
+
+/**
+ * @brief A non-owning reference to a callable, the handler type of the decode loops
+ * @details An object pointer and a call thunk: calling it is one indirect call, with neither the allocation nor the
+ * small buffer checks of std::function. The callable must outlive the reference, which holds for a temporary lambda
+ * passed to input_file_ref: it lives until the read returned. Function pointers are held by value instead, so a
+ * temporary pointer does not dangle. An empty std::function and a null function pointer give an empty reference.
+ */
+template <typename R, typename... Args>
+class function_ref_t<R(Args...)>
+{
+public:
+    function_ref_t() = default;
+    function_ref_t(std::nullptr_t) {}
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same_v<std::remove_cvref_t<F>, function_ref_t> &&
+                                          std::is_invocable_r_v<R, F&, Args...>>>
+    function_ref_t(F&& callable)
+    {
+        using callable_t = std::remove_reference_t<F>;
+        using pointer_t = std::decay_t<F>;
+        if constexpr (std::is_pointer_v<pointer_t> && std::is_function_v<std::remove_pointer_t<pointer_t>>)
+        {
+            const pointer_t function = callable;
+            if (!function) return;
+            // any function pointer type converts to void (*)() and back
+            storage.function = reinterpret_cast<void (*)()>(function);
+            call = [](storage_t storage, Args... args) -> R {
+                return reinterpret_cast<pointer_t>(storage.function)(std::forward<Args>(args)...);
+            };
+        }
+        else
+        {
+            if constexpr (std::is_same_v<std::remove_cv_t<callable_t>, std::function<R(Args...)>>)
+            {
+                if (!callable) return;
+            }
+            storage.object = const_cast<void*>(static_cast<const void*>(std::addressof(callable)));
+            call = [](storage_t storage, Args... args) -> R {
+                return (*static_cast<callable_t*>(storage.object))(std::forward<Args>(args)...);
+            };
+        }
+    }
+
+    R operator()(Args... args) const { return call(storage, std::forward<Args>(args)...); }
+    explicit operator bool() const { return call != nullptr; }
+
+private:
+    union storage_t
+    {
+        void* object;
+        void (*function)();
+    };
+    storage_t storage{nullptr};
+    R (*call)(storage_t, Args...) = nullptr;
+};
+
 void set_verbose(bool value);
 
 bool input_file(const char* filename,
@@ -95,12 +213,681 @@ bool input_file(const char* filename,
                 std::function<bool(span_t<way_t>)> way_handler,
                 std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
 
+/**
+ * @brief Same as input_file, but nodes are delivered as columns
+ * @details PBF dense nodes are handed over as decoded, without building node_t records. XML nodes are converted.
+ */
+bool input_file_columnar(const char* filename,
+                         bool decode_metadata,
+                         std::function<bool(const node_columns_t&)> node_handler,
+                         std::function<bool(span_t<way_t>)> way_handler,
+                         std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+
+/**
+ * @brief Same as input_file, with the node layout chosen at compile time
+ * @details Node is node_t or compact_node_t. PBF dense nodes are scattered straight into compact_node_t records and
+ * their metadata is not decoded; decode_metadata still applies to ways and relations. XML nodes are converted.
+ */
+template <class Node>
+bool input_file_as(const char* filename,
+                   bool decode_metadata,
+                   std::function<bool(span_t<Node>)> node_handler,
+                   std::function<bool(span_t<way_t>)> way_handler,
+                   std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+
+template <>
+bool input_file_as<node_t>(const char* filename,
+                           bool decode_metadata,
+                           std::function<bool(span_t<node_t>)> node_handler,
+                           std::function<bool(span_t<way_t>)> way_handler,
+                           std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+
+template <>
+bool input_file_as<compact_node_t>(const char* filename,
+                                   bool decode_metadata,
+                                   std::function<bool(span_t<compact_node_t>)> node_handler,
+                                   std::function<bool(span_t<way_t>)> way_handler,
+                                   std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+
+/**
+ * @brief Read several files in one run of the worker pool
+ * @details The blobs of all PBF files go through one work queue in the order of the list, so the workers never wait
+ * for the tail of one file before starting on the next. Each XML or OSC file is parsed as a whole by one worker, next
+ * to the PBF blobs. file_index tells the handlers which file a batch came from, block_index the block within it. With
+ * set_use_block_index(true), existing block indexes are used, missing ones are not built by this call.
+ * @return false if a file can't be read, or a handler returned false
+ */
+bool input_files(const std::vector<std::string>& filenames,
+                 bool decode_metadata,
+                 std::function<bool(span_t<node_t>)> node_handler,
+                 std::function<bool(span_t<way_t>)> way_handler,
+                 std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+
+/**
+ * @brief Same as input_file, the handlers are referenced instead of copied into std::function
+ * @details Lambdas can be passed as they are, e.g. `input_file_ref(path, false, [&](span_t<node_t> nodes) { ... },
+ * nullptr, nullptr)`: nothing is allocated and every batch is one indirect call through function_ref_t.
+ */
+bool input_file_ref(const char* filename,
+                    bool decode_metadata,
+                    function_ref_t<bool(span_t<node_t>)> node_handler,
+                    function_ref_t<bool(span_t<way_t>)> way_handler,
+                    function_ref_t<bool(span_t<relation_t>)> relation_handler) noexcept;
+
 void set_thread_count(size_t);
 
 void set_max_thread_count();
 
 size_t thread_count();
 
+/**
+ * @brief How PBF blocks are distributed to the worker threads
+ * @details queue: one shared FIFO, blocks are started in file order
+ * work_stealing: per-worker lanes, idle workers steal from the others; less contention with many threads and
+ * small blocks
+ * largest_first: one shared queue that hands out the largest pending blob first, by the compressed size from its
+ * BlobHeader. The choice is made among the blobs enumerated ahead, a few per thread like the other schedulers, so a
+ * large block only jumps ahead of the small blocks within that window
+ */
+enum class scheduler_t
+{
+    queue,
+    work_stealing,
+    largest_first
+};
+
+/**
+ * @brief Set the block scheduler used by multi-threaded PBF reads
+ * @note not thread safe
+ */
+void set_scheduler(scheduler_t);
+
+scheduler_t scheduler();
+
+/**
+ * @brief Deliver batches to the handlers in ascending block_index order
+ * @details Blocks are still decoded in parallel, but a worker holds its decoded block until all previous blocks were
+ * delivered. Handlers are then never called concurrently. Workers run at most a few blocks per thread ahead of
+ * the oldest undelivered block, so memory stays bounded. Forces the queue scheduler. XML input is always in order.
+ * @note not thread safe
+ */
+void set_ordered_delivery(bool);
+
+bool ordered_delivery();
+
+/**
+ * @brief Inflate implementation for zlib compressed PBF blobs
+ * @details zlib is always built in. zlib_ng, libdeflate and isal are available when the library was configured with
+ * INPUTOSM_WITH_ZLIB_NG, INPUTOSM_WITH_LIBDEFLATE or INPUTOSM_WITH_ISAL. Every worker thread keeps its own
+ * decompressor state and reuses it for all blobs it inflates.
+ */
+enum class decompressor_t
+{
+    zlib,
+    zlib_ng,
+    libdeflate,
+    isal
+};
+
+/**
+ * @brief Select the inflate implementation of the default reader, the default is the fastest one built in
+ * @details Each reader_t has its own selection, see reader_t::set_decompressor.
+ * @return false if the decompressor is not built in, the selection is then unchanged
+ * @note not thread safe
+ */
+bool set_decompressor(decompressor_t);
+
+decompressor_t decompressor();
+
+bool decompressor_available(decompressor_t);
+
+/**
+ * @brief Decoder counters of the last PBF read
+ * @details Every primitive group is decoded in a single pass into per-thread buffers that are reused from block to
+ * block. buffer_grows counts how often one of these buffers had to be enlarged; once they fit the largest blocks
+ * it stays constant. idle_seconds is the wall time of a multi-threaded read minus the time each worker spent on
+ * its blocks, so it covers waiting for blobs, waiting for the delivery turn, and the tail after the worker's last
+ * block.
+ * @note read them after input_file returned
+ */
+struct decode_statistics_t
+{
+    uint64_t blocks = 0;              // primitive blocks decoded
+    uint64_t groups = 0;              // primitive groups decoded
+    uint64_t buffer_grows = 0;        // per-thread decode buffers enlarged
+    std::vector<double> idle_seconds; // by thread_index, empty for single-threaded reads
+};
+
+decode_statistics_t decode_statistics();
+
+enum block_kind_t : uint32_t
+{
+    BLOCK_HEADER = 1,
+    BLOCK_HAS_NODES = 2,
+    BLOCK_HAS_WAYS = 4,
+    BLOCK_HAS_RELATIONS = 8,
+};
+
+/**
+ * @brief Summary of one PBF block as stored in the block index sidecar
+ * @details Ids are the min/max of each entity kind present in the block. Coordinates are the node bounding box in
+ * 1e-7 degrees, with the block granularity and offsets applied. Fields of kinds that are absent are 0.
+ */
+struct block_summary_t
+{
+    uint64_t offset = 0;      // file offset of the BlobHeader length prefix
+    uint32_t header_size = 0; // BlobHeader size
+    uint32_t blob_size = 0;   // Blob size as stored (compressed)
+    uint32_t raw_size = 0;    // inflated block size
+    uint32_t kinds = 0;       // block_kind_t bits
+    int64_t min_node_id = 0;
+    int64_t max_node_id = 0;
+    int64_t min_way_id = 0;
+    int64_t max_way_id = 0;
+    int64_t min_relation_id = 0;
+    int64_t max_relation_id = 0;
+    int32_t min_latitude = 0;
+    int32_t max_latitude = 0;
+    int32_t min_longitude = 0;
+    int32_t max_longitude = 0;
+};
+
+/**
+ * @brief Scan a PBF file and write its block index to "<filename>.idx"
+ * @return true if the index was written
+ */
+bool build_block_index(const char* filename) noexcept;
+
+/**
+ * @brief Consult the "<filename>.idx" sidecar when reading PBF files
+ * @details Blocks that hold no entity kind with a handler are never inflated. If the sidecar is missing, was built
+ * for another size or modification time of the file, or its offsets do not point at the BlobHeaders of the file, it
+ * is rebuilt during the next complete read and used from then on.
+ * @note not thread safe
+ */
+void set_use_block_index(bool);
+
+bool use_block_index();
+
+/**
+ * @brief Select blocks by their summary, e.g. for id range or bounding box queries
+ * @details Called once per indexed block before it is inflated; return false to skip the block.
+ * Only effective together with set_use_block_index(true). Pass nullptr to remove the filter.
+ * @note not thread safe
+ */
+void set_block_filter(std::function<bool(const block_summary_t&)> filter);
+
+enum entity_kind_t : uint32_t
+{
+    ENTITY_NODES = 1,
+    ENTITY_WAYS = 2,
+    ENTITY_RELATIONS = 4,
+    ENTITY_ALL = 7,
+};
+
+/**
+ * @brief Fields to decode, see set_projection
+ * @details Ids are always decoded. PROJECT_COORDINATES applies to nodes, PROJECT_REFS to way node refs and relation
+ * members. PROJECT_DEGREES is not part of PROJECT_ALL: it adds the node coordinates as doubles to node_columns_t.
+ */
+enum projection_t : uint32_t
+{
+    PROJECT_ID = 0,
+    PROJECT_COORDINATES = 1,
+    PROJECT_TAGS = 2,
+    PROJECT_REFS = 4,
+    PROJECT_VERSION = 8,
+    PROJECT_TIMESTAMP = 16,
+    PROJECT_CHANGESET = 32,
+    PROJECT_METADATA = PROJECT_VERSION | PROJECT_TIMESTAMP | PROJECT_CHANGESET,
+    PROJECT_ALL = 63,
+    PROJECT_DEGREES = 64,
+};
+
+/**
+ * @brief Decode only the given projection_t fields of the entity kinds in entity_kinds (entity_kind_t bits)
+ * @details The PBF reader skips the packed fields that are not requested; fields left out are empty or 0 in the
+ * delivered entities, in node columns their spans are empty. The metadata fields additionally need decode_metadata
+ * in input_file. The default is PROJECT_ALL for every kind.
+ * @note not thread safe
+ */
+void set_projection(uint32_t entity_kinds, uint32_t fields);
+
+uint32_t projection(entity_kind_t kind);
+
+/**
+ * @brief Predicate over the tags of one entity, see set_tag_filter
+ * @details Built from terms (key present, key=value, key with one of several values) combined with !, all_of and
+ * any_of; at most 64 terms. A default constructed filter accepts every entity.
+ */
+class tag_filter_t
+{
+public:
+    static tag_filter_t has_key(std::string key);
+    static tag_filter_t key_value(std::string key, std::string value);
+    static tag_filter_t key_in(std::string key, std::vector<std::string> values);
+    static tag_filter_t all_of(std::vector<tag_filter_t> filters);
+    static tag_filter_t any_of(std::vector<tag_filter_t> filters);
+    tag_filter_t operator!() const;
+
+    bool empty() const { return program.empty(); }
+    // at most 64 terms and 64 nested operands
+    bool valid() const;
+    bool matches(span_t<tag_t> tags) const;
+    // evaluate with bit i of matched_terms set if terms[i] matched one of the tags
+    bool evaluate(uint64_t matched_terms) const;
+
+    // matches if the key is present and, unless values is empty, has one of the values
+    struct term_t
+    {
+        std::string key;
+        std::vector<std::string> values;
+    };
+    std::vector<term_t> terms;
+    // postfix program: an index into terms pushes that term's result, the op_t codes combine results
+    enum op_t : uint32_t
+    {
+        OP_TRUE = 0xfffffffc,
+        OP_NOT = 0xfffffffd,
+        OP_AND = 0xfffffffe,
+        OP_OR = 0xffffffff,
+    };
+    std::vector<uint32_t> program;
+};
+
+/**
+ * @brief Only deliver entities whose tags pass the filter
+ * @details Applies to the entity kinds in entity_kinds (entity_kind_t bits), the others are delivered unfiltered.
+ * The PBF reader matches the filter strings once against each block string table, then tests entities on their
+ * string indexes and drops the failing ones before their tags are built; blocks whose string table cannot satisfy the
+ * filter are not decoded at all. Pass a default constructed filter to remove it.
+ * @return false if the filter is not valid, the previous filter is then kept
+ * @note not thread safe
+ */
+bool set_tag_filter(tag_filter_t filter, uint32_t entity_kinds = ENTITY_ALL);
+
+/**
+ * @brief Area of interest for set_spatial_filter, in raw coordinate units (1e-7 degrees)
+ * @details Either a box, or a multipolygon given as closed or open rings: a point is inside if it lies in an odd
+ * number of rings, so holes are rings within outer rings. Points on the box boundary are inside; points on a ring
+ * edge may fall either way. Coordinates must be valid, |latitude| <= 90 and |longitude| <= 180 degrees. A default
+ * constructed filter contains every point.
+ */
+class spatial_filter_t
+{
+public:
+    struct point_t
+    {
+        int64_t latitude = 0;
+        int64_t longitude = 0;
+    };
+
+    static spatial_filter_t box(int64_t min_latitude,
+                                int64_t min_longitude,
+                                int64_t max_latitude,
+                                int64_t max_longitude);
+    static spatial_filter_t polygon(std::vector<std::vector<point_t>> rings);
+
+    bool empty() const { return !bounded; }
+    bool contains(int64_t raw_latitude, int64_t raw_longitude) const;
+    // whether the node bounding box of a block may hold points that are inside
+    bool intersects(const block_summary_t& summary) const;
+
+    // the box, for a polygon the bounding box of its rings
+    bool bounded = false;
+    int64_t min_latitude = 0;
+    int64_t min_longitude = 0;
+    int64_t max_latitude = 0;
+    int64_t max_longitude = 0;
+    std::vector<std::vector<point_t>> rings;
+};
+
+/**
+ * @brief Only deliver the nodes inside the filter area
+ * @details The PBF reader tests the coordinate columns of each dense node group with SIMD compares against the box,
+ * only the points inside the box are tested against the rings, and nodes outside are dropped before their tags are
+ * built. With set_use_block_index(true), blocks whose node bounding box misses the box are not inflated for nodes.
+ * Ways and relations are not filtered. Pass a default constructed filter to remove it.
+ * @note not thread safe
+ */
+void set_spatial_filter(spatial_filter_t filter);
+
+/**
+ * @brief Compressed set of entity ids, see set_id_filter
+ * @details Roaring style: ids are grouped into chunks of 65536 by their upper bits; a chunk keeps its members as a
+ * sorted array of 16 bit offsets while it has at most 4096 of them, as a bitmap beyond. A few scattered ids cost a few
+ * bytes each, a dense range one bit per id. Lookups are safe from multiple threads once the set is built.
+ */
+class id_set_t
+{
+public:
+    id_set_t() = default;
+    explicit id_set_t(std::vector<int64_t> ids);
+
+    void insert(int64_t id);
+    bool contains(int64_t id) const;
+    // sets member[i] to 1 if ids[i] is in the set, else to 0, and returns the number of members; fastest for ascending
+    // ids
+    size_t contains(const int64_t* ids, size_t count, uint8_t* member) const;
+    // whether some member lies in [first, last]
+    bool overlaps(int64_t first, int64_t last) const;
+    size_t size() const { return count; }
+    bool empty() const { return !count; }
+
+private:
+    struct chunk_t
+    {
+        int64_t key = 0;              // id >> 16
+        std::vector<uint16_t> array;  // sorted members while the chunk is small
+        std::vector<uint64_t> bitmap; // 1024 words once it is not
+        bool has(uint16_t low) const;
+        bool any(uint16_t first, uint16_t last) const;
+        void insert(uint16_t low);
+    };
+    std::vector<chunk_t> chunks; // ascending key
+    size_t count = 0;
+};
+
+/**
+ * @brief Only deliver the entities of one kind whose ids are in the set
+ * @details The PBF reader tests the ids of a dense node group right after delta decoding them and skips the rest of
+ * the group if none is wanted; ways and relations are tested on their id before anything else is decoded. With
+ * set_use_block_index(true), blocks whose id range holds no member are not inflated for that kind. Meant for the
+ * second pass of jobs that resolve references, e.g. the nodes of selected ways. Pass an empty set to remove the
+ * filter of that kind.
+ * @return false if kind is not exactly one entity kind
+ * @note not thread safe
+ */
+bool set_id_filter(entity_kind_t kind, id_set_t ids);
+
+/**
+ * @brief Keeps the buffers of one delivered batch alive, see retain_batch
+ */
+using batch_handle_t = std::shared_ptr<const void>;
+
+/**
+ * @brief Let handlers keep their batches after they return
+ * @details With retention on, a handler may call retain_batch to take over the buffers of the batch it was given,
+ * together with the buffers of its block that the batch points into: the inflated blob and the copied strings. The
+ * worker goes on with buffers from a process wide pool instead of waiting, and released buffers return to the pool
+ * with their capacity. Batches that are not retained cost nothing extra.
+ * @note not thread safe
+ */
+void set_batch_retention(bool);
+
+bool batch_retention();
+
+/**
+ * @brief Keep the batch the calling handler was given valid until the handle and all its copies are destroyed
+ * @details Only inside a handler of a read with set_batch_retention(true). The spans of the batch and the strings of
+ * its tags and roles stay valid, so e.g. another thread can process the batch without copying it. Calling it again
+ * for the same batch returns the same handle.
+ * @return an empty handle outside a handler, with retention off, and for the nodes that input_file_columnar and
+ * input_file_as<compact_node_t> convert from XML input
+ */
+batch_handle_t retain_batch();
+
+/**
+ * @brief Map/reduce over a read: one State per worker thread, merged once the read is over
+ * @details make_state creates the state of a worker when its first batch arrives, and the handlers get the state of
+ * the worker they run on, so they aggregate without locks. Each state is allocated by its own worker and cache line
+ * aligned: no false sharing, and with first touch placement it lives in the worker's local memory. Unset handlers
+ * skip their entity kind. node_columns_handler, if set, replaces node_handler and reads like input_file_columnar.
+ * merge(result, state), which must be set, is called for every state in thread_index order on the calling thread.
+ * An exception thrown by make_state or merge fails the read instead of escaping it.
+ */
+template <typename State>
+struct reduction_t
+{
+    std::function<State()> make_state = [] { return State{}; };
+    std::function<bool(State&, span_t<node_t>)> node_handler = nullptr;
+    std::function<bool(State&, const node_columns_t&)> node_columns_handler = nullptr;
+    std::function<bool(State&, span_t<way_t>)> way_handler = nullptr;
+    std::function<bool(State&, span_t<relation_t>)> relation_handler = nullptr;
+    std::function<void(State&, State&)> merge = nullptr;
+};
+
+/**
+ * @brief Why a read stopped before the end of its input
+ * @details handler: a handler returned false. cancel: cancel() was called. timeout: the read took longer than
+ * set_timeout allows. error: the input could not be opened or decoded.
+ */
+enum class stop_reason_t : uint8_t
+{
+    none,
+    handler,
+    cancel,
+    timeout,
+    error
+};
+
+/**
+ * @brief Stop the read in progress as soon as possible
+ * @details Thread safe, may be called from a handler or from any other thread. The workers check between blocks and
+ * between primitive groups, the XML reader between batches, so the whole read stops within milliseconds and returns
+ * false; no handler is called once a worker noticed. A handler returning false, a decode error or the timeout stop
+ * the read the same way. Called while no read runs, e.g. just before another thread starts one, it stops the next
+ * read as soon as that starts; the reads after it are not affected.
+ */
+void cancel();
+
+/**
+ * @brief Stop reads that take longer than this, zero for no limit
+ * @note not thread safe
+ */
+void set_timeout(std::chrono::milliseconds);
+
+std::chrono::milliseconds timeout();
+
+/**
+ * @brief Why the last read stopped early, none if it read everything
+ */
+stop_reason_t stop_reason();
+
+struct reader_state_t;
+
+/**
+ * @brief A reader with its own options, handlers, work queue and decode statistics
+ * @details The member functions behave like the free functions of the same name, for this reader only. Readers are
+ * independent: several can read files at the same time from different threads, e.g. a few regional extracts and OSC
+ * diffs side by side; their workers come from the shared worker pool. The free functions use default_reader().
+ * @note a reader reads one file at a time, and its options must not be changed while it reads
+ */
+class reader_t
+{
+public:
+    reader_t();
+    ~reader_t();
+    reader_t(const reader_t&) = delete;
+    reader_t& operator=(const reader_t&) = delete;
+
+    bool input_file(const char* filename,
+                    bool decode_metadata,
+                    std::function<bool(span_t<node_t>)> node_handler,
+                    std::function<bool(span_t<way_t>)> way_handler,
+                    std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+    bool input_file_columnar(const char* filename,
+                             bool decode_metadata,
+                             std::function<bool(const node_columns_t&)> node_handler,
+                             std::function<bool(span_t<way_t>)> way_handler,
+                             std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+    template <class Node>
+    bool input_file_as(const char* filename,
+                       bool decode_metadata,
+                       std::function<bool(span_t<Node>)> node_handler,
+                       std::function<bool(span_t<way_t>)> way_handler,
+                       std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+    bool input_files(const std::vector<std::string>& filenames,
+                     bool decode_metadata,
+                     std::function<bool(span_t<node_t>)> node_handler,
+                     std::function<bool(span_t<way_t>)> way_handler,
+                     std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+    bool input_file_ref(const char* filename,
+                        bool decode_metadata,
+                        function_ref_t<bool(span_t<node_t>)> node_handler,
+                        function_ref_t<bool(span_t<way_t>)> way_handler,
+                        function_ref_t<bool(span_t<relation_t>)> relation_handler) noexcept;
+    template <typename State>
+    bool input_file_reduce(const char* filename,
+                           bool decode_metadata,
+                           const reduction_t<State>& reduction,
+                           State& result) noexcept;
+    bool build_block_index(const char* filename) noexcept;
+
+    void set_thread_count(size_t);
+    void set_max_thread_count();
+    size_t thread_count() const;
+    void set_scheduler(scheduler_t);
+    scheduler_t scheduler() const;
+    void set_ordered_delivery(bool);
+    bool ordered_delivery() const;
+    void set_use_block_index(bool);
+    bool use_block_index() const;
+    void set_block_filter(std::function<bool(const block_summary_t&)> filter);
+    void set_projection(uint32_t entity_kinds, uint32_t fields);
+    uint32_t projection(entity_kind_t kind) const;
+    bool set_tag_filter(tag_filter_t filter, uint32_t entity_kinds = ENTITY_ALL);
+    void set_spatial_filter(spatial_filter_t filter);
+    bool set_id_filter(entity_kind_t kind, id_set_t ids);
+    void set_batch_retention(bool);
+    bool batch_retention() const;
+    bool set_decompressor(decompressor_t);
+    decompressor_t decompressor() const;
+    // thread safe
+    void cancel();
+    void set_timeout(std::chrono::milliseconds);
+    std::chrono::milliseconds timeout() const;
+    stop_reason_t stop_reason() const;
+
+    // counters of the last PBF read of this reader
+    decode_statistics_t decode_statistics() const;
+
+private:
+    friend class batch_reader_t;
+    std::unique_ptr<reader_state_t> state;
+};
+
+template <>
+bool reader_t::input_file_as<node_t>(const char* filename,
+                                     bool decode_metadata,
+                                     std::function<bool(span_t<node_t>)> node_handler,
+                                     std::function<bool(span_t<way_t>)> way_handler,
+                                     std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+
+template <>
+bool reader_t::input_file_as<compact_node_t>(const char* filename,
+                                             bool decode_metadata,
+                                             std::function<bool(span_t<compact_node_t>)> node_handler,
+                                             std::function<bool(span_t<way_t>)> way_handler,
+                                             std::function<bool(span_t<relation_t>)> relation_handler) noexcept;
+
+/**
+ * @brief The reader behind the free functions
+ */
+reader_t& default_reader();
+
+/**
+ * @brief Read a file into per-worker states and merge them into result, see reduction_t
+ * @details e.g. counting nodes: `input_file_reduce(path, false, reduction_t<uint64_t>{.node_handler = [](uint64_t& n,
+ * span_t<node_t> list) { n += list.size(); return true; }, .merge = [](uint64_t& r, uint64_t& n) { r += n; }}, count)`
+ * @return false like input_file, or if make_state or merge is not set; result is then left unchanged, unless merge
+ * threw after merging some of the states
+ */
+template <typename State>
+bool input_file_reduce(const char* filename,
+                       bool decode_metadata,
+                       const reduction_t<State>& reduction,
+                       State& result) noexcept;
+
+/**
+ * @brief One batch pulled from a batch_reader_t
+ * @details Only the span of `kind` is set. The spans point into the decode buffers of the worker that produced the
+ * batch and stay valid until the next call to next() or try_next(). If the reader retains batches, handle keeps them
+ * valid for as long as a copy of it is kept.
+ */
+struct batch_t
+{
+    entity_kind_t kind = ENTITY_NODES;
+    span_t<node_t> nodes;
+    span_t<way_t> ways;
+    span_t<relation_t> relations;
+    size_t block_index = 0;
+    size_t file_index = 0;
+    mode_t osc_mode = mode_t::bulk;
+    batch_handle_t handle; // set if the reader retains batches, see set_batch_retention
+
+    size_t size() const { return nodes.size() + ways.size() + relations.size(); }
+};
+
+struct batch_reader_state_t;
+
+/**
+ * @brief Pull the batches of a read instead of receiving them in handlers
+ * @details The read runs in the background with the options of the given reader. Each worker hands its batches to
+ * the consumer through its own bounded single producer single consumer ring and waits until the batch is released,
+ * so a slow consumer holds back the decoding and a fast one finds up to one batch per worker ready. If the reader
+ * retains batches, workers do not wait and each ring buffers a few batches, which absorbs bursts. next() and
+ * try_next() may be called from any thread, one at a time, e.g. from a coroutine that polls try_next().
+ * Destroying the batch reader stops the read. With ordered delivery the batches come in block order.
+ * @note the reader must not be used for anything else until the batch reader is destroyed
+ */
+class batch_reader_t
+{
+public:
+    // reads one file, or several like input_files; entity_kinds (entity_kind_t bits) are the kinds to deliver
+    batch_reader_t(reader_t& reader,
+                   std::vector<std::string> filenames,
+                   bool decode_metadata,
+                   uint32_t entity_kinds = ENTITY_ALL);
+    batch_reader_t(std::vector<std::string> filenames, bool decode_metadata, uint32_t entity_kinds = ENTITY_ALL);
+    ~batch_reader_t();
+    batch_reader_t(const batch_reader_t&) = delete;
+    batch_reader_t& operator=(const batch_reader_t&) = delete;
+
+    // releases the previous batch and waits for the next one, nullptr once the read is over
+    const batch_t* next();
+    // releases the previous batch, nullptr if no batch is ready yet or the read is over
+    const batch_t* try_next();
+    // true once the read is over and every batch was pulled
+    bool finished() const;
+    // result of the read, like the return value of input_file; valid once finished
+    bool ok() const;
+
+    class iterator
+    {
+    public:
+        using value_type = batch_t;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        const batch_t& operator*() const { return *batch; }
+        const batch_t* operator->() const { return batch; }
+        iterator& operator++()
+        {
+            batch = owner->next();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return !batch; }
+
+    private:
+        friend class batch_reader_t;
+        iterator(batch_reader_t* owner, const batch_t* batch)
+            : owner(owner),
+              batch(batch)
+        {
+        }
+        batch_reader_t* owner = nullptr;
+        const batch_t* batch = nullptr;
+    };
+    // single pass: begin() pulls the first batch
+    iterator begin() { return iterator(this, next()); }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    std::unique_ptr<batch_reader_state_t> state;
+};
+
 enum log_level_t : uint8_t
 {
     LOG_LEVEL_TRACE = 0,
@@ -131,8 +918,107 @@ bool set_log_callback(log_callback_t log_callback) noexcept;
 
 extern thread_local size_t thread_index;
 extern thread_local size_t block_index;
-extern mode_t osc_mode;
-extern file_type_t file_type;
+// position in the list of input_files, 0 for input_file
+extern thread_local size_t file_index;
+// set on the threads that call the handlers of a read. Both used to be plain process-wide variables; they are thread
+// local so that readers running side by side, and the files of one input_files run, each see their own, which means
+// they must be read on the thread of the handler
+extern thread_local mode_t osc_mode;
+extern thread_local file_type_t file_type;
+
+template <typename State>
+bool reader_t::input_file_reduce(const char* filename,
+                                 bool decode_metadata,
+                                 const reduction_t<State>& reduction,
+                                 State& result) noexcept
+{
+    if (!reduction.make_state || !reduction.merge) return false;
+    // one slot per thread_index, made by its worker
+    struct alignas(64) slot_t
+    {
+        State state;
+    };
+    std::vector<std::unique_ptr<slot_t>> slots;
+    try
+    {
+        slots.resize(thread_count());
+    }
+    catch (...)
+    {
+        return false;
+    }
+    // nullptr if the state could not be made, the handler then fails the read
+    auto state = [&slots, &reduction]() noexcept -> State* {
+        std::unique_ptr<slot_t>& slot = slots[thread_index];
+        if (!slot)
+        {
+            try
+            {
+                slot.reset(new slot_t{reduction.make_state()});
+            }
+            catch (...)
+            {
+                return nullptr;
+            }
+        }
+        return &slot->state;
+    };
+    std::function<bool(span_t<node_t>)> node_handler;
+    std::function<bool(const node_columns_t&)> node_columns_handler;
+    std::function<bool(span_t<way_t>)> way_handler;
+    std::function<bool(span_t<relation_t>)> relation_handler;
+    if (reduction.node_columns_handler)
+        node_columns_handler = [&state, &reduction](const node_columns_t& nodes) {
+            State* s = state();
+            return s && reduction.node_columns_handler(*s, nodes);
+        };
+    else if (reduction.node_handler)
+        node_handler = [&state, &reduction](span_t<node_t> list) {
+            State* s = state();
+            return s && reduction.node_handler(*s, list);
+        };
+    if (reduction.way_handler)
+        way_handler = [&state, &reduction](span_t<way_t> list) {
+            State* s = state();
+            return s && reduction.way_handler(*s, list);
+        };
+    if (reduction.relation_handler)
+        relation_handler = [&state, &reduction](span_t<relation_t> list) {
+            State* s = state();
+            return s && reduction.relation_handler(*s, list);
+        };
+    const bool ok = node_columns_handler
+                        ? input_file_columnar(filename,
+                                              decode_metadata,
+                                              std::move(node_columns_handler),
+                                              std::move(way_handler),
+                                              std::move(relation_handler))
+                        : input_file(filename,
+                                     decode_metadata,
+                                     std::move(node_handler),
+                                     std::move(way_handler),
+                                     std::move(relation_handler));
+    if (!ok) return false;
+    try
+    {
+        for (auto& slot : slots)
+            if (slot) reduction.merge(result, slot->state);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+template <typename State>
+bool input_file_reduce(const char* filename,
+                       bool decode_metadata,
+                       const reduction_t<State>& reduction,
+                       State& result) noexcept
+{
+    return default_reader().input_file_reduce(filename, decode_metadata, reduction, result);
+}
 
 } // namespace input_osm
 
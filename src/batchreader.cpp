@@ -0,0 +1,194 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inputosm/inputosm.h>
+
+#include "reader.h"
+#include "spscring.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace input_osm
+{
+
+/**
+ * @brief Rings between the workers of a background read and the consumer
+ * @details A batch points into the decode buffers of its worker, so the worker waits in the handler until the
+ * consumer released it and each ring holds at most one batch. A retained batch owns its buffers, then the worker only
+ * waits while its ring is full. published counts the pushed batches and lets the consumer sleep while every ring is
+ * empty.
+ */
+struct batch_reader_state_t
+{
+    using ring_t = spsc_ring_t<batch_t, 4>;
+
+    std::unique_ptr<ring_t[]> rings; // by thread_index
+    size_t ring_count = 0;
+    std::atomic<uint64_t> published{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> done{false}; // the read returned, no more batches are pushed
+    bool result = false;
+    reader_t* reader = nullptr;
+    std::thread thread;
+
+    // consumer
+    size_t next_ring = 0;
+    ring_t* held = nullptr; // ring of the batch handed out last
+
+    // worker side of a handler: hand the batch over, and wait until it was released unless it is retained
+    bool publish(batch_t& batch)
+    {
+        if (stopping.load(std::memory_order_relaxed)) return false;
+        ring_t& ring = rings[input_osm::thread_index];
+        batch.handle = retain_batch();
+        ring.wait_not_full();
+        ring.try_push(batch);
+        published.fetch_add(1, std::memory_order_release);
+        published.notify_one();
+        if (!batch.handle) ring.wait_drained();
+        return !stopping.load(std::memory_order_relaxed);
+    }
+    template <typename T>
+    bool publish(entity_kind_t kind, span_t<T> list, span_t<T> batch_t::*field)
+    {
+        batch_t batch;
+        batch.kind = kind;
+        batch.*field = list;
+        batch.block_index = input_osm::block_index;
+        batch.file_index = input_osm::file_index;
+        batch.osc_mode = input_osm::osc_mode;
+        return publish(batch);
+    }
+
+    void release()
+    {
+        if (held)
+        {
+            held->front()->handle.reset();
+            held->pop();
+        }
+        held = nullptr;
+    }
+    // the next ready batch, round robin over the rings so that no worker waits behind a busy one
+    const batch_t* take()
+    {
+        for (size_t i = 0; i < ring_count; i++)
+        {
+            ring_t& ring = rings[(next_ring + i) % ring_count];
+            if (const batch_t* batch = ring.front())
+            {
+                next_ring = (next_ring + i + 1) % ring_count;
+                held = &ring;
+                return batch;
+            }
+        }
+        return nullptr;
+    }
+};
+
+batch_reader_t::batch_reader_t(reader_t& reader,
+                               std::vector<std::string> filenames,
+                               bool decode_metadata,
+                               uint32_t entity_kinds)
+    : state(std::make_unique<batch_reader_state_t>())
+{
+    state->reader = &reader;
+    state->ring_count = reader.thread_count();
+    state->rings = std::make_unique<batch_reader_state_t::ring_t[]>(state->ring_count);
+    state->thread = std::thread([this, &reader, filenames = std::move(filenames), decode_metadata, entity_kinds] {
+        batch_reader_state_t& s = *state;
+        std::function<bool(span_t<node_t>)> node_handler;
+        std::function<bool(span_t<way_t>)> way_handler;
+        std::function<bool(span_t<relation_t>)> relation_handler;
+        if (entity_kinds & ENTITY_NODES)
+            node_handler = [&s](span_t<node_t> list) { return s.publish(ENTITY_NODES, list, &batch_t::nodes); };
+        if (entity_kinds & ENTITY_WAYS)
+            way_handler = [&s](span_t<way_t> list) { return s.publish(ENTITY_WAYS, list, &batch_t::ways); };
+        if (entity_kinds & ENTITY_RELATIONS)
+            relation_handler = [&s](span_t<relation_t> list) {
+                return s.publish(ENTITY_RELATIONS, list, &batch_t::relations);
+            };
+        // one file goes through input_file, which also builds a missing block index
+        if (filenames.size() == 1)
+            s.result = reader.input_file(
+                filenames[0].c_str(), decode_metadata, node_handler, way_handler, relation_handler);
+        else
+            s.result = reader.input_files(filenames, decode_metadata, node_handler, way_handler, relation_handler);
+        s.done.store(true, std::memory_order_release);
+        s.published.fetch_add(1, std::memory_order_release);
+        s.published.notify_all();
+    });
+}
+
+batch_reader_t::batch_reader_t(std::vector<std::string> filenames, bool decode_metadata, uint32_t entity_kinds)
+    : batch_reader_t(default_reader(), std::move(filenames), decode_metadata, entity_kinds)
+{
+}
+
+batch_reader_t::~batch_reader_t()
+{
+    // the handlers return false from now on and the other workers stop at their next primitive group; release
+    // whatever the workers still hand over until the read returned
+    state->stopping = true;
+    state->reader->cancel();
+    state->release();
+    while (true)
+    {
+        const uint64_t seen = state->published.load(std::memory_order_acquire);
+        const bool done = state->done.load(std::memory_order_acquire);
+        while (state->take()) state->release();
+        if (done) break;
+        state->published.wait(seen, std::memory_order_acquire);
+    }
+    state->thread.join();
+    // the cancel is not meant for the next read, if this one had already returned
+    state->reader->state->cancel_pending = false;
+}
+
+const batch_t* batch_reader_t::next()
+{
+    state->release();
+    while (true)
+    {
+        // read before looking at the rings, so a batch pushed after the scan changes published and ends the wait
+        const uint64_t seen = state->published.load(std::memory_order_acquire);
+        const bool done = state->done.load(std::memory_order_acquire);
+        if (const batch_t* batch = state->take()) return batch;
+        if (done) return nullptr;
+        state->published.wait(seen, std::memory_order_acquire);
+    }
+}
+
+const batch_t* batch_reader_t::try_next()
+{
+    state->release();
+    return state->take();
+}
+
+bool batch_reader_t::finished() const
+{
+    if (!state->done.load(std::memory_order_acquire)) return false;
+    // the held batch is still in its ring
+    for (size_t i = 0; i < state->ring_count; i++)
+        if (state->rings[i].size() > (&state->rings[i] == state->held ? 1u : 0u)) return false;
+    return true;
+}
+
+bool batch_reader_t::ok() const
+{
+    return finished() && state->result;
+}
+
+} // namespace input_osm
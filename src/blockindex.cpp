@@ -0,0 +1,110 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "blockindex.h"
+
+#include "inputosmlog.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace input_osm
+{
+
+/**
+ * @brief Sidecar layout, host byte order
+ * @details index_header_t followed by `count` block_summary_t records, one per file block in file order.
+ * A different magic, version or record size makes the sidecar stale, so it is rebuilt.
+ */
+struct index_header_t
+{
+    char magic[8] = {'I', 'O', 'S', 'M', 'I', 'D', 'X', 0};
+    uint32_t version = 2; // 2: modification time in nanoseconds
+    uint32_t record_size = sizeof(block_summary_t);
+    uint64_t pbf_size = 0;
+    int64_t pbf_mtime_ns = 0;
+    uint64_t count = 0;
+};
+
+std::string block_index_filename(const char* pbf_filename)
+{
+    return std::string(pbf_filename) + ".idx";
+}
+
+bool load_block_index(const char* pbf_filename,
+                      uint64_t pbf_size,
+                      int64_t pbf_mtime_ns,
+                      std::vector<block_summary_t>& blocks) noexcept
+{
+    const std::string filename = block_index_filename(pbf_filename);
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    // the records that fit in the sidecar bound the count, a corrupt count must not allocate
+    long index_size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) index_size = ftell(f);
+    const bool sized = index_size >= long(sizeof(index_header_t)) && fseek(f, 0, SEEK_SET) == 0;
+    const uint64_t max_count = sized ? (uint64_t(index_size) - sizeof(index_header_t)) / sizeof(block_summary_t) : 0;
+    index_header_t expected;
+    index_header_t header;
+    bool result = sized && fread(&header, sizeof(header), 1, f) == 1 &&
+                  memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 &&
+                  header.version == expected.version && header.record_size == expected.record_size &&
+                  header.pbf_size == pbf_size && header.pbf_mtime_ns == pbf_mtime_ns && header.count <= max_count;
+    if (result)
+    {
+        blocks.resize(header.count);
+        result = fread(blocks.data(), sizeof(block_summary_t), blocks.size(), f) == blocks.size();
+    }
+    fclose(f);
+    if (!result)
+    {
+        IOSM_INFO("block index %s is stale or invalid", filename.c_str());
+        blocks.clear();
+    }
+    return result;
+}
+
+bool save_block_index(const char* pbf_filename,
+                      uint64_t pbf_size,
+                      int64_t pbf_mtime_ns,
+                      const std::vector<block_summary_t>& blocks) noexcept
+{
+    const std::string filename = block_index_filename(pbf_filename);
+    const std::string temp_filename = filename + ".tmp";
+    FILE* f = fopen(temp_filename.c_str(), "wb");
+    if (!f)
+    {
+        IOSM_ERROR("Failed to create %s: %s", temp_filename.c_str(), strerror(errno));
+        return false;
+    }
+    index_header_t header;
+    header.pbf_size = pbf_size;
+    header.pbf_mtime_ns = pbf_mtime_ns;
+    header.count = blocks.size();
+    bool result = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(blocks.data(), sizeof(block_summary_t), blocks.size(), f) == blocks.size();
+    result = (fclose(f) == 0) && result;
+    // readers see either the old or the complete new index
+    if (result) result = rename(temp_filename.c_str(), filename.c_str()) == 0;
+    if (!result)
+    {
+        IOSM_ERROR("Failed to write %s: %s", filename.c_str(), strerror(errno));
+        remove(temp_filename.c_str());
+        return false;
+    }
+    IOSM_TRACE("block index %s written with %zu blocks", filename.c_str(), blocks.size());
+    return true;
+}
+
+} // namespace input_osm
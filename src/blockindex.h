@@ -0,0 +1,51 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _BLOCKINDEX_H_
+#define _BLOCKINDEX_H_
+
+#include <inputosm/inputosm.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace input_osm
+{
+
+// sidecar path for a PBF file
+std::string block_index_filename(const char* pbf_filename);
+
+/**
+ * @brief Load the block index of a PBF file
+ * @param pbf_size, pbf_mtime_ns identify the PBF contents the index was built from, the modification time in
+ * nanoseconds so that a file rewritten within the same second is told apart
+ * @return false if the sidecar is missing, corrupt or stale
+ * @note the caller still checks the offsets against the file, see block_index_matches
+ */
+bool load_block_index(const char* pbf_filename,
+                      uint64_t pbf_size,
+                      int64_t pbf_mtime_ns,
+                      std::vector<block_summary_t>& blocks) noexcept;
+
+/**
+ * @brief Write the block index of a PBF file, replacing an existing one
+ */
+bool save_block_index(const char* pbf_filename,
+                      uint64_t pbf_size,
+                      int64_t pbf_mtime_ns,
+                      const std::vector<block_summary_t>& blocks) noexcept;
+
+} // namespace input_osm
+
+#endif // _BLOCKINDEX_H_
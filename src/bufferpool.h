@@ -0,0 +1,76 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _BUFFERPOOL_H_
+#define _BUFFERPOOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace input_osm
+{
+
+/**
+ * @brief Free list of decode buffers handed out by retain_batch
+ * @details A retained batch takes the buffers of its worker, and the worker continues with buffers from here. When the
+ * last handle of a batch goes, its buffers come back with their capacity, so after a few blocks no buffer is
+ * allocated any more. Contents are left as they are: the decoders clear a buffer before they fill it.
+ */
+template <typename T>
+class buffer_pool_t
+{
+public:
+    // a pooled or new object, back to the pool when the last copy of the pointer is destroyed
+    std::shared_ptr<T> acquire()
+    {
+        std::unique_ptr<T> item;
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            if (!free.empty())
+            {
+                item = std::move(free.back());
+                free.pop_back();
+            }
+        }
+        if (!item) item = std::make_unique<T>();
+        return std::shared_ptr<T>(item.release(), [this](T* released) { recycle(released); });
+    }
+
+private:
+    // more than this many free buffers are only left over from a burst of retained batches
+    static constexpr size_t k_max_free = 64;
+
+    void recycle(T* released)
+    {
+        std::unique_ptr<T> item(released);
+        std::lock_guard<std::mutex> lck(mtx);
+        if (free.size() < k_max_free) free.push_back(std::move(item));
+    }
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<T>> free;
+};
+
+// the pool of T, never destroyed: handles may be released during static destruction
+template <typename T>
+buffer_pool_t<T>& buffer_pool()
+{
+    static buffer_pool_t<T>* pool = new buffer_pool_t<T>;
+    return *pool;
+}
+
+} // namespace input_osm
+
+#endif // _BUFFERPOOL_H_
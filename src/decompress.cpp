@@ -0,0 +1,351 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decompress.h"
+
+#include "reader.h"
+
+#include <zlib.h>
+#ifdef INPUTOSM_HAVE_ZLIB_NG
+#include <zlib-ng.h>
+#endif
+#ifdef INPUTOSM_HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#ifdef INPUTOSM_HAVE_ISAL
+#include <isa-l/igzip_lib.h>
+#endif
+#ifdef INPUTOSM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef INPUTOSM_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include <limits>
+#include <memory>
+
+namespace input_osm
+{
+
+namespace
+{
+
+// one z_stream per thread, inflateReset keeps its window allocated between blobs
+struct zlib_context_t
+{
+    z_stream stream{};
+    bool initialized = false;
+
+    ~zlib_context_t()
+    {
+        if (initialized) inflateEnd(&stream);
+    }
+    bool inflate(const uint8_t* zip_ptr, size_t zip_size, uint8_t* raw_ptr, size_t raw_size) noexcept
+    {
+        if (!initialized)
+        {
+            if (inflateInit(&stream) != Z_OK) return false;
+            initialized = true;
+        }
+        else if (inflateReset(&stream) != Z_OK)
+            return false;
+        stream.next_in = const_cast<Bytef*>(zip_ptr);
+        stream.avail_in = static_cast<uInt>(zip_size);
+        stream.next_out = raw_ptr;
+        stream.avail_out = static_cast<uInt>(raw_size);
+        return ::inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == raw_size;
+    }
+};
+
+#ifdef INPUTOSM_HAVE_ZLIB_NG
+// native zlib-ng API, so it can be linked next to the system zlib
+struct zlib_ng_context_t
+{
+    zng_stream stream{};
+    bool initialized = false;
+
+    ~zlib_ng_context_t()
+    {
+        if (initialized) zng_inflateEnd(&stream);
+    }
+    bool inflate(const uint8_t* zip_ptr, size_t zip_size, uint8_t* raw_ptr, size_t raw_size) noexcept
+    {
+        if (!initialized)
+        {
+            if (zng_inflateInit(&stream) != Z_OK) return false;
+            initialized = true;
+        }
+        else if (zng_inflateReset(&stream) != Z_OK)
+            return false;
+        stream.next_in = zip_ptr;
+        stream.avail_in = static_cast<uint32_t>(zip_size);
+        stream.next_out = raw_ptr;
+        stream.avail_out = static_cast<uint32_t>(raw_size);
+        return zng_inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == raw_size;
+    }
+};
+#endif
+
+#ifdef INPUTOSM_HAVE_LIBDEFLATE
+// libdeflate inflates whole buffers in one call, the decompressor only holds its tables
+struct libdeflate_context_t
+{
+    libdeflate_decompressor* decompressor = nullptr;
+
+    ~libdeflate_context_t()
+    {
+        if (decompressor) libdeflate_free_decompressor(decompressor);
+    }
+    bool inflate(const uint8_t* zip_ptr, size_t zip_size, uint8_t* raw_ptr, size_t raw_size) noexcept
+    {
+        if (!decompressor && !(decompressor = libdeflate_alloc_decompressor())) return false;
+        size_t actual_size = 0;
+        return libdeflate_zlib_decompress(decompressor, zip_ptr, zip_size, raw_ptr, raw_size, &actual_size) ==
+                   LIBDEFLATE_SUCCESS &&
+               actual_size == raw_size;
+    }
+};
+#endif
+
+#ifdef INPUTOSM_HAVE_ISAL
+// inflate_state is large and self contained, allocate it once per thread
+struct isal_context_t
+{
+    std::unique_ptr<inflate_state> state;
+
+    bool inflate(const uint8_t* zip_ptr, size_t zip_size, uint8_t* raw_ptr, size_t raw_size) noexcept
+    {
+        if (!state)
+        {
+            state.reset(new (std::nothrow) inflate_state);
+            if (!state) return false;
+            isal_inflate_init(state.get());
+        }
+        else
+            isal_inflate_reset(state.get());
+        state->crc_flag = ISAL_ZLIB;
+        state->next_in = const_cast<uint8_t*>(zip_ptr);
+        state->avail_in = static_cast<uint32_t>(zip_size);
+        state->next_out = raw_ptr;
+        state->avail_out = static_cast<uint32_t>(raw_size);
+        return isal_inflate(state.get()) == ISAL_DECOMP_OK && state->block_state == ISAL_BLOCK_FINISH &&
+               state->total_out == raw_size;
+    }
+};
+#endif
+
+#ifdef INPUTOSM_HAVE_ZSTD
+// ZSTD_DCtx keeps its window and entropy tables between frames
+struct zstd_context_t
+{
+    ZSTD_DCtx* context = nullptr;
+
+    ~zstd_context_t()
+    {
+        if (context) ZSTD_freeDCtx(context);
+    }
+    bool decompress(const uint8_t* zip_ptr, size_t zip_size, uint8_t* raw_ptr, size_t raw_size) noexcept
+    {
+        if (!context && !(context = ZSTD_createDCtx())) return false;
+        const size_t size = ZSTD_decompressDCtx(context, raw_ptr, raw_size, zip_ptr, zip_size);
+        return !ZSTD_isError(size) && size == raw_size;
+    }
+};
+#endif
+
+} // namespace
+
+decompressor_t fastest_decompressor() noexcept
+{
+#if defined(INPUTOSM_HAVE_LIBDEFLATE)
+    return decompressor_t::libdeflate;
+#elif defined(INPUTOSM_HAVE_ISAL)
+    return decompressor_t::isal;
+#elif defined(INPUTOSM_HAVE_ZLIB_NG)
+    return decompressor_t::zlib_ng;
+#else
+    return decompressor_t::zlib;
+#endif
+}
+
+bool decompressor_available(decompressor_t decompressor)
+{
+    switch (decompressor)
+    {
+        case decompressor_t::zlib:
+            return true;
+        case decompressor_t::zlib_ng:
+#ifdef INPUTOSM_HAVE_ZLIB_NG
+            return true;
+#else
+            return false;
+#endif
+        case decompressor_t::libdeflate:
+#ifdef INPUTOSM_HAVE_LIBDEFLATE
+            return true;
+#else
+            return false;
+#endif
+        case decompressor_t::isal:
+#ifdef INPUTOSM_HAVE_ISAL
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool reader_t::set_decompressor(decompressor_t decompressor)
+{
+    if (!decompressor_available(decompressor)) return false;
+    state->decompressor = decompressor;
+    return true;
+}
+decompressor_t reader_t::decompressor() const
+{
+    return state->decompressor;
+}
+
+bool set_decompressor(decompressor_t decompressor)
+{
+    return default_reader().set_decompressor(decompressor);
+}
+decompressor_t decompressor()
+{
+    return default_reader().decompressor();
+}
+
+bool inflate_zlib(decompressor_t decompressor,
+                  const uint8_t* zip_ptr,
+                  size_t zip_size,
+                  uint8_t* raw_ptr,
+                  size_t raw_size) noexcept
+{
+    // the streaming APIs count in 32 bits, PBF blobs are limited to 32 MiB anyway
+    if (zip_size > std::numeric_limits<uint32_t>::max() || raw_size > std::numeric_limits<uint32_t>::max())
+        return false;
+    switch (decompressor)
+    {
+        case decompressor_t::zlib:
+        {
+            thread_local zlib_context_t context;
+            return context.inflate(zip_ptr, zip_size, raw_ptr, raw_size);
+        }
+#ifdef INPUTOSM_HAVE_ZLIB_NG
+        case decompressor_t::zlib_ng:
+        {
+            thread_local zlib_ng_context_t context;
+            return context.inflate(zip_ptr, zip_size, raw_ptr, raw_size);
+        }
+#endif
+#ifdef INPUTOSM_HAVE_LIBDEFLATE
+        case decompressor_t::libdeflate:
+        {
+            thread_local libdeflate_context_t context;
+            return context.inflate(zip_ptr, zip_size, raw_ptr, raw_size);
+        }
+#endif
+#ifdef INPUTOSM_HAVE_ISAL
+        case decompressor_t::isal:
+        {
+            thread_local isal_context_t context;
+            return context.inflate(zip_ptr, zip_size, raw_ptr, raw_size);
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* blob_compression_name(blob_compression_t compression) noexcept
+{
+    switch (compression)
+    {
+        case blob_compression_t::raw:
+            return "raw";
+        case blob_compression_t::zlib:
+            return "zlib";
+        case blob_compression_t::lzma:
+            return "lzma";
+        case blob_compression_t::bzip2:
+            return "bzip2";
+        case blob_compression_t::lz4:
+            return "lz4";
+        case blob_compression_t::zstd:
+            return "zstd";
+    }
+    return "unknown";
+}
+
+bool blob_compression_supported(blob_compression_t compression) noexcept
+{
+    switch (compression)
+    {
+        case blob_compression_t::raw:
+        case blob_compression_t::zlib:
+            return true;
+        case blob_compression_t::lz4:
+#ifdef INPUTOSM_HAVE_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case blob_compression_t::zstd:
+#ifdef INPUTOSM_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool decompress_blob(decompressor_t decompressor,
+                     blob_compression_t compression,
+                     const uint8_t* zip_ptr,
+                     size_t zip_size,
+                     uint8_t* raw_ptr,
+                     size_t raw_size) noexcept
+{
+    switch (compression)
+    {
+        case blob_compression_t::zlib:
+            return inflate_zlib(decompressor, zip_ptr, zip_size, raw_ptr, raw_size);
+#ifdef INPUTOSM_HAVE_ZSTD
+        case blob_compression_t::zstd:
+        {
+            thread_local zstd_context_t context;
+            return context.decompress(zip_ptr, zip_size, raw_ptr, raw_size);
+        }
+#endif
+#ifdef INPUTOSM_HAVE_LZ4
+        case blob_compression_t::lz4:
+        {
+            // LZ4 block format, stateless
+            if (zip_size > LZ4_MAX_INPUT_SIZE || raw_size > LZ4_MAX_INPUT_SIZE) return false;
+            const int size = LZ4_decompress_safe(reinterpret_cast<const char*>(zip_ptr),
+                                                 reinterpret_cast<char*>(raw_ptr),
+                                                 static_cast<int>(zip_size),
+                                                 static_cast<int>(raw_size));
+            return size >= 0 && static_cast<size_t>(size) == raw_size;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+} // namespace input_osm
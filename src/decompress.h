@@ -0,0 +1,69 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _DECOMPRESS_H_
+#define _DECOMPRESS_H_
+
+#include <inputosm/inputosm.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace input_osm
+{
+
+// Blob data variants, numbered like their Blob fields
+enum class blob_compression_t : uint8_t
+{
+    raw = 1,
+    zlib = 3,
+    lzma = 4,
+    bzip2 = 5,
+    lz4 = 6,
+    zstd = 7
+};
+
+// the default decompressor of a reader: the fastest one built in
+decompressor_t fastest_decompressor() noexcept;
+
+const char* blob_compression_name(blob_compression_t compression) noexcept;
+
+// true if blobs of this compression can be decoded by this build
+bool blob_compression_supported(blob_compression_t compression) noexcept;
+
+/**
+ * @brief Inflate a zlib stream of known inflated size
+ * @details Uses the calling thread's state of the given decompressor, created on first use and reset for each blob.
+ * @return false if the decompressor is not built in, the stream is corrupt or its size is not raw_size
+ */
+bool inflate_zlib(decompressor_t decompressor,
+                  const uint8_t* zip_ptr,
+                  size_t zip_size,
+                  uint8_t* raw_ptr,
+                  size_t raw_size) noexcept;
+
+/**
+ * @brief Decompress a Blob of known inflated size
+ * @details zlib goes through the given decompressor, zstd and lz4 use a per-thread context when built in.
+ * @return false if the compression is unsupported, the data is corrupt or its size is not raw_size
+ */
+bool decompress_blob(decompressor_t decompressor,
+                     blob_compression_t compression,
+                     const uint8_t* zip_ptr,
+                     size_t zip_size,
+                     uint8_t* raw_ptr,
+                     size_t raw_size) noexcept;
+
+} // namespace input_osm
+
+#endif // _DECOMPRESS_H_
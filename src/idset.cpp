@@ -0,0 +1,179 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inputosm/inputosm.h>
+
+#include "inputosmlog.h"
+#include "reader.h"
+
+#include <algorithm>
+
+namespace input_osm
+{
+
+namespace
+{
+constexpr size_t k_max_array_size = 4096;
+constexpr size_t k_bitmap_words = 65536 / 64;
+
+inline int64_t chunk_key(int64_t id)
+{
+    return id >> 16;
+}
+
+inline uint16_t chunk_low(int64_t id)
+{
+    return static_cast<uint16_t>(id & 0xffff);
+}
+
+// first chunk whose key is not below key
+template <typename Chunks>
+auto find_chunk(Chunks& chunks, int64_t key)
+{
+    return std::lower_bound(
+        chunks.begin(), chunks.end(), key, [](const auto& chunk, int64_t wanted) { return chunk.key < wanted; });
+}
+} // namespace
+
+bool id_set_t::chunk_t::has(uint16_t low) const
+{
+    if (!bitmap.empty()) return (bitmap[low >> 6] >> (low & 63)) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+bool id_set_t::chunk_t::any(uint16_t first, uint16_t last) const
+{
+    if (bitmap.empty())
+    {
+        const auto it = std::lower_bound(array.begin(), array.end(), first);
+        return it != array.end() && *it <= last;
+    }
+    for (size_t word = first >> 6; word <= size_t(last >> 6); word++)
+    {
+        uint64_t bits = bitmap[word];
+        if (word == size_t(first >> 6)) bits &= ~uint64_t{0} << (first & 63);
+        if (word == size_t(last >> 6)) bits &= ~uint64_t{0} >> (63 - (last & 63));
+        if (bits) return true;
+    }
+    return false;
+}
+
+void id_set_t::chunk_t::insert(uint16_t low)
+{
+    if (!bitmap.empty())
+    {
+        bitmap[low >> 6] |= uint64_t{1} << (low & 63);
+        return;
+    }
+    array.insert(std::lower_bound(array.begin(), array.end(), low), low);
+    if (array.size() <= k_max_array_size) return;
+    bitmap.assign(k_bitmap_words, 0);
+    for (uint16_t member : array) bitmap[member >> 6] |= uint64_t{1} << (member & 63);
+    array = {};
+}
+
+id_set_t::id_set_t(std::vector<int64_t> ids)
+{
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    count = ids.size();
+    for (size_t begin = 0, end; begin < ids.size(); begin = end)
+    {
+        chunk_t& chunk = chunks.emplace_back();
+        chunk.key = chunk_key(ids[begin]);
+        for (end = begin; end < ids.size() && chunk_key(ids[end]) == chunk.key; end++) {}
+        if (end - begin <= k_max_array_size)
+        {
+            chunk.array.reserve(end - begin);
+            for (size_t i = begin; i < end; i++) chunk.array.push_back(chunk_low(ids[i]));
+        }
+        else
+        {
+            chunk.bitmap.assign(k_bitmap_words, 0);
+            for (size_t i = begin; i < end; i++)
+            {
+                const uint16_t low = chunk_low(ids[i]);
+                chunk.bitmap[low >> 6] |= uint64_t{1} << (low & 63);
+            }
+        }
+    }
+}
+
+void id_set_t::insert(int64_t id)
+{
+    auto it = find_chunk(chunks, chunk_key(id));
+    if (it == chunks.end() || it->key != chunk_key(id))
+    {
+        it = chunks.insert(it, chunk_t());
+        it->key = chunk_key(id);
+    }
+    if (it->has(chunk_low(id))) return;
+    it->insert(chunk_low(id));
+    count++;
+}
+
+bool id_set_t::contains(int64_t id) const
+{
+    const auto it = find_chunk(chunks, chunk_key(id));
+    return it != chunks.end() && it->key == chunk_key(id) && it->has(chunk_low(id));
+}
+
+size_t id_set_t::contains(const int64_t* ids, size_t id_count, uint8_t* member) const
+{
+    size_t members = 0;
+    // the chunk of the previous id, ascending ids mostly stay in it
+    const chunk_t* chunk = nullptr;
+    for (size_t i = 0; i < id_count; i++)
+    {
+        const int64_t key = chunk_key(ids[i]);
+        if (!chunk || chunk->key != key)
+        {
+            const auto it = find_chunk(chunks, key);
+            chunk = it != chunks.end() && it->key == key ? &*it : nullptr;
+        }
+        member[i] = chunk && chunk->has(chunk_low(ids[i]));
+        members += member[i];
+    }
+    return members;
+}
+
+bool id_set_t::overlaps(int64_t first, int64_t last) const
+{
+    if (first > last) return false;
+    auto it = find_chunk(chunks, chunk_key(first));
+    for (; it != chunks.end() && it->key <= chunk_key(last); ++it)
+    {
+        const uint16_t low = it->key == chunk_key(first) ? chunk_low(first) : 0;
+        const uint16_t high = it->key == chunk_key(last) ? chunk_low(last) : 0xffff;
+        if (it->any(low, high)) return true;
+    }
+    return false;
+}
+
+bool reader_t::set_id_filter(entity_kind_t kind, id_set_t ids)
+{
+    if (kind != ENTITY_NODES && kind != ENTITY_WAYS && kind != ENTITY_RELATIONS)
+    {
+        IOSM_ERROR("id filter: exactly one entity kind expected");
+        return false;
+    }
+    state->id_filters[kind >> 1] = std::move(ids);
+    return true;
+}
+
+bool set_id_filter(entity_kind_t kind, id_set_t ids)
+{
+    return default_reader().set_id_filter(kind, std::move(ids));
+}
+
+} // namespace input_osm
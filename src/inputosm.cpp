@@ -14,42 +14,376 @@
 #include <inputosm/inputosm.h>
 
 #include "inputosmlog.h"
+#include "normalize.h"
+#include "reader.h"
 
 #include <cstring>
 #include <filesystem>
+#include <vector>
 
 namespace input_osm
 {
 
-bool decode_metadata;
-std::function<bool(span_t<node_t>)> node_handler;
-std::function<bool(span_t<way_t>)> way_handler;
-std::function<bool(span_t<relation_t>)> relation_handler;
-mode_t osc_mode;
+thread_local reader_state_t* current_reader = nullptr;
+thread_local mode_t osc_mode{mode_t::bulk};
 thread_local size_t thread_index{0};
 thread_local size_t block_index{0};
-file_type_t file_type{file_type_t::xml};
+thread_local size_t file_index{0};
+thread_local file_type_t file_type{file_type_t::xml};
 bool verbose = true;
 
 bool input_pbf(const char* filename) noexcept;
+bool input_pbf_files(const std::vector<std::string>& filenames, const std::vector<file_type_t>& file_types) noexcept;
 bool input_xml(const char* filename);
 
+namespace
+{
+// node_t batches (XML input) converted to columns
+bool nodes_to_columns(span_t<node_t> node_list, const reader_state_t& reader)
+{
+    const uint32_t node_fields = reader.node_fields;
+    thread_local std::vector<int64_t> ids, latitudes, longitudes, timestamps, changesets;
+    thread_local std::vector<double> latitude_degrees, longitude_degrees;
+    thread_local std::vector<uint64_t> versions;
+    thread_local std::vector<uint32_t> tag_offsets;
+    thread_local std::vector<tag_t> tags;
+    ids.clear();
+    latitudes.clear();
+    longitudes.clear();
+    versions.clear();
+    timestamps.clear();
+    changesets.clear();
+    tag_offsets.assign(1, 0);
+    tags.clear();
+    for (const auto& node : node_list)
+    {
+        ids.push_back(node.id);
+        latitudes.push_back(node.raw_latitude);
+        longitudes.push_back(node.raw_longitude);
+        tags.insert(tags.end(), node.tags.begin(), node.tags.end());
+        tag_offsets.push_back(static_cast<uint32_t>(tags.size()));
+        if (node_fields & PROJECT_VERSION) versions.push_back(node.version);
+        if (node_fields & PROJECT_TIMESTAMP) timestamps.push_back(node.timestamp);
+        if (node_fields & PROJECT_CHANGESET) changesets.push_back(node.changeset);
+    }
+    node_columns_t columns;
+    columns.id = ids;
+    if (node_fields & PROJECT_COORDINATES)
+    {
+        columns.raw_latitude = latitudes;
+        columns.raw_longitude = longitudes;
+    }
+    if (node_fields & PROJECT_DEGREES)
+    {
+        latitude_degrees.resize(latitudes.size());
+        longitude_degrees.resize(longitudes.size());
+        to_degrees(latitudes.data(), latitudes.size(), latitude_degrees.data());
+        to_degrees(longitudes.data(), longitudes.size(), longitude_degrees.data());
+        columns.latitude = latitude_degrees;
+        columns.longitude = longitude_degrees;
+    }
+    if (!tags.empty())
+    {
+        columns.tag_offsets = tag_offsets;
+        columns.tags = tags;
+    }
+    columns.version = versions;
+    columns.timestamp = timestamps;
+    columns.changeset = changesets;
+    return reader.node_columns_handler(columns);
+}
+
+// node_t batches (XML input, PBF non dense nodes) converted to compact_node_t
+bool nodes_to_compact(span_t<node_t> node_list, function_ref_t<bool(span_t<compact_node_t>)> handler)
+{
+    thread_local std::vector<compact_node_t> compact_list;
+    compact_list.resize(node_list.size());
+    for (size_t i = 0; i < node_list.size(); i++)
+    {
+        compact_list[i].id = node_list[i].id;
+        compact_list[i].raw_latitude = static_cast<int32_t>(node_list[i].raw_latitude);
+        compact_list[i].raw_longitude = static_cast<int32_t>(node_list[i].raw_longitude);
+        compact_list[i].tags = node_list[i].tags;
+    }
+    return handler(span_t{compact_list.data(), compact_list.size()});
+}
+
+bool input_file_impl(reader_state_t& state, const char* filename) noexcept;
+bool input_files_impl(reader_state_t& state, const std::vector<std::string>& filenames) noexcept;
+} // namespace
+
+reader_t::reader_t()
+    : state(std::make_unique<reader_state_t>())
+{
+}
+
+reader_t::~reader_t() = default;
+
+reader_t& default_reader()
+{
+    static reader_t reader;
+    return reader;
+}
+
+bool reader_t::input_file(const char* filename,
+                          bool decode_metadata,
+                          std::function<bool(span_t<node_t>)> node_handler,
+                          std::function<bool(span_t<way_t>)> way_handler,
+                          std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    return input_file_ref(filename, decode_metadata, node_handler, way_handler, relation_handler);
+}
+
+bool reader_t::input_file_ref(const char* filename,
+                              bool decode_metadata,
+                              function_ref_t<bool(span_t<node_t>)> node_handler,
+                              function_ref_t<bool(span_t<way_t>)> way_handler,
+                              function_ref_t<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    state->decode_metadata = decode_metadata;
+    state->node_handler = node_handler;
+    state->node_columns_handler = nullptr;
+    state->compact_node_handler = nullptr;
+    state->way_handler = way_handler;
+    state->relation_handler = relation_handler;
+    const bool result = input_file_impl(*state, filename);
+    state->clear_handlers();
+    return result;
+}
+
+bool reader_t::input_file_columnar(const char* filename,
+                                   bool decode_metadata,
+                                   std::function<bool(const node_columns_t&)> node_handler,
+                                   std::function<bool(span_t<way_t>)> way_handler,
+                                   std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    state->decode_metadata = decode_metadata;
+    // the PBF reader hands dense nodes to node_columns_handler, node_handler converts everything else
+    auto convert = [reader = state.get()](span_t<node_t> node_list) { return nodes_to_columns(node_list, *reader); };
+    state->node_columns_handler = node_handler;
+    state->compact_node_handler = nullptr;
+    state->node_handler = nullptr;
+    if (state->node_columns_handler) state->node_handler = convert;
+    state->way_handler = way_handler;
+    state->relation_handler = relation_handler;
+    const bool result = input_file_impl(*state, filename);
+    state->clear_handlers();
+    return result;
+}
+
+template <>
+bool reader_t::input_file_as<node_t>(const char* filename,
+                                     bool decode_metadata,
+                                     std::function<bool(span_t<node_t>)> node_handler,
+                                     std::function<bool(span_t<way_t>)> way_handler,
+                                     std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    return input_file_ref(filename, decode_metadata, node_handler, way_handler, relation_handler);
+}
+
+template <>
+bool reader_t::input_file_as<compact_node_t>(const char* filename,
+                                             bool decode_metadata,
+                                             std::function<bool(span_t<compact_node_t>)> node_handler,
+                                             std::function<bool(span_t<way_t>)> way_handler,
+                                             std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    state->decode_metadata = decode_metadata;
+    // the PBF reader fills compact records from dense nodes, node_handler converts everything else
+    auto convert = [reader = state.get()](span_t<node_t> node_list) {
+        return nodes_to_compact(node_list, reader->compact_node_handler);
+    };
+    state->compact_node_handler = node_handler;
+    state->node_columns_handler = nullptr;
+    state->node_handler = nullptr;
+    if (state->compact_node_handler) state->node_handler = convert;
+    state->way_handler = way_handler;
+    state->relation_handler = relation_handler;
+    const bool result = input_file_impl(*state, filename);
+    state->clear_handlers();
+    return result;
+}
+
+bool reader_t::input_files(const std::vector<std::string>& filenames,
+                           bool decode_metadata,
+                           std::function<bool(span_t<node_t>)> node_handler,
+                           std::function<bool(span_t<way_t>)> way_handler,
+                           std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    state->decode_metadata = decode_metadata;
+    state->node_handler = node_handler;
+    state->node_columns_handler = nullptr;
+    state->compact_node_handler = nullptr;
+    state->way_handler = way_handler;
+    state->relation_handler = relation_handler;
+    const bool result = input_files_impl(*state, filenames);
+    state->clear_handlers();
+    return result;
+}
+
+void reader_t::set_projection(uint32_t entity_kinds, uint32_t fields)
+{
+    if (entity_kinds & ENTITY_NODES) state->projection[0] = fields & (PROJECT_ALL | PROJECT_DEGREES);
+    if (entity_kinds & ENTITY_WAYS) state->projection[1] = fields & PROJECT_ALL;
+    if (entity_kinds & ENTITY_RELATIONS) state->projection[2] = fields & PROJECT_ALL;
+}
+uint32_t reader_t::projection(entity_kind_t kind) const
+{
+    return state->projection[kind == ENTITY_NODES ? 0 : kind == ENTITY_WAYS ? 1 : 2];
+}
+void reader_t::set_batch_retention(bool retain)
+{
+    state->batch_retention = retain;
+}
+bool reader_t::batch_retention() const
+{
+    return state->batch_retention;
+}
+void reader_t::cancel()
+{
+    state->cancel();
+}
+void reader_t::set_timeout(std::chrono::milliseconds timeout)
+{
+    state->timeout = timeout;
+}
+std::chrono::milliseconds reader_t::timeout() const
+{
+    return state->timeout;
+}
+stop_reason_t reader_t::stop_reason() const
+{
+    return state->stop_reason.load();
+}
+
+batch_handle_t retain_batch()
+{
+    if (!current_reader || !current_reader->batch_retention) return {};
+    // at most one of the decoders is delivering on this thread
+    if (batch_handle_t handle = retain_pbf_batch()) return handle;
+    return retain_xml_batch();
+}
+
 bool input_file(const char* filename,
                 bool decode_metadata,
                 std::function<bool(span_t<node_t>)> node_handler,
                 std::function<bool(span_t<way_t>)> way_handler,
                 std::function<bool(span_t<relation_t>)> relation_handler) noexcept
 {
-    input_osm::decode_metadata = decode_metadata;
-    input_osm::node_handler = std::move(node_handler);
-    input_osm::way_handler = way_handler;
-    input_osm::relation_handler = relation_handler;
+    return default_reader().input_file(
+        filename, decode_metadata, std::move(node_handler), std::move(way_handler), std::move(relation_handler));
+}
+
+bool input_file_ref(const char* filename,
+                    bool decode_metadata,
+                    function_ref_t<bool(span_t<node_t>)> node_handler,
+                    function_ref_t<bool(span_t<way_t>)> way_handler,
+                    function_ref_t<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    return default_reader().input_file_ref(filename, decode_metadata, node_handler, way_handler, relation_handler);
+}
+
+bool input_file_columnar(const char* filename,
+                         bool decode_metadata,
+                         std::function<bool(const node_columns_t&)> node_handler,
+                         std::function<bool(span_t<way_t>)> way_handler,
+                         std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    return default_reader().input_file_columnar(
+        filename, decode_metadata, std::move(node_handler), std::move(way_handler), std::move(relation_handler));
+}
+
+template <>
+bool input_file_as<node_t>(const char* filename,
+                           bool decode_metadata,
+                           std::function<bool(span_t<node_t>)> node_handler,
+                           std::function<bool(span_t<way_t>)> way_handler,
+                           std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    return default_reader().input_file_as<node_t>(
+        filename, decode_metadata, std::move(node_handler), std::move(way_handler), std::move(relation_handler));
+}
+
+template <>
+bool input_file_as<compact_node_t>(const char* filename,
+                                   bool decode_metadata,
+                                   std::function<bool(span_t<compact_node_t>)> node_handler,
+                                   std::function<bool(span_t<way_t>)> way_handler,
+                                   std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    return default_reader().input_file_as<compact_node_t>(
+        filename, decode_metadata, std::move(node_handler), std::move(way_handler), std::move(relation_handler));
+}
+
+bool input_files(const std::vector<std::string>& filenames,
+                 bool decode_metadata,
+                 std::function<bool(span_t<node_t>)> node_handler,
+                 std::function<bool(span_t<way_t>)> way_handler,
+                 std::function<bool(span_t<relation_t>)> relation_handler) noexcept
+{
+    return default_reader().input_files(
+        filenames, decode_metadata, std::move(node_handler), std::move(way_handler), std::move(relation_handler));
+}
+
+void set_projection(uint32_t entity_kinds, uint32_t fields)
+{
+    default_reader().set_projection(entity_kinds, fields);
+}
+uint32_t projection(entity_kind_t kind)
+{
+    return default_reader().projection(kind);
+}
+void set_batch_retention(bool retain)
+{
+    default_reader().set_batch_retention(retain);
+}
+bool batch_retention()
+{
+    return default_reader().batch_retention();
+}
+void cancel()
+{
+    default_reader().cancel();
+}
+void set_timeout(std::chrono::milliseconds timeout)
+{
+    default_reader().set_timeout(timeout);
+}
+std::chrono::milliseconds timeout()
+{
+    return default_reader().timeout();
+}
+stop_reason_t stop_reason()
+{
+    return default_reader().stop_reason();
+}
+
+namespace
+{
+// the fields to decode and the thread-local state of the calling thread, for a read that starts
+void begin_read(reader_state_t& state) noexcept
+{
+    const uint32_t metadata = state.decode_metadata ? ~0u : ~uint32_t{PROJECT_METADATA};
+    state.node_fields = state.projection[0] & metadata;
+    // compact_node_t has neither metadata nor degree fields
+    if (state.compact_node_handler) state.node_fields &= ~uint32_t{PROJECT_METADATA | PROJECT_DEGREES};
+    state.way_fields = state.projection[1] & metadata;
+    state.relation_fields = state.projection[2] & metadata;
+    state.stop_reason = stop_reason_t::none;
+    state.reading = true;
+    if (state.cancel_pending.exchange(false)) state.stop(stop_reason_t::cancel);
+    state.deadline = state.timeout.count() > 0 ? std::chrono::steady_clock::now() + state.timeout
+                                               : std::chrono::steady_clock::time_point::max();
     input_osm::osc_mode = mode_t::bulk;
     input_osm::file_type = file_type_t::xml;
     input_osm::thread_index = 0;
     input_osm::block_index = 0;
-    bool result = false;
+    input_osm::file_index = 0;
+}
 
+// the file type from the extension: .osm and .osc are XML, .pbf is PBF
+bool detect_file_type(const char* filename, file_type_t& type) noexcept
+{
     if (!filename)
     {
         IOSM_ERROR("Invalid file name: null");
@@ -69,18 +403,38 @@ bool input_file(const char* filename,
 
     if (extension.compare(k_osm) == 0 || extension.compare(k_osc) == 0)
     {
-        input_osm::file_type = file_type_t::xml;
+        type = file_type_t::xml;
     }
     else if (extension.compare(k_pbf) == 0)
     {
-        input_osm::file_type = file_type_t::pbf;
+        type = file_type_t::pbf;
     }
     else
     {
         IOSM_ERROR("Can't detect type from: %s", filename);
         return false;
     }
+    return true;
+}
+
+// false when the read failed or stopped early, with the reason why
+bool end_read(reader_state_t& state, bool result) noexcept
+{
+    if (!result) state.stop(stop_reason_t::error);
+    // a cancel() that came in while the read ran was for this read
+    state.reading = false;
+    state.cancel_pending = false;
+    return result && state.stop_reason.load() == stop_reason_t::none;
+}
 
+bool input_file_impl(reader_state_t& state, const char* filename) noexcept
+{
+    current_reader_scope_t scope(&state);
+    begin_read(state);
+    if (state.stopped()) return end_read(state, true);
+    if (!detect_file_type(filename, input_osm::file_type)) return end_read(state, false);
+
+    bool result = false;
     switch (input_osm::file_type)
     {
         case file_type_t::pbf:
@@ -90,8 +444,20 @@ bool input_file(const char* filename,
             result = input_xml(filename);
             break;
     };
-    return result;
+    return end_read(state, result);
+}
+
+bool input_files_impl(reader_state_t& state, const std::vector<std::string>& filenames) noexcept
+{
+    current_reader_scope_t scope(&state);
+    begin_read(state);
+    if (state.stopped()) return end_read(state, true);
+    std::vector<file_type_t> file_types(filenames.size());
+    for (size_t i = 0; i < filenames.size(); i++)
+        if (!detect_file_type(filenames[i].c_str(), file_types[i])) return end_read(state, false);
+    return end_read(state, input_pbf_files(filenames, file_types));
 }
+} // namespace
 
 void set_verbose(bool value)
 {
@@ -15,21 +15,36 @@
 
 #include "inputosmlog.h"
 #include "timeutil.h"
+#include "workerpool.h"
+#include "blockindex.h"
+#include "decompress.h"
+#include "varint.h"
+#include "spatialfilter.h"
+#include "normalize.h"
+#include "reader.h"
+#include "bufferpool.h"
 
 #include <cstdint>
 #include <cinttypes>
 #include <cstring>
 #include <vector>
-#include <zlib.h>
 #include <thread>
 #include <iostream>
 #include <mutex>
+#include <condition_variable>
 #include <queue>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <chrono>
 #include <iomanip>
+#include <type_traits>
 
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 namespace input_osm
 {
@@ -40,11 +55,6 @@ namespace input_osm
  * @link https://developers.google.com/protocol-buffers/docs/encoding#structure @endlink
  */
 
-extern bool decode_metadata;
-extern std::function<bool(span_t<node_t>)> node_handler;
-extern std::function<bool(span_t<way_t>)> way_handler;
-extern std::function<bool(span_t<relation_t>)> relation_handler;
-
 extern bool verbose;
 struct field_t
 {
@@ -54,38 +64,199 @@ struct field_t
     uint64_t value_uint64{0};
 };
 
+/**
+ * @brief Strings of one primitive block, referenced in place
+ * @details Each string is followed by the key of the next string table field. Once the table is parsed that byte is
+ * not needed any more, so it is overwritten with the terminating NUL. Only the last string, and all strings of a block
+ * that is not writable (a raw blob in the read only file mapping), are copied.
+ */
 struct string_table_t
 {
-    std::vector<std::size_t> st_index;
-    std::vector<uint8_t> st_buffer;
-
-    void clear()
+    struct entry_t
     {
-        st_buffer.clear();
-        st_index.clear();
-    }
+        const char* data;
+        uint32_t length;
+    };
+    std::vector<entry_t> entries;
+    std::vector<char> copies;
+
+    void clear() { entries.clear(); }
     void init(size_t byte_size)
     {
-        st_buffer.clear();
-        st_index.clear();
-        if (byte_size > st_buffer.capacity()) st_buffer.reserve(byte_size);
+        entries.clear();
+        copies.clear();
+        // every string takes at least a key and a length byte, so the copies fit and never move
+        if (byte_size > copies.capacity()) copies.reserve(byte_size);
     }
-    void add(uint8_t* buf, size_t len)
+    void add(uint8_t* buf, size_t len) { entries.push_back({(const char*)buf, static_cast<uint32_t>(len)}); }
+    // NUL terminate every string, in place up to end if the block is writable
+    void terminate(uint8_t* end)
     {
-        st_index.emplace_back(st_buffer.size());
-        st_buffer.insert(st_buffer.end(), buf, buf + len);
-        st_buffer.emplace_back(0);
+        for (auto& entry : entries)
+        {
+            char* next = const_cast<char*>(entry.data) + entry.length;
+            if (next < (char*)end)
+            {
+                *next = 0;
+                continue;
+            }
+            const char* copy = copies.data() + copies.size();
+            copies.insert(copies.end(), entry.data, entry.data + entry.length);
+            copies.push_back(0);
+            entry.data = copy;
+        }
     }
 
-    const char* get(uint32_t index) { return (const char*)st_buffer.data() + st_index[index]; }
+    const char* get(uint32_t index) const { return entries[index].data; }
+    const entry_t& entry(uint32_t index) const { return entries[index]; }
 };
 
+// set tag key or value and its length
+inline void set_key(tag_t& tag, const string_table_t::entry_t& entry)
+{
+    tag.key = entry.data;
+    tag.key_length = entry.length;
+}
+inline void set_value(tag_t& tag, const string_table_t::entry_t& entry)
+{
+    tag.value = entry.data;
+    tag.value_length = entry.length;
+}
+
 // This primitive block's data
 thread_local string_table_t string_table;
-thread_local int32_t granularity = 100;
-thread_local int64_t lat_offset = 0;
-thread_local int64_t lon_offset = 0;
-thread_local int32_t date_granularity = 1000;
+thread_local bool writable_block = false;
+thread_local std::vector<uint8_t> inflated_block;
+
+// tag filter terms matched by each string of this block's string table
+struct block_tag_masks_t
+{
+    std::vector<tag_matcher_t::string_terms_t> strings;
+    bool any_key = false; // a string of the table is a key of a filter term
+
+    void clear()
+    {
+        strings.clear();
+        any_key = false;
+    }
+    void build(const tag_matcher_t& tag_matcher, const string_table_t& table)
+    {
+        strings.resize(table.entries.size());
+        any_key = false;
+        for (size_t i = 0; i < strings.size(); i++)
+        {
+            strings[i] = tag_matcher.lookup(table.entries[i].data, table.entries[i].length);
+            any_key = any_key || strings[i].key;
+        }
+    }
+    // terms matched by the tag with these key and value string indexes
+    uint64_t matched(const tag_matcher_t& tag_matcher, uint64_t key, uint64_t value) const
+    {
+        if (key >= strings.size() || !strings[key].key) return 0;
+        return strings[key].key & (tag_matcher.key_only_terms | (value < strings.size() ? strings[value].value : 0));
+    }
+};
+thread_local block_tag_masks_t block_tag_masks;
+
+// false if no entity of this kind in the block can pass the tag filter
+inline bool tag_filter_may_pass(entity_kind_t kind)
+{
+    const tag_matcher_t& tag_matcher = current_reader->tag_matcher;
+    return !tag_matcher.applies(kind) || block_tag_masks.any_key || tag_matcher.accepts_untagged;
+}
+
+// true if the entities of this kind have to be tested one by one
+inline bool tag_filter_tests(entity_kind_t kind)
+{
+    return current_reader->tag_matcher.applies(kind) && block_tag_masks.any_key;
+}
+// granularity, offsets and date granularity of the current block, to 1e-7 degrees and seconds
+thread_local linear_scale_t latitude_scale;
+thread_local linear_scale_t longitude_scale;
+thread_local linear_scale_t timestamp_scale;
+
+/**
+ * @brief Hands the decoded batches to the handlers in ascending block_index order
+ * @details A worker takes the turn of its block before its first handler call and gives it up when the block is
+ * done. Blocks that never call a handler are only marked finished, so their worker moves on. Workers can run at most
+ * `window` blocks ahead of the oldest undelivered one, which caps the reorder state at one decoded block per worker.
+ * Once the read is stopped the turns are cancelled, so no worker waits for a block that will never be delivered.
+ */
+struct delivery_order_t
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t next_block = 0;
+    std::vector<uint8_t> finished; // ring indexed by block % window
+    bool enabled = false;
+    bool cancelled = false;
+
+    void open(bool enable, size_t window)
+    {
+        enabled = enable;
+        next_block = 0;
+        cancelled = false;
+        finished.assign(std::max<size_t>(window, 1), 0);
+    }
+    // wake all waiting workers, no turn is given anymore
+    void cancel()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            cancelled = true;
+        }
+        cv.notify_all();
+    }
+    // wait until all previous blocks are delivered, false if cancelled meanwhile
+    bool take_turn(size_t block)
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        cv.wait(lck, [this, block] { return next_block == block || cancelled; });
+        return !cancelled;
+    }
+    void finish(size_t block)
+    {
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv.wait(lck, [this, block] { return block < next_block + finished.size() || cancelled; });
+            if (cancelled) return;
+            finished[block % finished.size()] = 1;
+            while (finished[next_block % finished.size()])
+            {
+                finished[next_block % finished.size()] = 0;
+                next_block++;
+            }
+        }
+        cv.notify_all();
+    }
+};
+thread_local bool delivery_turn_taken = false;
+thread_local size_t delivery_sequence = 0; // position of the current block among the enumerated ones
+
+// call before handing a batch of the current block to a user handler, false if the read was stopped meanwhile
+inline bool take_delivery_turn();
+
+// stop the read on all workers, the first reason is kept
+inline void stop_read(stop_reason_t reason);
+// whether the read was stopped, by any thread or by the timeout
+inline bool read_stopped();
+
+// kind of the batch being handed to a handler on this thread, 0 between handlers, and its handle once retained
+thread_local uint32_t delivering = 0;
+thread_local batch_handle_t delivered_handle;
+
+// hand a batch of the current block to a handler, which may retain_batch it meanwhile
+template <typename Handler, typename Batch>
+inline bool deliver(entity_kind_t kind, const Handler& handler, const Batch& batch)
+{
+    if (!take_delivery_turn() || read_stopped()) return false;
+    delivering = kind;
+    const bool result = handler(batch);
+    delivering = 0;
+    delivered_handle.reset();
+    if (!result) stop_read(stop_reason_t::handler);
+    return result;
+}
 
 static constexpr uint32_t KEY(uint32_t field_number, uint8_t wire_type)
 {
@@ -124,11 +295,6 @@ inline uint64_t read_varint_sint64(uint8_t*& ptr) noexcept
     return to_sint64(read_varint_uint64(ptr));
 }
 
-inline int64_t read_varint_int64(uint8_t*& ptr) noexcept
-{
-    return (int64_t)read_varint_uint64(ptr);
-}
-
 inline uint8_t* read_field(uint8_t* ptr, field_t& field) noexcept
 {
     field.key = read_varint_uint64(ptr); // BUGFIX: id5wt3 is actually a varint
@@ -159,26 +325,56 @@ inline uint8_t* read_field(uint8_t* ptr, field_t& field) noexcept
     return ptr;
 }
 
-inline bool unzip_compressed_block(uint8_t* zip_ptr, size_t zip_sz, uint8_t* raw_ptr, size_t raw_sz) noexcept
+// decoded values of a packed field. the storage only grows, so steady state decoding does not touch the allocator
+template <typename T>
+struct column_t
+{
+    std::vector<T> storage;
+    size_t size = 0;
+
+    T* reserve(size_t capacity)
+    {
+        if (storage.size() < capacity)
+        {
+            if (storage.capacity() < capacity) current_reader->buffer_grows.fetch_add(1, std::memory_order_relaxed);
+            storage.resize(capacity);
+        }
+        return storage.data();
+    }
+    // pad with zeros or cut to count values
+    void fit(size_t count)
+    {
+        if (size < count) std::fill(reserve(count) + size, storage.data() + count, T{});
+        size = count;
+    }
+    T& operator[](size_t index) { return storage[index]; }
+    span_t<T> span() const { return {storage.data(), size}; }
+};
+
+inline span_t<int64_t> decode_delta_column(const field_t& field, column_t<int64_t>& column) noexcept
 {
-    uLongf size = raw_sz;
-    int ret = uncompress(raw_ptr, &size, zip_ptr, zip_sz);
-    return ret == Z_OK && size == raw_sz;
+    column.size = decode_packed_delta_sint64(field.pointer, field.pointer + field.length, column.reserve(field.length));
+    return column.span();
 }
 
-inline void read_sint64_packed(std::vector<int64_t>& packed, uint8_t* ptr, uint8_t* end) noexcept
+inline span_t<uint64_t> decode_uint_column(const field_t& field, column_t<uint64_t>& column) noexcept
 {
-    while (ptr < end) packed.emplace_back(read_varint_sint64(ptr));
+    column.size = decode_packed_uint64(field.pointer, field.pointer + field.length, column.reserve(field.length));
+    return column.span();
 }
 
-inline void read_sint32_packed(std::vector<int32_t>& packed, uint8_t* ptr, uint8_t* end) noexcept
+// decode a packed zigzag delta field, the column is valid until the next call on this thread
+inline span_t<int64_t> decode_delta_column(const field_t& field) noexcept
 {
-    while (ptr < end) packed.emplace_back(read_varint_sint64(ptr));
+    thread_local column_t<int64_t> column;
+    return decode_delta_column(field, column);
 }
 
-inline void read_uint32_packed(std::vector<uint32_t>& packed, uint8_t* ptr, uint8_t* end) noexcept
+// decode a packed uint field, the column is valid until the next call on this thread
+inline span_t<uint64_t> decode_uint_column(const field_t& field) noexcept
 {
-    while (ptr < end) packed.emplace_back(read_varint_uint64(ptr));
+    thread_local column_t<uint64_t> column;
+    return decode_uint_column(field, column);
 }
 
 template <typename Handler>
@@ -196,563 +392,749 @@ inline bool iterate_fields(uint8_t* ptr, uint8_t* end, Handler&& handler) noexce
 
 inline bool read_string_table(uint8_t* ptr, uint8_t* end) noexcept
 {
-    return iterate_fields(ptr, end, [&](field_t& field) -> bool {
-        if (field.key == KEY(1, 2)) // string
-            string_table.add(field.pointer, field.length);
-        return true;
-    });
+    string_table.init(end - ptr);
+    if (!iterate_fields(ptr, end, [&](field_t& field) -> bool {
+            if (field.key == KEY(1, 2)) // string
+                string_table.add(field.pointer, field.length);
+            return true;
+        }))
+        return false;
+    string_table.terminate(writable_block ? end : nullptr);
+    const tag_matcher_t& tag_matcher = current_reader->tag_matcher;
+    if (tag_matcher.entity_kinds) block_tag_masks.build(tag_matcher, string_table);
+    return true;
 }
 
-template <typename T>
-inline bool check_capacity(std::vector<T>& vec, std::size_t index, const char* subject)
+// dense node columns of one group, decoded straight from the packed fields
+struct dense_nodes_t
 {
-    size_t previous_capacity = vec.capacity();
-    while (index >= vec.size())
+    column_t<int64_t> id;
+    column_t<int64_t> latitude;
+    column_t<int64_t> longitude;
+    column_t<uint64_t> version;
+    column_t<int64_t> timestamp;
+    column_t<int64_t> changeset;
+    column_t<uint64_t> keys_vals;
+    column_t<uint32_t> tag_offsets;
+    std::vector<tag_t> tags;
+    column_t<double> latitude_degrees;
+    column_t<double> longitude_degrees;
+    // nodes kept by the id and spatial filters, all while keep_flags.size is 0
+    column_t<uint8_t> keep_flags;
+    column_t<uint8_t> inside_flags;
+    size_t kept_count = 0;
+
+    void clear()
+    {
+        id.size = latitude.size = longitude.size = version.size = timestamp.size = changeset.size = 0;
+        keys_vals.size = tag_offsets.size = 0;
+        latitude_degrees.size = longitude_degrees.size = 0;
+        keep_flags.size = 0;
+        tags.clear();
+    }
+
+    // resolve keys_vals into tags, the tags of node i are tags[tag_offsets[i]] .. tags[tag_offsets[i + 1] - 1]
+    void read_tags()
     {
-        vec.emplace_back();
-        if (vec.capacity() > previous_capacity)
+        const size_t count = id.size;
+        if (!keys_vals.size) return;
+        // at most one tag per two indexes
+        if (tags.capacity() < keys_vals.size / 2)
         {
-            IOSM_TRACE("%s capacity exceeded: %zu/%zu on thread %zu",
-                       subject,
-                       vec.capacity(),
-                       previous_capacity,
-                       thread_index);
-            return false;
+            tags.reserve(keys_vals.size / 2);
+            current_reader->buffer_grows.fetch_add(1, std::memory_order_relaxed);
+        }
+        uint32_t* offsets = tag_offsets.reserve(count + 1);
+        size_t inode = 0;
+        offsets[0] = 0;
+        for (size_t i = 0; i < keys_vals.size && inode < count;)
+        {
+            // read key
+            const uint64_t istring = keys_vals[i++];
+            if (!istring)
+            {
+                // finish up current node
+                offsets[++inode] = static_cast<uint32_t>(tags.size());
+                continue;
+            }
+            if (i == keys_vals.size) break; // key without value
+            // add to tags
+            tag_t& tag = tags.emplace_back();
+            set_key(tag, string_table.entry(istring));
+            set_value(tag, string_table.entry(keys_vals[i++]));
         }
+        // nodes missing from a short stream have no tags
+        while (inode < count) offsets[++inode] = static_cast<uint32_t>(tags.size());
+        tag_offsets.size = count + 1;
     }
-    return true;
+
+    // keep only the nodes in the id set, returns their number
+    size_t keep_ids(const id_set_t& ids)
+    {
+        keep_flags.size = id.size;
+        return kept_count = ids.contains(id.storage.data(), id.size, keep_flags.reserve(id.size));
+    }
+
+    // keep only the nodes inside the area too, returns the number kept
+    size_t keep_inside(const spatial_filter_t& area)
+    {
+        const size_t count = id.size;
+        const int64_t* lat = latitude.storage.data();
+        const int64_t* lon = longitude.storage.data();
+        if (!keep_flags.size)
+        {
+            keep_flags.size = count;
+            return kept_count = mark_inside(area, lat, lon, count, keep_flags.reserve(count));
+        }
+        uint8_t* inside = inside_flags.reserve(count);
+        mark_inside(area, lat, lon, count, inside);
+        kept_count = 0;
+        for (size_t i = 0; i < count; i++) kept_count += keep_flags[i] &= inside[i];
+        return kept_count;
+    }
+
+    // drop the nodes not kept by keep_ids and keep_inside, and those whose tags fail the tag filter; keys_vals is
+    // compacted along for read_tags
+    void select(bool tag_filter)
+    {
+        const tag_matcher_t& tag_matcher = current_reader->tag_matcher;
+        const size_t count = id.size;
+        const uint8_t* keep = keep_flags.size && kept_count < count ? keep_flags.storage.data() : nullptr;
+        if (!keep && !tag_filter) return;
+
+        size_t kept = 0, kept_keys_vals = 0;
+        for (size_t inode = 0, i = 0; inode < count; inode++)
+        {
+            const size_t begin = i;
+            const bool candidate = !keep || keep[inode];
+            uint64_t matched = 0;
+            for (; i < keys_vals.size && keys_vals[i]; i += 2)
+                if (candidate && tag_filter && i + 1 < keys_vals.size)
+                    matched |= block_tag_masks.matched(tag_matcher, keys_vals[i], keys_vals[i + 1]);
+            if (i < keys_vals.size) i++; // end of node
+            i = std::min(i, keys_vals.size);
+            if (!candidate || (tag_filter && !tag_matcher.filter.evaluate(matched))) continue;
+
+            id[kept] = id[inode];
+            if (latitude.size)
+            {
+                latitude[kept] = latitude[inode];
+                longitude[kept] = longitude[inode];
+            }
+            if (version.size) version[kept] = version[inode];
+            if (timestamp.size) timestamp[kept] = timestamp[inode];
+            if (changeset.size) changeset[kept] = changeset[inode];
+            std::copy(keys_vals.storage.begin() + begin,
+                      keys_vals.storage.begin() + i,
+                      keys_vals.storage.begin() + kept_keys_vals);
+            kept_keys_vals += i - begin;
+            kept++;
+        }
+        id.size = kept;
+        if (latitude.size) latitude.size = longitude.size = kept;
+        if (version.size) version.size = kept;
+        if (timestamp.size) timestamp.size = kept;
+        if (changeset.size) changeset.size = kept;
+        keys_vals.size = kept_keys_vals;
+    }
+
+    void to_degrees()
+    {
+        const size_t count = id.size;
+        input_osm::to_degrees(latitude.storage.data(), count, latitude_degrees.reserve(count));
+        input_osm::to_degrees(longitude.storage.data(), count, longitude_degrees.reserve(count));
+        latitude_degrees.size = longitude_degrees.size = count;
+    }
+
+    node_columns_t columns() const
+    {
+        node_columns_t columns;
+        columns.id = id.span();
+        columns.raw_latitude = latitude.span();
+        columns.raw_longitude = longitude.span();
+        columns.latitude = latitude_degrees.span();
+        columns.longitude = longitude_degrees.span();
+        if (tag_offsets.size)
+        {
+            columns.tag_offsets = tag_offsets.span();
+            columns.tags = span_t{tags.data(), tags.size()};
+        }
+        columns.version = version.span();
+        columns.timestamp = timestamp.span();
+        columns.changeset = changeset.span();
+        return columns;
+    }
+
+    // scatter into node_t or compact_node_t records
+    template <class Node>
+    void to_nodes(std::vector<Node>& node_list) const
+    {
+        using coordinate_t = decltype(Node::raw_latitude);
+        const size_t count = id.size;
+        node_list.resize(count);
+        for (size_t i = 0; i < count; i++) node_list[i].id = id.storage[i];
+        if (latitude.size)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                node_list[i].raw_latitude = static_cast<coordinate_t>(latitude.storage[i]);
+                node_list[i].raw_longitude = static_cast<coordinate_t>(longitude.storage[i]);
+            }
+        }
+        if (tag_offsets.size)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                const uint32_t begin = tag_offsets.storage[i];
+                const uint32_t end = tag_offsets.storage[i + 1];
+                if (begin != end) node_list[i].tags = span_t{tags.data() + begin, end - begin};
+            }
+        }
+        if constexpr (std::is_same_v<Node, node_t>)
+        {
+            if (version.size)
+                for (size_t i = 0; i < count; i++) node_list[i].version = version.storage[i];
+            if (timestamp.size)
+                for (size_t i = 0; i < count; i++) node_list[i].timestamp = timestamp.storage[i];
+            if (changeset.size)
+                for (size_t i = 0; i < count; i++) node_list[i].changeset = changeset.storage[i];
+        }
+    }
+};
+
+// the node buffers of the current group, at namespace scope so that retain_batch can swap them out
+thread_local dense_nodes_t dense_nodes;
+template <class Node>
+thread_local std::vector<Node> delivered_nodes(16000);
+
+template <class Node>
+bool deliver_nodes(const dense_nodes_t& nodes, function_ref_t<bool(span_t<Node>)> handler) noexcept
+{
+    std::vector<Node>& node_list = delivered_nodes<Node>;
+    node_list.clear();
+    nodes.to_nodes(node_list);
+    return deliver(ENTITY_NODES, handler, span_t{node_list.data(), node_list.size()});
 }
 
 bool read_dense_nodes(uint8_t* ptr, uint8_t* end) noexcept
 {
-    thread_local std::vector<node_t> node_list(16000);
-    node_list.clear();
-    thread_local std::vector<tag_t> tags(256000);
-    tags.clear();
+    dense_nodes_t& nodes = dense_nodes;
+    nodes.clear();
+    const reader_state_t& reader = *current_reader;
+    const uint32_t node_fields = reader.node_fields;
+    const bool coordinates = node_fields & PROJECT_COORDINATES;
+    const bool tags = node_fields & PROJECT_TAGS;
+    const bool tag_filter = tag_filter_tests(ENTITY_NODES);
+    const bool degrees = node_fields & PROJECT_DEGREES;
+    const bool area = !reader.spatial_filter.empty();
+    const bool decode_coordinates = coordinates || degrees || area;
+    const id_set_t* ids = reader.id_filter(ENTITY_NODES);
+    bool none_wanted = false;
 
     if (!iterate_fields(ptr, end, [&](field_t& field) -> bool {
+            if (none_wanted) return true;
             switch (field.key)
             {
                 case KEY(1, 2): // node ids. delta encoded
-                {
-                    int64_t id = 0;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length;)
-                    {
-                        id += read_varint_sint64(ptr);
-                        node_list.emplace_back();
-                        node_list.back().id = id;
-                    }
-                }
-                break;
+                    decode_delta_column(field, nodes.id);
+                    // no need to decode the other columns if no id is wanted
+                    if (ids && !nodes.keep_ids(*ids)) none_wanted = true;
+                    break;
                 case KEY(5, 2): // dense infos
-                    if (decode_metadata)
+                    if (node_fields & PROJECT_METADATA)
                     {
-                        iterate_fields(field.pointer, field.pointer + field.length, [](field_t& field) -> bool {
+                        auto read_dense_info = [node_fields, &nodes](field_t& field) -> bool {
                             switch (field.key)
                             {
                                 case KEY(1, 2): // versions. not delta encoded
-                                {
-                                    auto inode = node_list.begin();
-                                    for (auto ptr = field.pointer;
-                                         ptr < field.pointer + field.length && inode < node_list.end();
-                                         inode++)
-                                    {
-                                        inode->version = read_varint_uint64(ptr);
-                                    }
-                                }
-                                break;
+                                    if (node_fields & PROJECT_VERSION) decode_uint_column(field, nodes.version);
+                                    break;
                                 case KEY(2, 2): // timestamps. delta encoded
-                                {
-                                    int64_t timestamp = 0;
-                                    auto inode = node_list.begin();
-                                    for (auto ptr = field.pointer;
-                                         ptr < field.pointer + field.length && inode < node_list.end();
-                                         inode++)
-                                    {
-                                        timestamp += read_varint_sint64(ptr);
-                                        inode->timestamp = timestamp;
-                                    }
-                                }
-                                break;
+                                    if (node_fields & PROJECT_TIMESTAMP) decode_delta_column(field, nodes.timestamp);
+                                    break;
                                 case KEY(3, 2): // changesets. delta encoded
-                                {
-                                    int64_t changeset = 0;
-                                    auto inode = node_list.begin();
-                                    for (auto ptr = field.pointer;
-                                         ptr < field.pointer + field.length && inode < node_list.end();
-                                         inode++)
-                                    {
-                                        changeset += read_varint_sint64(ptr);
-                                        inode->changeset = changeset;
-                                    }
-                                }
-                                break;
+                                    if (node_fields & PROJECT_CHANGESET) decode_delta_column(field, nodes.changeset);
+                                    break;
                             }
                             return true;
-                        });
+                        };
+                        iterate_fields(field.pointer, field.pointer + field.length, read_dense_info);
                     }
                     break;
                 case KEY(8, 2): // latitudes. delta encoded
-                {
-                    int64_t latitude = 0;
-                    auto inode = node_list.begin();
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length && inode < node_list.end();
-                         inode++)
-                    {
-                        latitude += read_varint_sint64(ptr);
-                        inode->raw_latitude = latitude;
-                    }
-                }
-                break;
+                    if (decode_coordinates) decode_delta_column(field, nodes.latitude);
+                    break;
                 case KEY(9, 2): // longitudes. delta encoded
-                {
-                    int64_t longitude = 0;
-                    auto inode = node_list.begin();
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length && inode < node_list.end();
-                         inode++)
-                    {
-                        longitude += read_varint_sint64(ptr);
-                        inode->raw_longitude = longitude;
-                    }
-                }
-                break;
+                    if (decode_coordinates) decode_delta_column(field, nodes.longitude);
+                    break;
                 case KEY(10, 2): // packed indexes to keys & values
-                {
-                    bool invalid = true;
-                    while (invalid)
-                    {
-                        invalid = false;
-                        tags.clear();
-                        auto itag_start = tags.begin();
-                        auto inode = node_list.begin();
-                        size_t previous_capacity = tags.capacity();
-                        size_t tags_size = tags.size();
-                        for (auto ptr = field.pointer; ptr < field.pointer + field.length;)
-                        {
-                            // read key
-                            uint32_t istring = read_varint_uint64(ptr);
-                            if (!istring)
-                            {
-                                // finish up current node
-                                if (itag_start != tags.end())
-                                {
-                                    inode->tags = span_t{&(*itag_start), static_cast<size_t>(tags.end() - itag_start)};
-                                }
-                                itag_start = tags.end();
-                                ++inode;
-                                continue;
-                            }
-                            // add to tags
-                            tags.emplace_back();
-                            ++tags_size;
-                            // get key
-                            tags.back().key = string_table.get(istring);
-                            // read value
-                            tags.back().value = string_table.get(read_varint_uint64(ptr));
-                            // check for invalidity
-                            if (tags_size > previous_capacity)
-                            {
-                                // all references to tags are invalid. restart.
-                                invalid = true;
-                                break;
-                            }
-                        }
-                    }
-                }
-                break;
+                    if (tags || tag_filter) decode_uint_column(field, nodes.keys_vals);
+                    break;
             }
             return true;
         }))
         return false;
+    if (none_wanted) return true;
+
+    // every column has one value per id, metadata columns only if present
+    const size_t count = nodes.id.size;
+    if (decode_coordinates)
+    {
+        nodes.latitude.fit(count);
+        nodes.longitude.fit(count);
+        // to 1e-7 degrees before the spatial filter sees them
+        if (!latitude_scale.identity()) scale_column(nodes.latitude.storage.data(), count, latitude_scale);
+        if (!longitude_scale.identity()) scale_column(nodes.longitude.storage.data(), count, longitude_scale);
+    }
+    if (nodes.version.size) nodes.version.fit(count);
+    if (nodes.timestamp.size)
+    {
+        nodes.timestamp.fit(count);
+        if (!timestamp_scale.identity()) scale_column(nodes.timestamp.storage.data(), count, timestamp_scale);
+    }
+    if (nodes.changeset.size) nodes.changeset.fit(count);
+    if (area && !nodes.keep_inside(reader.spatial_filter)) return true;
+    if (ids || area || tag_filter)
+    {
+        nodes.select(tag_filter);
+        if (!nodes.id.size) return true;
+    }
+    if (degrees) nodes.to_degrees();
+    // decoded only for the degrees or the spatial filter
+    if (!coordinates) nodes.latitude.size = nodes.longitude.size = 0;
+    if (tags) nodes.read_tags();
 
     // report nodes
-    if (!node_handler(span_t{node_list.data(), node_list.size()})) return false;
-    return true;
-    ;
+    if (reader.node_columns_handler) return deliver(ENTITY_NODES, reader.node_columns_handler, nodes.columns());
+    if (reader.compact_node_handler) return deliver_nodes(nodes, reader.compact_node_handler);
+    return deliver_nodes(nodes, reader.node_handler);
 }
 
 template <class T>
-bool read_info(T& obj, uint8_t* ptr, uint8_t* end) noexcept
+bool read_info(T& obj, uint8_t* ptr, uint8_t* end, uint32_t fields) noexcept
 {
     return iterate_fields(ptr, end, [&](field_t& field) -> bool {
         switch (field.key)
         {
             case KEY(1, 0): // version
-                obj.version = field.value_uint64;
+                if (fields & PROJECT_VERSION) obj.version = field.value_uint64;
                 break;
             case KEY(2, 0): // timestamp
-                obj.timestamp = field.value_uint64;
+                if (fields & PROJECT_TIMESTAMP)
+                {
+                    const int64_t timestamp = static_cast<int64_t>(field.value_uint64);
+                    obj.timestamp = timestamp_scale.identity() ? timestamp : timestamp_scale.apply(timestamp);
+                }
                 break;
             case KEY(3, 0): // changeset
-                obj.changeset = field.value_uint64;
+                if (fields & PROJECT_CHANGESET) obj.changeset = field.value_uint64;
                 break;
         }
         return true;
     });
 }
 
-enum class result_t
+// where the node refs or members and the tags of one way or relation start in the group buffers. spans are only made
+// once the whole group is decoded, so the buffers may grow meanwhile without invalidating anything
+struct ranges_t
 {
-    ok = 0,
-    error = 1,
-    eoutofmem = 2
+    size_t items_begin = 0;
+    size_t tags_begin = 0;
 };
 
-result_t read_way(uint8_t* ptr,
-                  uint8_t* end,
-                  std::vector<way_t>& way_list,
-                  std::vector<tag_t>& tags,
-                  std::vector<int64_t>& node_refs) noexcept
+// set the key or value of tags[begin], tags[begin + 1], ... from a packed string index field
+template <typename Setter>
+inline void read_tag_strings(const field_t& field, std::vector<tag_t>& tags, size_t begin, Setter&& set) noexcept
 {
-    way_t way;
-    auto node_ref_begin = node_refs.size();
-    auto tags_begin = tags.size();
-    result_t result = result_t::ok;
+    const auto indexes = decode_uint_column(field);
+    if (tags.size() < begin + indexes.size()) tags.resize(begin + indexes.size());
+    for (size_t i = 0; i < indexes.size(); i++) set(tags[begin + i], string_table.entry(indexes[i]));
+}
 
+// whether a way or relation message passes the tag filter, tested on its string indexes only
+inline bool tags_pass(uint8_t* ptr, uint8_t* end) noexcept
+{
+    field_t keys, values;
+    // a malformed message passes, so that reading it reports the error
     if (!iterate_fields(ptr, end, [&](field_t& field) -> bool {
-            switch (field.key)
-            {
-                case KEY(1, 0): // way id
-                    way.id = field.value_uint64;
-                    break;
-                case KEY(2, 2): // packed keys
-                {
-                    int index = tags_begin;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length; index++)
-                    {
-                        if (!check_capacity(tags, index, "way tags"))
-                        {
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                        tags[index].key = string_table.get(read_varint_uint64(ptr));
-                    }
-                }
-                break;
-                case KEY(3, 2): // packed values
-                {
-                    int index = tags_begin;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length; index++)
-                    {
-                        if (!check_capacity(tags, index, "way tags"))
-                        {
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                        tags[index].value = string_table.get(read_varint_uint64(ptr));
-                    }
-                }
-                break;
-                case KEY(4, 2): // way info
-                    if (decode_metadata) read_info<way_t>(way, field.pointer, field.pointer + field.length);
-                    break;
-                case KEY(8, 2): // node refs
-                {
-                    int64_t id = 0;
-                    size_t previous_capacity = node_refs.capacity();
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length;)
-                    {
-                        id += read_varint_sint64(ptr);
-                        node_refs.push_back(id);
-                        if (node_refs.capacity() > previous_capacity)
-                        {
-                            IOSM_TRACE("way node ref capacity exceeded: %" PRIu64 "/ %" PRIu64 " on thread %" PRIu64,
-                                       node_refs.capacity(),
-                                       previous_capacity,
-                                       thread_index);
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                    }
-                }
-                break;
-            }
+            if (field.key == KEY(2, 2)) // packed keys
+                keys = field;
+            else if (field.key == KEY(3, 2)) // packed values
+                values = field;
             return true;
         }))
-    {
-        // error:
-        if (result_t::eoutofmem == result)
-        {
-            // cleanup
-            node_refs.erase(node_refs.begin() + node_ref_begin, node_refs.end());
-            tags.erase(tags.begin() + tags_begin, tags.end());
-        }
-        else
-            result = result_t::error;
-    }
-    else
-    {
-        // success:
-        // node refs
-        if (node_ref_begin != node_refs.size())
-            way.node_refs = {node_refs.data() + node_ref_begin, node_refs.size() - node_ref_begin};
-        // tags
-        if (tags_begin != tags.size()) way.tags = {tags.data() + tags_begin, tags.size() - tags_begin};
-        // add to list
-        way_list.emplace_back(way);
-    }
+        return true;
+    thread_local column_t<uint64_t> key_column, value_column;
+    decode_uint_column(keys, key_column);
+    decode_uint_column(values, value_column);
+    const tag_matcher_t& tag_matcher = current_reader->tag_matcher;
+    uint64_t matched = 0;
+    for (size_t i = 0; i < std::min(key_column.size, value_column.size); i++)
+        matched |= block_tag_masks.matched(tag_matcher, key_column[i], value_column[i]);
+    return tag_matcher.filter.evaluate(matched);
+}
 
-    return result;
+// whether the id of a way or relation message is in the id filter
+inline bool id_passes(uint8_t* ptr, uint8_t* end, const id_set_t& ids) noexcept
+{
+    // the id is the first field, stop there; a message without id passes, so that reading it reports the error
+    bool found = false;
+    int64_t id = 0;
+    iterate_fields(ptr, end, [&](field_t& field) -> bool {
+        if (field.key != KEY(1, 0)) return true;
+        id = static_cast<int64_t>(field.value_uint64);
+        found = true;
+        return false;
+    });
+    return !found || ids.contains(id);
 }
 
-result_t read_relation(uint8_t* ptr,
-                       uint8_t* end,
-                       std::vector<relation_t>& relation_list,
-                       std::vector<tag_t>& tags,
-                       std::vector<relation_member_t>& members) noexcept
+bool read_way(uint8_t* ptr,
+              uint8_t* end,
+              std::vector<way_t>& way_list,
+              std::vector<ranges_t>& ranges,
+              std::vector<tag_t>& tags,
+              column_t<int64_t>& node_refs) noexcept
 {
-    relation_t relation;
-    auto tags_begin = tags.size();
-    auto members_begin = members.size();
-    result_t result = result_t::ok;
+    const reader_state_t& reader = *current_reader;
+    if (const id_set_t* ids = reader.id_filter(ENTITY_WAYS); ids && !id_passes(ptr, end, *ids)) return true;
+    if (tag_filter_tests(ENTITY_WAYS) && !tags_pass(ptr, end)) return true;
+    way_t& way = way_list.emplace_back();
+    const ranges_t& range = ranges.emplace_back(ranges_t{node_refs.size, tags.size()});
 
-    if (!iterate_fields(ptr, end, [&](field_t& field) -> bool {
-            switch (field.key)
-            {
-                case KEY(1, 0): // relation id
-                    relation.id = field.value_uint64;
-                    break;
-                case KEY(2, 2): // packed keys
+    const uint32_t way_fields = reader.way_fields;
+    return iterate_fields(ptr, end, [&](field_t& field) -> bool {
+        switch (field.key)
+        {
+            case KEY(1, 0): // way id
+                way.id = field.value_uint64;
+                break;
+            case KEY(2, 2): // packed keys
+                if (way_fields & PROJECT_TAGS) read_tag_strings(field, tags, range.tags_begin, set_key);
+                break;
+            case KEY(3, 2): // packed values
+                if (way_fields & PROJECT_TAGS) read_tag_strings(field, tags, range.tags_begin, set_value);
+                break;
+            case KEY(4, 2): // way info
+                if (way_fields & PROJECT_METADATA)
+                    read_info<way_t>(way, field.pointer, field.pointer + field.length, way_fields);
+                break;
+            case KEY(8, 2): // node refs
+                if (way_fields & PROJECT_REFS)
                 {
-                    int index = tags_begin;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length; index++)
-                    {
-                        if (!check_capacity(tags, index, "relation tags"))
-                        {
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                        tags[index].key = string_table.get(read_varint_uint64(ptr));
-                    }
+                    // decoded in place behind the refs of the previous ways of the group
+                    int64_t* refs = node_refs.reserve(node_refs.size + field.length) + node_refs.size;
+                    node_refs.size += decode_packed_delta_sint64(field.pointer, field.pointer + field.length, refs);
                 }
                 break;
-                case KEY(3, 2): // packed values
-                {
-                    int index = tags_begin;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length; index++)
-                    {
-                        if (!check_capacity(tags, index, "relation tags"))
-                        {
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                        tags[index].value = string_table.get(read_varint_uint64(ptr));
-                    }
-                }
+        }
+        return true;
+    });
+}
+
+bool read_relation(uint8_t* ptr,
+                   uint8_t* end,
+                   std::vector<relation_t>& relation_list,
+                   std::vector<ranges_t>& ranges,
+                   std::vector<tag_t>& tags,
+                   std::vector<relation_member_t>& members) noexcept
+{
+    const reader_state_t& reader = *current_reader;
+    if (const id_set_t* ids = reader.id_filter(ENTITY_RELATIONS); ids && !id_passes(ptr, end, *ids)) return true;
+    if (tag_filter_tests(ENTITY_RELATIONS) && !tags_pass(ptr, end)) return true;
+    relation_t& relation = relation_list.emplace_back();
+    const ranges_t& range = ranges.emplace_back(ranges_t{members.size(), tags.size()});
+
+    // roles, ids and types are separate fields, the longest one sets the member count
+    auto members_at = [&](size_t count) {
+        if (members.size() < range.items_begin + count) members.resize(range.items_begin + count);
+        return members.data() + range.items_begin;
+    };
+
+    const uint32_t relation_fields = reader.relation_fields;
+    return iterate_fields(ptr, end, [&](field_t& field) -> bool {
+        switch (field.key)
+        {
+            case KEY(1, 0): // relation id
+                relation.id = field.value_uint64;
                 break;
-                case KEY(4, 2): // relation info
-                    if (decode_metadata) read_info<relation_t>(relation, field.pointer, field.pointer + field.length);
-                    break;
-                case KEY(8, 2): // member roles
+            case KEY(2, 2): // packed keys
+                if (relation_fields & PROJECT_TAGS) read_tag_strings(field, tags, range.tags_begin, set_key);
+                break;
+            case KEY(3, 2): // packed values
+                if (relation_fields & PROJECT_TAGS) read_tag_strings(field, tags, range.tags_begin, set_value);
+                break;
+            case KEY(4, 2): // relation info
+                if (relation_fields & PROJECT_METADATA)
+                    read_info<relation_t>(relation, field.pointer, field.pointer + field.length, relation_fields);
+                break;
+            case KEY(8, 2): // member roles
+                if (relation_fields & PROJECT_REFS)
                 {
-                    int index = members_begin;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length; index++)
-                    {
-                        if (!check_capacity(members, index, "relation members"))
-                        {
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                        members[index].role = string_table.get(read_varint_uint64(ptr));
-                    }
+                    const auto roles = decode_uint_column(field);
+                    relation_member_t* member = members_at(roles.size());
+                    for (size_t i = 0; i < roles.size(); i++) member[i].role = string_table.get(roles[i]);
                 }
                 break;
-                case KEY(9, 2): // member ids
+            case KEY(9, 2): // member ids
+                if (relation_fields & PROJECT_REFS)
                 {
-                    int index = members_begin;
-                    int64_t id = 0;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length; index++)
-                    {
-                        if (!check_capacity(members, index, "relation members"))
-                        {
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                        id += read_varint_sint64(ptr);
-                        members[index].id = id;
-                    }
+                    const auto ids = decode_delta_column(field);
+                    relation_member_t* member = members_at(ids.size());
+                    for (size_t i = 0; i < ids.size(); i++) member[i].id = ids[i];
                 }
                 break;
-                case KEY(10, 2): // member types
+            case KEY(10, 2): // member types
+                if (relation_fields & PROJECT_REFS)
                 {
-                    int index = members_begin;
-                    for (auto ptr = field.pointer; ptr < field.pointer + field.length; index++)
-                    {
-                        if (!check_capacity(members, index, "relation members"))
-                        {
-                            result = result_t::eoutofmem;
-                            return false;
-                        }
-                        members[index].type = read_varint_uint64(ptr);
-                    }
+                    const auto types = decode_uint_column(field);
+                    relation_member_t* member = members_at(types.size());
+                    for (size_t i = 0; i < types.size(); i++) member[i].type = types[i];
                 }
                 break;
-            }
-            return true;
-        }))
-    {
-        // error:
-        if (result_t::eoutofmem == result)
-        {
-            // cleanup
-            tags.erase(tags.begin() + tags_begin, tags.end());
-            members.erase(members.begin() + members_begin, members.end());
         }
-        else
-            result = result_t::error;
+        return true;
+    });
+}
+
+// point the entities at their node refs or members and tags, now that the buffers are final
+template <typename Entity, typename Item>
+void make_spans(std::vector<Entity>& list,
+                const std::vector<ranges_t>& ranges,
+                span_t<Item> Entity::*items_member,
+                span_t<Item> items,
+                std::vector<tag_t>& tags) noexcept
+{
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        const size_t items_end = i + 1 < list.size() ? ranges[i + 1].items_begin : items.size();
+        const size_t tags_end = i + 1 < list.size() ? ranges[i + 1].tags_begin : tags.size();
+        if (items_end != ranges[i].items_begin)
+            list[i].*items_member = {items.data() + ranges[i].items_begin, items_end - ranges[i].items_begin};
+        if (tags_end != ranges[i].tags_begin)
+            list[i].tags = {tags.data() + ranges[i].tags_begin, tags_end - ranges[i].tags_begin};
     }
-    else
+}
+
+// count a buffer that had to grow while decoding a group
+template <typename T>
+struct capacity_watch_t
+{
+    const std::vector<T>& vec;
+    const size_t capacity = vec.capacity();
+    ~capacity_watch_t()
     {
-        // success:
-        // tags
-        if (tags_begin != tags.size()) relation.tags = {tags.data() + tags_begin, tags.size() - tags_begin};
-        // members
-        if (members_begin != members.size())
-            relation.members = {members.data() + members_begin, members.size() - members_begin};
-        // add to list
-        relation_list.emplace_back(relation);
+        if (vec.capacity() != capacity) current_reader->buffer_grows.fetch_add(1, std::memory_order_relaxed);
     }
+};
 
-    return result;
+// the way and relation buffers of the current group, at namespace scope so that retain_batch can swap them out
+thread_local std::vector<way_t> way_list(8000);
+thread_local std::vector<tag_t> way_tags(256000);
+thread_local column_t<int64_t> way_node_refs;
+thread_local std::vector<relation_t> relation_list(1024);
+thread_local std::vector<tag_t> relation_tags(32000);
+thread_local std::vector<relation_member_t> relation_members(128000);
+
+// buffers of the current block that its batches point into: the inflated blob, and the strings copied out of it
+struct retained_block_t
+{
+    std::vector<uint8_t> inflated;
+    std::vector<char> strings;
+};
+// the buffers of one retained batch, by kind
+struct retained_nodes_t
+{
+    dense_nodes_t dense_nodes;
+    std::vector<node_t> nodes;
+    std::vector<compact_node_t> compact_nodes;
+};
+struct retained_ways_t
+{
+    std::vector<way_t> ways;
+    std::vector<tag_t> tags;
+    column_t<int64_t> node_refs;
+};
+struct retained_relations_t
+{
+    std::vector<relation_t> relations;
+    std::vector<tag_t> tags;
+    std::vector<relation_member_t> members;
+};
+struct retained_pbf_batch_t
+{
+    std::shared_ptr<retained_block_t> block;
+    std::shared_ptr<void> entities;
+};
+
+// the block buffers once a batch of the current block was retained; the worker holds them until the block is done
+thread_local std::shared_ptr<retained_block_t> retained_block;
+
+batch_handle_t retain_pbf_batch()
+{
+    if (!delivering) return {};
+    if (delivered_handle) return delivered_handle;
+    // every batch of the block may point into these, so they move out with the first retained batch
+    if (!retained_block)
+    {
+        retained_block = buffer_pool<retained_block_t>().acquire();
+        std::swap(retained_block->inflated, inflated_block);
+        std::swap(retained_block->strings, string_table.copies);
+    }
+    auto batch = std::make_shared<retained_pbf_batch_t>();
+    batch->block = retained_block;
+    // the worker goes on with the pooled buffers, the spans handed out keep pointing to the swapped ones
+    if (delivering == ENTITY_NODES)
+    {
+        auto nodes = buffer_pool<retained_nodes_t>().acquire();
+        std::swap(nodes->dense_nodes, dense_nodes);
+        std::swap(nodes->nodes, delivered_nodes<node_t>);
+        std::swap(nodes->compact_nodes, delivered_nodes<compact_node_t>);
+        batch->entities = std::move(nodes);
+    }
+    else if (delivering == ENTITY_WAYS)
+    {
+        auto ways = buffer_pool<retained_ways_t>().acquire();
+        std::swap(ways->ways, way_list);
+        std::swap(ways->tags, way_tags);
+        std::swap(ways->node_refs, way_node_refs);
+        batch->entities = std::move(ways);
+    }
+    else
+    {
+        auto relations = buffer_pool<retained_relations_t>().acquire();
+        std::swap(relations->relations, relation_list);
+        std::swap(relations->tags, relation_tags);
+        std::swap(relations->members, relation_members);
+        batch->entities = std::move(relations);
+    }
+    delivered_handle = std::move(batch);
+    return delivered_handle;
 }
 
 bool read_primitive_group(uint8_t* ptr, uint8_t* end) noexcept
 {
-    thread_local std::vector<way_t> way_list(8000);
     way_list.clear();
-    thread_local std::vector<tag_t> way_tags(256000);
+    thread_local std::vector<ranges_t> way_ranges(8000);
+    way_ranges.clear();
     way_tags.clear();
-    thread_local std::vector<int64_t> way_node_refs(1024000);
-    way_node_refs.clear();
+    way_node_refs.size = 0;
 
-    thread_local std::vector<relation_t> relation_list(1024);
     relation_list.clear();
-    thread_local std::vector<tag_t> relation_tags(32000);
+    thread_local std::vector<ranges_t> relation_ranges(1024);
+    relation_ranges.clear();
     relation_tags.clear();
-    thread_local std::vector<relation_member_t> relation_members(128000);
     relation_members.clear();
 
-    // read elements
-    size_t nodes_read{0}, ways_read{0}, relations_read{0};
-    bool restart_ways = true;
-    bool restart_relations = true;
-    bool result = true;
-    while (restart_ways || restart_relations)
+    reader_state_t& reader = *current_reader;
+    reader.groups_decoded.fetch_add(1, std::memory_order_relaxed);
     {
-        restart_ways = restart_relations = false;
-        size_t node_index{0}, way_index{0}, relation_index{0};
-        result = iterate_fields(ptr, end, [&](field_t& field) -> bool {
+        capacity_watch_t<tag_t> watch_way_tags{way_tags};
+        capacity_watch_t<tag_t> watch_relation_tags{relation_tags};
+        capacity_watch_t<relation_member_t> watch_relation_members{relation_members};
+
+        // read elements, single pass. kinds without handler, or that the tag filter rules out, are skipped
+        const bool read_nodes = reader.node_handler && tag_filter_may_pass(ENTITY_NODES);
+        const bool read_ways = reader.way_handler && tag_filter_may_pass(ENTITY_WAYS);
+        const bool read_relations = reader.relation_handler && tag_filter_may_pass(ENTITY_RELATIONS);
+        if (!iterate_fields(ptr, end, [&](field_t& field) -> bool {
+                switch (field.key)
+                {
+                    case KEY(1, 2): // node
+                        break;
+                    case KEY(2, 2): // dense nodes
+                        if (read_nodes && !read_dense_nodes(field.pointer, field.pointer + field.length)) return false;
+                        break;
+                    case KEY(3, 2): // way
+                        if (read_ways && !read_way(field.pointer,
+                                                   field.pointer + field.length,
+                                                   way_list,
+                                                   way_ranges,
+                                                   way_tags,
+                                                   way_node_refs))
+                            return false;
+                        break;
+                    case KEY(4, 2): // relation
+                        if (read_relations && !read_relation(field.pointer,
+                                                             field.pointer + field.length,
+                                                             relation_list,
+                                                             relation_ranges,
+                                                             relation_tags,
+                                                             relation_members))
+                            return false;
+                        break;
+                }
+                return true;
+            }))
+            return false;
+    }
+    make_spans(way_list, way_ranges, &way_t::node_refs, way_node_refs.span(), way_tags);
+    make_spans(relation_list,
+               relation_ranges,
+               &relation_t::members,
+               span_t{relation_members.data(), relation_members.size()},
+               relation_tags);
+
+    // report ways
+    if (reader.way_handler && !deliver(ENTITY_WAYS, reader.way_handler, span_t{way_list.data(), way_list.size()}))
+        return false;
+
+    // report relations
+    if (reader.relation_handler &&
+        !deliver(ENTITY_RELATIONS, reader.relation_handler, span_t{relation_list.data(), relation_list.size()}))
+        return false;
+    return true;
+}
+
+// the granularities and offsets follow the primitive groups in a block, so they are read ahead
+bool read_block_scales(uint8_t* ptr, uint8_t* end) noexcept
+{
+    int64_t granularity = 100, lat_offset = 0, lon_offset = 0, date_granularity = 1000;
+    if (!iterate_fields(ptr, end, [&](field_t& field) -> bool {
             switch (field.key)
             {
-                case KEY(1, 2): // node
+                case KEY(17, 0): // granularity in nanodegrees
+                    granularity = (int64_t)field.value_uint64;
+                    IOSM_TRACE("granularity: %" PRId64 " nanodegrees", granularity);
                     break;
-                case KEY(2, 2): // dense nodes
-                    if (node_index++ >= nodes_read && node_handler)
-                    {
-                        if (!read_dense_nodes(field.pointer, field.pointer + field.length)) return false;
-                        nodes_read++;
-                    }
+                case KEY(18, 0): // date granularity in milliseconds
+                    date_granularity = (int64_t)field.value_uint64;
+                    IOSM_TRACE("date granularity: %" PRId64 " milliseconds", date_granularity);
                     break;
-                case KEY(3, 2): // way
-                    if (way_index++ >= ways_read && way_handler)
-                    {
-                        switch (
-                            read_way(field.pointer, field.pointer + field.length, way_list, way_tags, way_node_refs))
-                        {
-                            case result_t::eoutofmem:
-                                restart_ways = true;
-                            case result_t::error:
-                                return false;
-                            case result_t::ok:
-                                break;
-                        }
-                        ways_read++;
-                    }
+                case KEY(19, 0): // latitude offset in nanodegrees
+                    lat_offset = (int64_t)field.value_uint64;
+                    IOSM_TRACE("latitude offset: %" PRId64 " nanodegrees", lat_offset);
                     break;
-                case KEY(4, 2): // relation
-                    if (relation_index++ >= relations_read && relation_handler)
-                    {
-                        switch (read_relation(field.pointer,
-                                              field.pointer + field.length,
-                                              relation_list,
-                                              relation_tags,
-                                              relation_members))
-                        {
-                            case result_t::eoutofmem:
-                                restart_relations = true;
-                            case result_t::error:
-                                return false;
-                            case result_t::ok:
-                                break;
-                        }
-                        relations_read++;
-                    }
+                case KEY(20, 0): // longitude offset in nanodegrees
+                    lon_offset = (int64_t)field.value_uint64;
+                    IOSM_TRACE("longitude offset: %" PRId64 " nanodegrees", lon_offset);
                     break;
             }
             return true;
-        });
-        if (restart_ways)
-        {
-            way_list.clear();
-            way_tags.clear();
-            way_node_refs.clear();
-            ways_read = 0;
-        }
-        if (restart_relations)
-        {
-            relation_list.clear();
-            relation_members.clear();
-            relation_tags.clear();
-            relations_read = 0;
-        }
-        if (restart_ways || restart_relations)
-        {
-            IOSM_TRACE("restarting read_primitive_group on thread %zu", thread_index);
-        }
-    }
-    if (result)
-    {
-        // report ways
-        if (way_handler)
-            if (!way_handler(span_t{way_list.data(), way_list.size()})) return false;
-
-        // report relations
-        if (relation_handler)
-            if (!relation_handler(span_t{relation_list.data(), relation_list.size()})) return false;
-    }
-    return result;
+        }))
+        return false;
+    latitude_scale = linear_scale_t::make(granularity, lat_offset, 100);
+    longitude_scale = linear_scale_t::make(granularity, lon_offset, 100);
+    timestamp_scale = linear_scale_t::make(date_granularity, 0, 1000);
+    return true;
 }
 
 bool read_primitve_block(uint8_t* ptr, uint8_t* end) noexcept
 {
     // PrimitiveBlock
     string_table.clear();
+    block_tag_masks.clear();
+    current_reader->blocks_decoded.fetch_add(1, std::memory_order_relaxed);
+    if (!read_block_scales(ptr, end)) return false;
 
     return iterate_fields(ptr, end, [&](field_t& field) -> bool {
         switch (field.key)
         {
             case KEY(1, 2): // string table
-                string_table.init(field.length);
                 if (!read_string_table(field.pointer, field.pointer + field.length)) return false;
                 break;
             case KEY(2, 2): // primitive group
-                if (!read_primitive_group(field.pointer, field.pointer + field.length)) return false;
-                break;
-            case KEY(17, 0): // granularity in nanodegrees
-                granularity = (int64_t)field.value_uint64;
-                IOSM_TRACE("granularity: %" PRId32 " nanodegrees", granularity);
-                break;
-            case KEY(18, 0): // date granularity in milliseconds
-                date_granularity = (int64_t)field.value_uint64;
-                IOSM_TRACE("date granularity: %" PRId32 " milliseconds", date_granularity);
-                break;
-            case KEY(19, 0): // latitude offset in nanodegrees
-                lat_offset = (int64_t)field.value_uint64;
-                IOSM_TRACE("latitude offset: %" PRId32 " nanodegrees", lat_offset);
-                break;
-            case KEY(20, 0): // longitude offset in nanodegrees
-                lon_offset = (int64_t)field.value_uint64;
-                IOSM_TRACE("longitude offset: %" PRId32 " nanodegrees", lon_offset);
+                if (read_stopped() || !read_primitive_group(field.pointer, field.pointer + field.length)) return false;
                 break;
         }
         return true;
@@ -846,25 +1228,556 @@ struct work_item
     size_t blob_size = 0;
     bool (*handler)(uint8_t*, uint8_t*) = nullptr;
     size_t block_index = 0;
+    uint64_t offset = 0; // of the BlobHeader length prefix
+    uint32_t header_size = 0;
+    size_t sequence = 0; // position in the enumeration, block indices have gaps when the block index skips blocks
+    size_t file_index = 0;
+    const char* xml_filename = nullptr; // input_files: a whole XML file, parsed by one worker
+};
+
+/**
+ * @brief Bounded FIFO of blobs shared by the enumerating thread and the workers
+ * @details The enumerator pushes blobs as it discovers them and blocks once `capacity` blobs are pending, so the
+ * workers start inflating while the rest of the file is still being walked.
+ */
+struct work_queue_t
+{
+    std::queue<work_item> items;
+    std::mutex mtx;
+    std::condition_variable cv_not_empty;
+    std::condition_variable cv_not_full;
+    size_t capacity = 1;
+    size_t consumers = 0;
+    bool closed = false;
+
+    void open(size_t new_capacity, size_t new_consumers)
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        items = {};
+        capacity = std::max<size_t>(new_capacity, 1);
+        consumers = new_consumers;
+        closed = false;
+    }
+    // no more items will be pushed
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            closed = true;
+        }
+        cv_not_empty.notify_all();
+    }
+    // a consumer stopped early and won't pop anymore
+    void leave()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            consumers--;
+        }
+        cv_not_full.notify_all();
+    }
+    // returns false if there is nobody left to process the item
+    bool push(const work_item& wi)
+    {
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv_not_full.wait(lck, [this] { return items.size() < capacity || !consumers; });
+            if (!consumers) return false;
+            items.push(wi);
+        }
+        cv_not_empty.notify_one();
+        return true;
+    }
+    // returns false when the queue is closed and drained
+    bool pop(size_t /*worker*/, work_item& wi)
+    {
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv_not_empty.wait(lck, [this] { return !items.empty() || closed; });
+            if (items.empty()) return false;
+            wi = items.front();
+            items.pop();
+        }
+        cv_not_full.notify_one();
+        return true;
+    }
+};
+
+/**
+ * @brief Bounded queue of blobs that hands out the largest pending blob first
+ * @details The compressed size from the BlobHeader stands in for the cost of a block, which varies by orders of
+ * magnitude between small relation blocks and large way blocks. Like work_queue_t, the enumerator blocks once
+ * `capacity` blobs are pending, so the workers start while the file is still being walked and the look-ahead stays
+ * bounded; each worker takes the largest blob within that window, and cheap blocks wait for the next idle worker
+ * instead of holding back an expensive one. Whole XML files of input_files go first, equal sizes are started in file
+ * order.
+ */
+struct largest_first_queue_t
+{
+    struct smaller_t
+    {
+        static uint64_t cost(const work_item& wi) { return wi.xml_filename ? UINT64_MAX : wi.blob_size; }
+        bool operator()(const work_item& a, const work_item& b) const
+        {
+            return cost(a) != cost(b) ? cost(a) < cost(b) : a.sequence > b.sequence;
+        }
+    };
+    std::priority_queue<work_item, std::vector<work_item>, smaller_t> items;
+    std::mutex mtx;
+    std::condition_variable cv_not_empty;
+    std::condition_variable cv_not_full;
+    size_t capacity = 1;
+    size_t consumers = 0;
+    bool closed = false;
+
+    void open(size_t new_capacity, size_t new_consumers)
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        items = {};
+        capacity = std::max<size_t>(new_capacity, 1);
+        consumers = new_consumers;
+        closed = false;
+    }
+    // no more items will be pushed
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            closed = true;
+        }
+        cv_not_empty.notify_all();
+    }
+    // a consumer stopped early and won't pop anymore
+    void leave()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            consumers--;
+        }
+        cv_not_full.notify_all();
+    }
+    // returns false if there is nobody left to process the item
+    bool push(const work_item& wi)
+    {
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv_not_full.wait(lck, [this] { return items.size() < capacity || !consumers; });
+            if (!consumers) return false;
+            items.push(wi);
+        }
+        cv_not_empty.notify_one();
+        return true;
+    }
+    // returns false when the queue is closed and drained
+    bool pop(size_t /*worker*/, work_item& wi)
+    {
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv_not_empty.wait(lck, [this] { return !items.empty() || closed; });
+            if (items.empty()) return false;
+            wi = items.top();
+            items.pop();
+        }
+        cv_not_full.notify_one();
+        return true;
+    }
 };
-static std::queue<work_item> work_queue;
-static std::mutex mtx_work_queue;
+
+/**
+ * @brief Per-worker lanes of blobs with stealing
+ * @details The enumerator deals blobs round-robin to the worker lanes. A worker pops the oldest blob of its own lane
+ * and, once that is empty, steals the newest blob of another lane. Each lane has its own lock, so the only shared
+ * writes on the fast path are the `pending` counter updates. Waiting for work or for free look-ahead slots goes
+ * through `mtx_wait`, and only when a lane scan came up empty or the look-ahead is full.
+ */
+struct work_stealing_queue_t
+{
+    struct alignas(64) lane_t
+    {
+        std::mutex mtx;
+        std::deque<work_item> items;
+    };
+    std::unique_ptr<lane_t[]> lanes;
+    size_t lane_count = 0;
+    size_t next_lane = 0;
+    size_t capacity = 1;
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> consumers{0};
+    std::atomic<size_t> sleepers{0};
+    std::atomic<bool> closed{false};
+    std::mutex mtx_wait;
+    std::condition_variable cv_work;
+    std::condition_variable cv_space;
+
+    void open(size_t new_capacity, size_t new_consumers)
+    {
+        if (lane_count != new_consumers)
+        {
+            lanes = std::make_unique<lane_t[]>(new_consumers);
+            lane_count = new_consumers;
+        }
+        for (size_t i = 0; i < lane_count; i++) lanes[i].items.clear();
+        next_lane = 0;
+        capacity = std::max<size_t>(new_capacity, 1);
+        pending = 0;
+        consumers = new_consumers;
+        sleepers = 0;
+        closed = false;
+    }
+    // no more items will be pushed
+    void close()
+    {
+        closed = true;
+        std::lock_guard<std::mutex> lck(mtx_wait);
+        cv_work.notify_all();
+    }
+    // a consumer stopped early and won't pop anymore, its lane is left to the thieves
+    void leave()
+    {
+        consumers--;
+        std::lock_guard<std::mutex> lck(mtx_wait);
+        cv_space.notify_all();
+    }
+    // returns false if there is nobody left to process the item
+    bool push(const work_item& wi)
+    {
+        if (pending >= capacity)
+        {
+            std::unique_lock<std::mutex> lck(mtx_wait);
+            cv_space.wait(lck, [this] { return pending < capacity || !consumers; });
+        }
+        if (!consumers) return false;
+        // counted before it is visible, so a popped item never drives the counter below zero
+        pending++;
+        lane_t& lane = lanes[next_lane++ % lane_count];
+        {
+            std::lock_guard<std::mutex> lck(lane.mtx);
+            lane.items.push_back(wi);
+        }
+        if (sleepers)
+        {
+            std::lock_guard<std::mutex> lck(mtx_wait);
+            cv_work.notify_one();
+        }
+        return true;
+    }
+    // returns false when the queue is closed and drained
+    bool pop(size_t worker, work_item& wi)
+    {
+        while (true)
+        {
+            if (try_pop(worker, wi))
+            {
+                if (pending-- == capacity)
+                {
+                    std::lock_guard<std::mutex> lck(mtx_wait);
+                    cv_space.notify_one();
+                }
+                return true;
+            }
+            std::unique_lock<std::mutex> lck(mtx_wait);
+            sleepers++;
+            cv_work.wait(lck, [this] { return pending || closed; });
+            sleepers--;
+            if (!pending && closed) return false;
+        }
+    }
+    bool try_pop(size_t worker, work_item& wi)
+    {
+        // own lane, oldest first
+        {
+            lane_t& lane = lanes[worker % lane_count];
+            std::lock_guard<std::mutex> lck(lane.mtx);
+            if (!lane.items.empty())
+            {
+                wi = lane.items.front();
+                lane.items.pop_front();
+                return true;
+            }
+        }
+        // steal, newest first
+        for (size_t i = 1; i < lane_count; i++)
+        {
+            lane_t& lane = lanes[(worker + i) % lane_count];
+            std::lock_guard<std::mutex> lck(lane.mtx);
+            if (!lane.items.empty())
+            {
+                wi = lane.items.back();
+                lane.items.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// blobs enumerated ahead of the workers, per worker thread
+static constexpr size_t k_blobs_ahead_per_thread = 4;
+
+/**
+ * @brief Entity kinds, id ranges and node bounding box of an inflated PrimitiveBlock
+ * @details Only ids and coordinates are decoded; tags, refs, members and metadata are skipped.
+ */
+bool summarize_primitive_block(uint8_t* ptr, uint8_t* end, block_summary_t& summary) noexcept
+{
+    int64_t block_granularity = 100;
+    int64_t block_lat_offset = 0;
+    int64_t block_lon_offset = 0;
+    int64_t min_lat = INT64_MAX, max_lat = INT64_MIN, min_lon = INT64_MAX, max_lon = INT64_MIN;
+    auto add_id = [&summary](uint32_t kind, int64_t& min_id, int64_t& max_id, int64_t id) {
+        if (!(summary.kinds & kind))
+        {
+            summary.kinds |= kind;
+            min_id = max_id = id;
+        }
+        min_id = std::min(min_id, id);
+        max_id = std::max(max_id, id);
+    };
+    auto add_coordinate = [&](int64_t lat, int64_t lon) {
+        min_lat = std::min(min_lat, lat);
+        max_lat = std::max(max_lat, lat);
+        min_lon = std::min(min_lon, lon);
+        max_lon = std::max(max_lon, lon);
+    };
+    auto read_packed_range = [](field_t& field, int64_t& lo, int64_t& hi) {
+        int64_t value = 0;
+        for (auto p = field.pointer; p < field.pointer + field.length;)
+        {
+            value += read_varint_sint64(p);
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+        }
+    };
+
+    bool result = iterate_fields(ptr, end, [&](field_t& field) -> bool {
+        switch (field.key)
+        {
+            case KEY(2, 2): // primitive group
+                return iterate_fields(field.pointer, field.pointer + field.length, [&](field_t& field) -> bool {
+                    switch (field.key)
+                    {
+                        case KEY(1, 2): // node
+                        {
+                            int64_t id = 0, lat = 0, lon = 0;
+                            iterate_fields(field.pointer, field.pointer + field.length, [&](field_t& field) -> bool {
+                                if (field.key == KEY(1, 0)) id = to_sint64(field.value_uint64);
+                                if (field.key == KEY(8, 0)) lat = to_sint64(field.value_uint64);
+                                if (field.key == KEY(9, 0)) lon = to_sint64(field.value_uint64);
+                                return true;
+                            });
+                            add_id(BLOCK_HAS_NODES, summary.min_node_id, summary.max_node_id, id);
+                            add_coordinate(lat, lon);
+                        }
+                        break;
+                        case KEY(2, 2): // dense nodes
+                            iterate_fields(field.pointer, field.pointer + field.length, [&](field_t& field) -> bool {
+                                switch (field.key)
+                                {
+                                    case KEY(1, 2): // ids
+                                    {
+                                        int64_t lo = INT64_MAX, hi = INT64_MIN;
+                                        read_packed_range(field, lo, hi);
+                                        if (lo <= hi)
+                                        {
+                                            add_id(BLOCK_HAS_NODES, summary.min_node_id, summary.max_node_id, lo);
+                                            add_id(BLOCK_HAS_NODES, summary.min_node_id, summary.max_node_id, hi);
+                                        }
+                                    }
+                                    break;
+                                    case KEY(8, 2): // latitudes
+                                        read_packed_range(field, min_lat, max_lat);
+                                        break;
+                                    case KEY(9, 2): // longitudes
+                                        read_packed_range(field, min_lon, max_lon);
+                                        break;
+                                }
+                                return true;
+                            });
+                            break;
+                        case KEY(3, 2): // way
+                        case KEY(4, 2): // relation
+                        {
+                            // the id is the first field, stop there
+                            int64_t id = 0;
+                            iterate_fields(field.pointer, field.pointer + field.length, [&id](field_t& field) -> bool {
+                                if (field.key != KEY(1, 0)) return true;
+                                id = field.value_uint64;
+                                return false;
+                            });
+                            if (field.key == KEY(3, 2))
+                                add_id(BLOCK_HAS_WAYS, summary.min_way_id, summary.max_way_id, id);
+                            else
+                                add_id(BLOCK_HAS_RELATIONS, summary.min_relation_id, summary.max_relation_id, id);
+                        }
+                        break;
+                    }
+                    return true;
+                });
+            case KEY(17, 0): // granularity
+                block_granularity = (int64_t)field.value_uint64;
+                break;
+            case KEY(19, 0): // latitude offset
+                block_lat_offset = (int64_t)field.value_uint64;
+                break;
+            case KEY(20, 0): // longitude offset
+                block_lon_offset = (int64_t)field.value_uint64;
+                break;
+        }
+        return true;
+    });
+
+    // the granularity is positive, so the transformed bounds are the bounds of the transformed values
+    if (result && min_lat <= max_lat)
+    {
+        const auto lat_scale = linear_scale_t::make(block_granularity, block_lat_offset, 100);
+        const auto lon_scale = linear_scale_t::make(block_granularity, block_lon_offset, 100);
+        summary.min_latitude = lat_scale.apply(min_lat);
+        summary.max_latitude = lat_scale.apply(max_lat);
+        summary.min_longitude = lon_scale.apply(min_lon);
+        summary.max_longitude = lon_scale.apply(max_lon);
+    }
+    return result;
+}
+
+/**
+ * @brief Collects the block index while a file is read
+ * @details The enumerator records where each blob is, the workers add the summaries of the blocks they inflated.
+ */
+struct index_builder_t
+{
+    bool active = false;
+    std::vector<block_summary_t> located; // enumerator thread only
+    std::mutex mtx;
+    std::vector<std::pair<size_t, block_summary_t>> summarized;
+
+    void open(bool enable)
+    {
+        active = enable;
+        located.clear();
+        summarized.clear();
+    }
+    void locate(const work_item& wi)
+    {
+        if (!active) return;
+        block_summary_t& summary = located.emplace_back();
+        summary.offset = wi.offset;
+        summary.header_size = wi.header_size;
+        summary.blob_size = wi.blob_size;
+    }
+    void summarize(const work_item& wi, uint8_t* raw_ptr, uint64_t raw_size)
+    {
+        if (!active) return;
+        block_summary_t summary;
+        summary.raw_size = raw_size;
+        if (wi.handler == read_header_block)
+            summary.kinds = BLOCK_HEADER;
+        else if (!summarize_primitive_block(raw_ptr, raw_ptr + raw_size, summary))
+            return;
+        std::lock_guard<std::mutex> lck(mtx);
+        summarized.emplace_back(wi.block_index, summary);
+    }
+    // false unless every located block was summarized
+    bool finish(std::vector<block_summary_t>& blocks)
+    {
+        active = false;
+        if (summarized.size() != located.size()) return false;
+        for (auto& [index, summary] : summarized)
+        {
+            if (index >= located.size()) return false;
+            summary.offset = located[index].offset;
+            summary.header_size = located[index].header_size;
+            summary.blob_size = located[index].blob_size;
+            located[index] = summary;
+        }
+        blocks.swap(located);
+        return true;
+    }
+};
+
+// queues, delivery order and index builder of one PBF read, they live on the stack of the reading thread
+struct pbf_read_t
+{
+    work_queue_t work_queue;
+    work_stealing_queue_t work_stealing_queue;
+    largest_first_queue_t largest_first_queue;
+    delivery_order_t delivery_order;
+    index_builder_t index_builder;
+};
+
+// clears reader_state_t::pbf when the read is over
+struct pbf_read_scope_t
+{
+    reader_state_t& reader;
+    ~pbf_read_scope_t() { reader.pbf = nullptr; }
+};
+
+inline bool take_delivery_turn()
+{
+    delivery_order_t& delivery_order = current_reader->pbf->delivery_order;
+    if (delivery_order.enabled && !delivery_turn_taken)
+    {
+        if (!delivery_order.take_turn(delivery_sequence)) return false;
+        delivery_turn_taken = true;
+    }
+    return true;
+}
+
+inline void stop_read(stop_reason_t reason)
+{
+    current_reader->stop(reason);
+    if (current_reader->pbf) current_reader->pbf->delivery_order.cancel();
+}
+
+inline bool read_stopped()
+{
+    if (!current_reader->stopped()) return false;
+    // stopped from outside or by the timeout, the workers waiting for their turn have to notice too
+    if (current_reader->pbf) current_reader->pbf->delivery_order.cancel();
+    return true;
+}
+
+bool input_xml(const char* filename);
 
 bool handle_blob(work_item& wi) noexcept;
-bool work(size_t index) noexcept
+
+// the item's file, block and delivery turn are set for the handlers
+bool handle_item(work_item& wi) noexcept
 {
-    while (1)
+    input_osm::file_index = wi.file_index;
+    input_osm::block_index = wi.block_index;
+    delivery_turn_taken = false;
+    delivery_sequence = wi.sequence;
+    if (!wi.xml_filename) return handle_blob(wi);
+
+    // the XML reader calls the handlers as it parses, so it holds the delivery turn for the whole file
+    if (!take_delivery_turn()) return false;
+    input_osm::file_type = file_type_t::xml;
+    const bool result = input_xml(wi.xml_filename);
+    input_osm::file_type = file_type_t::pbf;
+    input_osm::osc_mode = mode_t::bulk;
+    return result;
+}
+
+// busy: time spent on the blocks, including the handlers
+template <typename Queue>
+bool work(Queue& queue, size_t index, std::chrono::steady_clock::duration& busy) noexcept
+{
+    input_osm::thread_index = std::min(index, current_reader->threads() - 1);
+    delivery_order_t& delivery_order = current_reader->pbf->delivery_order;
+    work_item wi;
+    while (queue.pop(index, wi))
     {
-        input_osm::thread_index = std::min(index, thread_count() - 1);
-        work_item wi;
+        const auto start = std::chrono::steady_clock::now();
+        const bool result = !read_stopped() && handle_item(wi);
+        busy += std::chrono::steady_clock::now() - start;
+        if (delivery_order.enabled) delivery_order.finish(wi.sequence);
+        if (!result)
         {
-            std::lock_guard<std::mutex> lck(mtx_work_queue);
-            if (work_queue.empty()) return true;
-            wi = work_queue.front();
-            work_queue.pop();
+            // a decode error stops the other workers as well, unless the read was already stopped for another reason
+            stop_read(stop_reason_t::error);
+            queue.leave();
+            return false;
         }
-        input_osm::block_index = wi.block_index;
-        if (!handle_blob(wi)) return false;
     }
     return true;
 }
@@ -872,11 +1785,12 @@ bool work(size_t index) noexcept
 bool handle_blob(work_item& wi) noexcept
 {
     // Blob
-    thread_local std::vector<uint8_t> buffer2;
+    blob_compression_t compression = blob_compression_t::raw;
     uint8_t* zip_ptr = nullptr;
     uint64_t zip_sz = 0;
     uint8_t* raw_ptr = nullptr;
     uint64_t raw_size = 0;
+    writable_block = false;
     iterate_fields(wi.buffer1, wi.buffer1 + wi.blob_size, [&](field_t& field) -> bool {
         switch (field.key)
         {
@@ -888,6 +1802,11 @@ bool handle_blob(work_item& wi) noexcept
                 raw_size = field.value_uint64;
                 break;
             case KEY(3, 2): // zlib_data
+            case KEY(4, 2): // lzma_data
+            case KEY(5, 2): // OBSOLETE_bzip2_data
+            case KEY(6, 2): // lz4_data
+            case KEY(7, 2): // zstd_data
+                compression = static_cast<blob_compression_t>(field.key >> 3);
                 zip_sz = field.length;
                 zip_ptr = field.pointer;
                 break;
@@ -895,22 +1814,31 @@ bool handle_blob(work_item& wi) noexcept
         return true;
     });
 
-    // unzip if necessary
-    if (zip_ptr && zip_sz && raw_size)
+    // decompress if necessary
+    if (zip_ptr && !blob_compression_supported(compression))
     {
-        assert(zip_ptr >= wi.buffer1 && zip_ptr < wi.buffer1 + wi.blob_size);
-        assert(zip_ptr + zip_sz <= wi.buffer1 + wi.blob_size);
-        if (buffer2.size() < raw_size) buffer2.resize(raw_size);
-        raw_ptr = buffer2.data();
-        if (!unzip_compressed_block(zip_ptr, zip_sz, raw_ptr, raw_size))
+        IOSM_ERROR("block %zu: unsupported blob compression %s", wi.block_index, blob_compression_name(compression));
+        return false;
+    }
+    if (zip_ptr && raw_size)
+    {
+        assert(zip_ptr >= wi.buffer1 && zip_ptr + zip_sz <= wi.buffer1 + wi.blob_size);
+        if (inflated_block.size() < raw_size) inflated_block.resize(raw_size);
+        raw_ptr = inflated_block.data();
+        writable_block = true;
+        if (!decompress_blob(current_reader->decompressor, compression, zip_ptr, zip_sz, raw_ptr, raw_size))
         {
+            IOSM_ERROR("block %zu: corrupt %s blob", wi.block_index, blob_compression_name(compression));
             return false;
         }
     }
 
+    current_reader->pbf->index_builder.summarize(wi, raw_ptr, raw_size);
+
     // use blob data
     bool result = true;
     if (wi.handler) result = wi.handler(raw_ptr, raw_ptr + raw_size);
+    retained_block.reset();
     return result;
 };
 
@@ -919,7 +1847,8 @@ bool input_blob_mem(uint8_t*& buffer,
                     uint32_t header_size,
                     const char* expected_type,
                     bool (*handler)(uint8_t*, uint8_t*),
-                    size_t index) noexcept
+                    size_t index,
+                    work_item& wi) noexcept
 {
     // read BlobHeader
     uint8_t* header_buffer = buffer;
@@ -950,109 +1879,467 @@ bool input_blob_mem(uint8_t*& buffer,
     buffer += blob_size;
     if (buffer > buffer_end) return false;
 
-    // handle blob in its own thread
-    work_queue.push(work_item{buffer1, blob_size, handler, index});
+    // blob is handled by whoever consumes the work item
+    wi = work_item{buffer1, blob_size, handler, index, 0, header_size};
     return true;
 }
 
-static size_t g_thread_count = 0;
+void reader_t::set_thread_count(size_t count)
+{
+    state->thread_count = std::min(count, static_cast<size_t>(std::thread::hardware_concurrency()));
+}
+void reader_t::set_max_thread_count()
+{
+    state->thread_count = std::thread::hardware_concurrency();
+}
+size_t reader_t::thread_count() const
+{
+    return state->threads();
+}
+
+void reader_t::set_scheduler(scheduler_t value)
+{
+    state->scheduler = value;
+}
+scheduler_t reader_t::scheduler() const
+{
+    return state->scheduler;
+}
+
+void reader_t::set_ordered_delivery(bool value)
+{
+    state->ordered_delivery = value;
+}
+bool reader_t::ordered_delivery() const
+{
+    return state->ordered_delivery;
+}
+
+void reader_t::set_use_block_index(bool value)
+{
+    state->use_block_index = value;
+}
+bool reader_t::use_block_index() const
+{
+    return state->use_block_index;
+}
+
+decode_statistics_t reader_t::decode_statistics() const
+{
+    return {state->blocks_decoded.load(),
+            state->groups_decoded.load(),
+            state->buffer_grows.load(),
+            state->idle_seconds};
+}
+
+void reader_t::set_block_filter(std::function<bool(const block_summary_t&)> filter)
+{
+    state->block_filter = std::move(filter);
+}
+
 void set_thread_count(size_t count)
 {
-    g_thread_count = std::min(count, static_cast<size_t>(std::thread::hardware_concurrency()));
+    default_reader().set_thread_count(count);
 }
 void set_max_thread_count()
 {
-    g_thread_count = std::thread::hardware_concurrency();
+    default_reader().set_max_thread_count();
 }
 size_t thread_count()
 {
-    return g_thread_count ? g_thread_count : 1;
+    return default_reader().thread_count();
 }
 
-bool input_mem(uint8_t* file_begin, size_t file_size) noexcept
+void set_scheduler(scheduler_t value)
 {
-    // iterate file blocks
-    {
-        uint8_t* file_end = file_begin + file_size;
-        uint8_t* buf = file_begin;
-        size_t index = 0;
-        std::locale old_locale;
+    default_reader().set_scheduler(value);
+}
+scheduler_t scheduler()
+{
+    return default_reader().scheduler();
+}
+
+void set_ordered_delivery(bool value)
+{
+    default_reader().set_ordered_delivery(value);
+}
+bool ordered_delivery()
+{
+    return default_reader().ordered_delivery();
+}
+
+void set_use_block_index(bool value)
+{
+    default_reader().set_use_block_index(value);
+}
+bool use_block_index()
+{
+    return default_reader().use_block_index();
+}
+
+decode_statistics_t decode_statistics()
+{
+    return default_reader().decode_statistics();
+}
 
-        IOSM_TRACE("file size is %" PRIu64 " bytes", file_size);
-        IOSM_TRACE("reading block %" PRIu64, index);
+void set_block_filter(std::function<bool(const block_summary_t&)> filter)
+{
+    default_reader().set_block_filter(std::move(filter));
+}
 
-        if (buf + 4 > file_end) return false;
-        uint32_t header_size = read_net_uint32(buf);
+/**
+ * @brief Walk the file blocks and hand each blob to the sink as soon as it is found
+ * @param sink callable taking a work_item&, returns false to stop the enumeration early
+ * @return false if the file structure is invalid
+ */
+template <typename Sink>
+bool enumerate_blobs(uint8_t* file_begin,
+                     size_t file_size,
+                     bool (*data_handler)(uint8_t*, uint8_t*),
+                     Sink&& sink) noexcept
+{
+    uint8_t* file_end = file_begin + file_size;
+    uint8_t* buf = file_begin;
+    size_t index = 0;
+    work_item wi;
+
+    IOSM_TRACE("file size is %" PRIu64 " bytes", file_size);
+    IOSM_TRACE("reading block %" PRIu64, index);
+
+    if (buf + 4 > file_end) return false;
+    uint32_t header_size = read_net_uint32(buf);
+    buf += 4;
+    if (!input_blob_mem(buf, file_end, header_size, "OSMHeader", read_header_block, index++, wi)) return false;
+    current_reader->pbf->index_builder.locate(wi);
+    if (!sink(wi)) return true;
+
+    // data blobs
+    while (buf < file_end)
+    {
+        IOSM_TRACE("reading block %" PRIu64 " offset %" PRId64, index, buf - file_begin);
+        uint64_t offset = buf - file_begin;
+        // header size
+        if (buf + 4 > file_end) break;
+        header_size = read_net_uint32(buf);
         buf += 4;
-        if (!input_blob_mem(buf, file_end, header_size, "OSMHeader", read_header_block, index++)) return false;
+        // OSMData blob
+        if (!input_blob_mem(buf, file_end, header_size, "OSMData", data_handler, index++, wi)) return false;
+        wi.offset = offset;
+        current_reader->pbf->index_builder.locate(wi);
+        if (!sink(wi)) return true;
+    }
+    IOSM_TRACE("enumerated %" PRIu64 " blocks", index);
+    return true;
+}
 
-        // data blobs
-        while (buf < file_end)
-        {
-            IOSM_TRACE("reading block %" PRIu64 " offset %" PRId64, index, buf - file_begin);
-            // header size
-            if (buf + 4 > file_end) break;
-            header_size = read_net_uint32(buf);
-            buf += 4;
-            // OSMData blob
-            if (!input_blob_mem(buf, file_end, header_size, "OSMData", read_primitve_block, index++)) return false;
-        }
-        IOSM_TRACE("block work queue has  %" PRIu64 " items", work_queue.size());
+// true if the block holds something a handler wants and passes the user's block filter
+bool block_wanted(const block_summary_t& summary) noexcept
+{
+    if (summary.kinds & BLOCK_HEADER) return true;
+    const reader_state_t& reader = *current_reader;
+    // an entity kind is wanted if it has a handler and the block may hold some that pass the spatial and id filters
+    auto ids_overlap = [&reader](entity_kind_t kind, int64_t first, int64_t last) {
+        const id_set_t* ids = reader.id_filter(kind);
+        return !ids || ids->overlaps(first, last);
+    };
+    const bool nodes = (summary.kinds & BLOCK_HAS_NODES) && reader.node_handler &&
+                       reader.spatial_filter.intersects(summary) &&
+                       ids_overlap(ENTITY_NODES, summary.min_node_id, summary.max_node_id);
+    const bool ways = (summary.kinds & BLOCK_HAS_WAYS) && reader.way_handler &&
+                      ids_overlap(ENTITY_WAYS, summary.min_way_id, summary.max_way_id);
+    const bool relations = (summary.kinds & BLOCK_HAS_RELATIONS) && reader.relation_handler &&
+                           ids_overlap(ENTITY_RELATIONS, summary.min_relation_id, summary.max_relation_id);
+    if (!(nodes || ways || relations)) return false;
+    return !reader.block_filter || reader.block_filter(summary);
+}
+
+/**
+ * @brief Whether the block index describes this file
+ * @details The blocks have to tile the file, and every offset has to hold a BlobHeader of the expected type and data
+ * size. Only the headers are read, before any block is handed to a worker, so a stale index is noticed while the read
+ * can still fall back to walking the file.
+ */
+bool block_index_matches(uint8_t* file_begin, size_t file_size, const std::vector<block_summary_t>& blocks) noexcept
+{
+    uint8_t* file_end = file_begin + file_size;
+    uint64_t offset = 0;
+    for (size_t index = 0; index < blocks.size(); index++)
+    {
+        const block_summary_t& summary = blocks[index];
+        if (summary.offset != offset || file_size - offset < 4) return false;
+        uint8_t* buf = file_begin + offset;
+        if (read_net_uint32(buf) != summary.header_size) return false;
+        buf += 4;
+        work_item wi;
+        const char* expected_type = (summary.kinds & BLOCK_HEADER) ? "OSMHeader" : "OSMData";
+        if (!input_blob_mem(buf, file_end, summary.header_size, expected_type, nullptr, index, wi) ||
+            wi.blob_size != summary.blob_size)
+            return false;
+        offset = buf - file_begin;
     }
+    return offset == file_size;
+}
 
-    // handle blobs
-    if (thread_count() > 1)
+/**
+ * @brief Hand the blobs of the wanted blocks to the sink, straight from the block index
+ * @return false if the index does not match the file
+ */
+template <typename Sink>
+bool enumerate_indexed_blobs(uint8_t* file_begin,
+                             size_t file_size,
+                             const std::vector<block_summary_t>& blocks,
+                             Sink&& sink) noexcept
+{
+    size_t skipped = 0;
+    for (size_t index = 0; index < blocks.size(); index++)
     {
-        // spawn workers
-        std::vector<std::thread> worker_threads(thread_count());
-        for (size_t index{0}; index < thread_count(); index++)
+        const block_summary_t& summary = blocks[index];
+        if (summary.offset + 4 + summary.header_size + summary.blob_size > file_size) return false;
+        if (!block_wanted(summary))
         {
-            worker_threads[index] = std::thread(work, index);
+            skipped++;
+            continue;
         }
+        work_item wi{file_begin + summary.offset + 4 + summary.header_size,
+                     summary.blob_size,
+                     (summary.kinds & BLOCK_HEADER) ? read_header_block : read_primitve_block,
+                     index,
+                     summary.offset,
+                     summary.header_size};
+        if (!sink(wi)) return true;
+    }
+    IOSM_TRACE("block index: skipped %zu of %zu blocks", skipped, blocks.size());
+    return true;
+}
 
-        // wait for them to finish
-        for (auto& th : worker_threads)
-        {
-            if (th.joinable()) th.join();
-        }
+template <typename Queue, typename Enumerate>
+bool input_mem_threaded(Queue& queue, Enumerate&& enumerate) noexcept
+{
+    reader_state_t* reader = current_reader;
+    const size_t threads = reader->threads();
+    queue.open(k_blobs_ahead_per_thread * threads, threads);
+    reader->pbf->delivery_order.open(reader->ordered_delivery, k_blobs_ahead_per_thread * threads);
+
+    // workers come from the persistent pool, they block until the enumerator below feeds them. the pool is shared by
+    // all readers, so each job points its thread to this reader for the duration of the job
+    std::atomic<bool> failed{false};
+    std::vector<std::chrono::steady_clock::duration> busy(threads, std::chrono::steady_clock::duration::zero());
+    const std::function<void(size_t)> job = [&queue, &failed, &busy, reader](size_t index) {
+        current_reader_scope_t scope(reader);
+        input_osm::file_type = file_type_t::pbf;
+        input_osm::osc_mode = mode_t::bulk;
+        std::chrono::steady_clock::duration worker_busy = std::chrono::steady_clock::duration::zero();
+        if (!work(queue, index, worker_busy)) failed = true;
+        busy[index] = worker_busy;
+    };
+    const auto start = std::chrono::steady_clock::now();
+    worker_pool_t::run_t run;
+    worker_pool().start(run, threads, job);
+
+    // iterate file blocks
+    size_t sequence = 0;
+    bool result = enumerate([&queue, &sequence](work_item& wi) -> bool {
+        wi.sequence = sequence++;
+        return !read_stopped() && queue.push(wi);
+    });
+    queue.close();
+
+    // wait for them to finish
+    worker_pool().wait(run);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    reader->idle_seconds.resize(threads);
+    for (size_t i = 0; i < threads; i++)
+        reader->idle_seconds[i] = std::chrono::duration<double>(elapsed - busy[i]).count();
+
+    return result && !failed;
+}
+
+/**
+ * @brief Handle the blobs produced by enumerate(sink) with the configured threads and scheduler
+ */
+template <typename Enumerate>
+bool input_blobs(Enumerate&& enumerate) noexcept
+{
+    reader_state_t& reader = *current_reader;
+    if (reader.threads() == 1)
+    {
+        // 1 thread, so handle each blob as soon as it is enumerated, which is also in order
+        input_osm::thread_index = 0;
+        reader.pbf->delivery_order.open(false, 1);
+        bool failed = false;
+        bool result = enumerate([&failed](work_item& wi) -> bool {
+            failed = read_stopped() || !handle_item(wi);
+            return !failed;
+        });
+        return result && !failed;
     }
-    else
+
+    // in order delivery needs the blocks started in file order
+    if (reader.ordered_delivery) return input_mem_threaded(reader.pbf->work_queue, enumerate);
+
+    switch (reader.scheduler)
     {
-        // 1 thread, so call the work function directly
-        work(0);
+        case scheduler_t::queue:
+            return input_mem_threaded(reader.pbf->work_queue, enumerate);
+        case scheduler_t::work_stealing:
+            return input_mem_threaded(reader.pbf->work_stealing_queue, enumerate);
+        case scheduler_t::largest_first:
+            return input_mem_threaded(reader.pbf->largest_first_queue, enumerate);
     }
+    return false;
+}
 
-    return true;
+bool input_mem(uint8_t* file_begin, size_t file_size, bool (*data_handler)(uint8_t*, uint8_t*)) noexcept
+{
+    return input_blobs([=](auto&& sink) { return enumerate_blobs(file_begin, file_size, data_handler, sink); });
 }
 
-bool input_pbf(const char* filename) noexcept
+bool input_mem_indexed(uint8_t* file_begin, size_t file_size, const std::vector<block_summary_t>& blocks) noexcept
 {
-    struct stat mmapstat;
-    if (stat(filename, &mmapstat) == -1)
-    {
-        IOSM_ERROR("Failed stat: %s", strerror(errno));
-        return false;
-    }
-    int fd;
-    if ((fd = open(filename, O_RDONLY)) == -1)
+    return input_blobs([file_begin, file_size, &blocks](auto&& sink) {
+        return enumerate_indexed_blobs(file_begin, file_size, blocks, sink);
+    });
+}
+
+// read-only mapping of a whole file
+struct mapped_file_t
+{
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    int64_t mtime_ns = 0;
+
+    mapped_file_t() = default;
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+    ~mapped_file_t()
     {
-        IOSM_ERROR("Failed open: %s", strerror(errno));
-        return false;
+        if (data && munmap(data, size) == -1) IOSM_ERROR("Failed munmap: %s", strerror(errno));
     }
-    uint8_t* file_data = (uint8_t*)mmap((caddr_t)0, mmapstat.st_size, PROT_READ, MAP_SHARED, fd, 0);
-    close(fd);
-    if ((caddr_t)file_data == (caddr_t)(-1))
+
+    bool open(const char* filename) noexcept
     {
-        IOSM_ERROR("Failed mmap: %s", strerror(errno));
-        return false;
+        struct stat mmapstat;
+        if (stat(filename, &mmapstat) == -1)
+        {
+            IOSM_ERROR("Failed stat: %s", strerror(errno));
+            return false;
+        }
+        int fd;
+        if ((fd = ::open(filename, O_RDONLY)) == -1)
+        {
+            IOSM_ERROR("Failed open: %s", strerror(errno));
+            return false;
+        }
+        uint8_t* file_data = (uint8_t*)mmap((caddr_t)0, mmapstat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if ((caddr_t)file_data == (caddr_t)(-1))
+        {
+            IOSM_ERROR("Failed mmap: %s", strerror(errno));
+            return false;
+        }
+        // blobs are consumed roughly front to back, let the kernel read ahead
+        madvise(file_data, mmapstat.st_size, MADV_SEQUENTIAL);
+        data = file_data;
+        size = mmapstat.st_size;
+        mtime_ns = int64_t(mmapstat.st_mtim.tv_sec) * 1000000000 + mmapstat.st_mtim.tv_nsec;
+        return true;
     }
-    bool result = input_mem(file_data, mmapstat.st_size);
-    if (munmap(file_data, mmapstat.st_size) == -1)
+};
+
+bool input_pbf(const char* filename) noexcept
+{
+    reader_state_t& reader = *current_reader;
+    reader.blocks_decoded = reader.groups_decoded = reader.buffer_grows = 0;
+    reader.idle_seconds.clear();
+    mapped_file_t file;
+    if (!file.open(filename)) return false;
+    pbf_read_t read;
+    reader.pbf = &read;
+    const pbf_read_scope_t scope{reader};
+    if (!reader.use_block_index) return input_mem(file.data, file.size, read_primitve_block);
+
+    std::vector<block_summary_t> blocks;
+    if (load_block_index(filename, file.size, file.mtime_ns, blocks))
     {
-        IOSM_ERROR("Failed munmap: %s", strerror(errno));
-        return false;
+        if (block_index_matches(file.data, file.size, blocks)) return input_mem_indexed(file.data, file.size, blocks);
+        IOSM_INFO("block index does not match %s, rebuilding it", filename);
+        blocks.clear();
     }
+
+    // no usable index: build it during this read
+    read.index_builder.open(true);
+    bool result = input_mem(file.data, file.size, read_primitve_block);
+    if (result && read.index_builder.finish(blocks)) save_block_index(filename, file.size, file.mtime_ns, blocks);
     return result;
 }
 
+bool input_pbf_files(const std::vector<std::string>& filenames, const std::vector<file_type_t>& file_types) noexcept
+{
+    reader_state_t& reader = *current_reader;
+    reader.blocks_decoded = reader.groups_decoded = reader.buffer_grows = 0;
+    reader.idle_seconds.clear();
+    std::vector<mapped_file_t> files(filenames.size());
+    for (size_t i = 0; i < filenames.size(); i++)
+        if (file_types[i] == file_type_t::pbf && !files[i].open(filenames[i].c_str())) return false;
+    input_osm::file_type = file_type_t::pbf;
+    pbf_read_t read;
+    reader.pbf = &read;
+    const pbf_read_scope_t scope{reader};
+
+    return input_blobs([&](auto&& sink) {
+        for (size_t i = 0; i < filenames.size(); i++)
+        {
+            bool stopped = false;
+            auto file_sink = [&](work_item& wi) -> bool {
+                wi.file_index = i;
+                stopped = !sink(wi);
+                return !stopped;
+            };
+            if (file_types[i] == file_type_t::xml)
+            {
+                work_item wi;
+                wi.xml_filename = filenames[i].c_str();
+                if (!file_sink(wi)) return true;
+                continue;
+            }
+            const mapped_file_t& file = files[i];
+            std::vector<block_summary_t> blocks;
+            const bool indexed = reader.use_block_index &&
+                                 load_block_index(filenames[i].c_str(), file.size, file.mtime_ns, blocks) &&
+                                 block_index_matches(file.data, file.size, blocks);
+            const bool valid = indexed ? enumerate_indexed_blobs(file.data, file.size, blocks, file_sink)
+                                       : enumerate_blobs(file.data, file.size, read_primitve_block, file_sink);
+            if (!valid)
+            {
+                IOSM_ERROR("invalid PBF file %s", filenames[i].c_str());
+                return false;
+            }
+            if (stopped) return true;
+        }
+        return true;
+    });
+}
+
+bool reader_t::build_block_index(const char* filename) noexcept
+{
+    mapped_file_t file;
+    if (!file.open(filename)) return false;
+
+    current_reader_scope_t reader_scope(state.get());
+    input_osm::file_type = file_type_t::pbf;
+    pbf_read_t read;
+    state->pbf = &read;
+    const pbf_read_scope_t scope{*state};
+    std::vector<block_summary_t> blocks;
+    read.index_builder.open(true);
+    // inflate and summarize only, no handlers are called
+    bool result = input_mem(file.data, file.size, nullptr) && read.index_builder.finish(blocks);
+    return result && save_block_index(filename, file.size, file.mtime_ns, blocks);
+}
+
+bool build_block_index(const char* filename) noexcept
+{
+    return default_reader().build_block_index(filename);
+}
+
 } // namespace input_osm
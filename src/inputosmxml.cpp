@@ -14,13 +14,18 @@
 #include <inputosm/inputosm.h>
 #include "inputosmlog.h"
 #include "timeutil.h"
+#include "reader.h"
+#include "bufferpool.h"
 
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <expat.h>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <ctime>
@@ -28,16 +33,8 @@
 namespace input_osm
 {
 
-extern bool decode_metadata;
-extern std::function<bool(span_t<node_t>)> node_handler;
-extern std::function<bool(span_t<way_t>)> way_handler;
-extern std::function<bool(span_t<relation_t>)> relation_handler;
-
-bool parser_enabled;
-node_t current_node;
-way_t current_way;
-relation_t current_relation;
-
+namespace
+{
 enum class current_tag_t
 {
     none,
@@ -45,216 +42,495 @@ enum class current_tag_t
     way,
     relation
 };
-current_tag_t current_tag;
-std::vector<std::string> current_strings;
-std::vector<std::pair<int, int>> current_tags;
-std::vector<int64_t> current_refs;
-struct ext_relation_member_t : relation_member_t
+
+// entities are handed over in batches of one kind, like the PBF primitive groups
+constexpr size_t k_batch_size = 8000;
+
+struct tag_offsets_t
 {
-    int role_index = -1;
+    uint32_t key = 0;
+    uint32_t value = 0;
+    uint32_t key_length = 0;
+    uint32_t value_length = 0;
 };
-std::vector<ext_relation_member_t> current_members;
 
-static void xml_start_node(const char **attr)
+struct member_offsets_t
 {
-    // node start
-    current_node = node_t();
-    current_tag = current_tag_t::node;
-    for (int i = 0; attr[i]; i += 2)
-    {
-        if (strcmp(attr[i], "id") == 0) current_node.id = atoll(attr[i + 1]);
-        if (strcmp(attr[i], "lat") == 0)
-        {
-            // current_node.latitude = atof(attr[i + 1]);
-            double latitude = atof(attr[i + 1]);
-            current_node.raw_latitude = latitude * 10000000;
-        }
-        if (strcmp(attr[i], "lon") == 0)
-        {
-            // current_node.longitude = atof(attr[i + 1]);
-            double longitude = atof(attr[i + 1]);
-            current_node.raw_longitude = longitude * 10000000;
-        }
-        if (strcmp(attr[i], "version") == 0) current_node.version = atoi(attr[i + 1]);
-        if (strcmp(attr[i], "changeset") == 0) current_node.changeset = atoll(attr[i + 1]);
-        if (strcmp(attr[i], "timestamp") == 0) current_node.timestamp = str_to_timestamp(attr[i + 1]);
-    }
-}
+    uint8_t type = 0;
+    int64_t id = 0;
+    uint32_t role = 0;
+};
 
-static void xml_end_node()
+/**
+ * @brief The batch being collected
+ * @details Strings, tags, refs and members of all entities of the batch are appended to growing columns and referred
+ * to by offset; the pointers are made when the batch is handed over and the columns no longer move. *_begin hold the
+ * first column index of each entity of the batch. An entity that does not pass the filters is rolled back.
+ */
+struct xml_batch_t
 {
-    // node end
-    current_tag = current_tag_t::none;
-    // assemble tags
+    current_tag_t kind = current_tag_t::none;
+    std::vector<node_t> nodes;
+    std::vector<way_t> ways;
+    std::vector<relation_t> relations;
+    std::vector<char> strings;
+    std::vector<tag_offsets_t> tag_columns;
+    std::vector<int64_t> refs;
+    std::vector<member_offsets_t> member_columns;
+    std::vector<uint32_t> tag_begin;
+    std::vector<uint32_t> ref_begin;
+    std::vector<uint32_t> member_begin;
     std::vector<tag_t> tags;
-    for (std::size_t i = 0; i < current_tags.size(); i++)
+    std::vector<relation_member_t> members;
+
+    size_t size() const { return nodes.size() + ways.size() + relations.size(); }
+
+    void clear()
     {
-        tags.emplace_back(
-            tag_t{current_strings[current_tags[i].first].c_str(), current_strings[current_tags[i].second].c_str()});
+        kind = current_tag_t::none;
+        nodes.clear();
+        ways.clear();
+        relations.clear();
+        strings.clear();
+        tag_columns.clear();
+        refs.clear();
+        member_columns.clear();
+        tag_begin.clear();
+        ref_begin.clear();
+        member_begin.clear();
     }
-    current_node.tags = {tags.data(), tags.size()};
-    if (parser_enabled && node_handler) parser_enabled = node_handler({&current_node, 1});
-    current_tags.clear();
-    current_strings.clear();
+};
+
+template <typename T>
+span_t<T> slice(std::vector<T> &column, const std::vector<uint32_t> &begin, size_t i)
+{
+    const uint32_t first = begin[i];
+    const uint32_t last = i + 1 < begin.size() ? begin[i + 1] : uint32_t(column.size());
+    return {column.data() + first, last - first};
 }
 
-static void xml_start_way(const char **attr)
+// clear the fields that set_projection leaves out
+template <typename T>
+void project_metadata(T &entity, uint32_t fields)
 {
-    // way start
-    current_way = way_t();
-    current_tag = current_tag_t::way;
-    for (int i = 0; attr[i]; i += 2)
-    {
-        if (strcmp(attr[i], "id") == 0) current_way.id = atoll(attr[i + 1]);
-        if (strcmp(attr[i], "version") == 0) current_way.version = atoi(attr[i + 1]);
-        if (strcmp(attr[i], "changeset") == 0) current_way.changeset = atoll(attr[i + 1]);
-        if (strcmp(attr[i], "timestamp") == 0) current_way.timestamp = str_to_timestamp(attr[i + 1]);
-    }
+    if (!(fields & PROJECT_VERSION)) entity.version = 0;
+    if (!(fields & PROJECT_TIMESTAMP)) entity.timestamp = 0;
+    if (!(fields & PROJECT_CHANGESET)) entity.changeset = 0;
+    if (!(fields & PROJECT_TAGS)) entity.tags = {};
 }
 
-static void xml_end_way()
+// the metadata attributes common to all entities, parsed only if projected
+template <typename T>
+void read_metadata(T &entity, const char *name, const char *value, uint32_t fields)
 {
-    // way end
-    current_tag = current_tag_t::none;
-    // assemble tags
-    std::vector<tag_t> tags;
-    for (std::size_t i = 0; i < current_tags.size(); i++)
-    {
-        tags.emplace_back(
-            tag_t{current_strings[current_tags[i].first].c_str(), current_strings[current_tags[i].second].c_str()});
-    }
-    current_way.tags = {tags.data(), tags.size()};
-    current_way.node_refs = {current_refs.data(), current_refs.size()};
-    if (parser_enabled && way_handler) parser_enabled = way_handler({&current_way, 1});
-    current_tags.clear();
-    current_strings.clear();
-    current_refs.clear();
+    if (!(fields & PROJECT_METADATA)) return;
+    if (strcmp(name, "version") == 0)
+        entity.version = atoi(value);
+    else if (strcmp(name, "changeset") == 0)
+        entity.changeset = atoll(value);
+    else if (strcmp(name, "timestamp") == 0 && (fields & PROJECT_TIMESTAMP))
+        entity.timestamp = str_to_timestamp(value);
 }
 
-static void xml_start_relation(const char **attr)
+// the batch being handed to a handler on this thread, nullptr between handlers, and its handle once retained
+thread_local xml_batch_t *delivering_batch = nullptr;
+thread_local batch_handle_t delivered_xml_handle;
+
+/**
+ * @brief State of one XML read, the user data of its expat parser
+ */
+struct xml_reader_t
 {
-    // relation start
-    current_relation = relation_t();
-    current_tag = current_tag_t::relation;
-    for (int i = 0; attr[i]; i += 2)
+    const reader_state_t &reader;
+    bool parser_enabled = true;
+    current_tag_t current_tag = current_tag_t::none;
+    node_t current_node;
+    way_t current_way;
+    relation_t current_relation;
+    xml_batch_t batch;
+    // column sizes when the current entity started
+    size_t entity_strings = 0, entity_tags = 0, entity_refs = 0, entity_members = 0;
+    // whether the current entity needs its tags and refs or members collected
+    bool collect_tags = false, collect_refs = false;
+
+    explicit xml_reader_t(const reader_state_t &reader)
+        : reader(reader)
     {
-        if (strcmp(attr[i], "id") == 0) current_relation.id = atoll(attr[i + 1]);
-        if (strcmp(attr[i], "version") == 0) current_relation.version = atoi(attr[i + 1]);
-        if (strcmp(attr[i], "changeset") == 0) current_relation.changeset = atoll(attr[i + 1]);
-        if (strcmp(attr[i], "timestamp") == 0) current_relation.timestamp = str_to_timestamp(attr[i + 1]);
     }
-}
 
-static void xml_end_relation()
-{
-    // end relation
-    current_tag = current_tag_t::none;
-    // assemble tags
-    std::vector<tag_t> tags;
-    for (std::size_t i = 0; i < current_tags.size(); i++)
+    // appends a NUL terminated string, returns its offset
+    uint32_t add_string(const char *str, size_t length)
     {
-        tags.emplace_back(
-            tag_t{current_strings[current_tags[i].first].c_str(), current_strings[current_tags[i].second].c_str()});
+        const uint32_t offset = uint32_t(batch.strings.size());
+        batch.strings.insert(batch.strings.end(), str, str + length + 1);
+        return offset;
     }
-    current_relation.tags = {tags.data(), tags.size()};
-    // assemble members
-    std::vector<relation_member_t> members;
-    for (const auto &m : current_members)
+
+    void project(node_t &node) const
     {
-        members.emplace_back(
-            relation_member_t{m.type, m.id, m.role_index >= 0 ? current_strings[m.role_index].c_str() : nullptr});
+        project_metadata(node, reader.node_fields);
+        // the degree columns are made from the coordinates
+        if (!(reader.node_fields & (PROJECT_COORDINATES | PROJECT_DEGREES))) node.raw_latitude = node.raw_longitude = 0;
     }
-    current_relation.members = {members.data(), members.size()};
-    if (parser_enabled && relation_handler) parser_enabled = relation_handler({&current_relation, 1});
-    current_tags.clear();
-    current_strings.clear();
-    current_members.clear();
-}
 
-static void xml_start_xtag(const char **attr)
-{
-    // tag start
-    if (current_tag != current_tag_t::none)
+    void project(way_t &way) const
+    {
+        project_metadata(way, reader.way_fields);
+        if (!(reader.way_fields & PROJECT_REFS)) way.node_refs = {};
+    }
+
+    void project(relation_t &relation) const
+    {
+        project_metadata(relation, reader.relation_fields);
+        if (!(reader.relation_fields & PROJECT_REFS)) relation.members = {};
+    }
+
+    template <typename T>
+    bool deliver(function_ref_t<bool(span_t<T>)> handler, std::vector<T> &list)
+    {
+        delivering_batch = &batch;
+        const bool result = handler({list.data(), list.size()});
+        delivering_batch = nullptr;
+        delivered_xml_handle.reset();
+        if (!result) reader.stop(stop_reason_t::handler);
+        return result;
+    }
+
+    // hand the batch over to its handler, unless the read was stopped meanwhile
+    void flush_batch()
+    {
+        if (parser_enabled && batch.size() && !reader.stopped())
+        {
+            batch.tags.resize(batch.tag_columns.size());
+            for (size_t i = 0; i < batch.tag_columns.size(); i++)
+            {
+                const auto &t = batch.tag_columns[i];
+                batch.tags[i] = tag_t{batch.strings.data() + t.key,
+                                      batch.strings.data() + t.value,
+                                      t.key_length,
+                                      t.value_length};
+            }
+            switch (batch.kind)
+            {
+                case current_tag_t::node:
+                    for (size_t i = 0; i < batch.nodes.size(); i++)
+                    {
+                        batch.nodes[i].tags = slice(batch.tags, batch.tag_begin, i);
+                        project(batch.nodes[i]);
+                    }
+                    parser_enabled = deliver(reader.node_handler, batch.nodes);
+                    break;
+                case current_tag_t::way:
+                    for (size_t i = 0; i < batch.ways.size(); i++)
+                    {
+                        batch.ways[i].tags = slice(batch.tags, batch.tag_begin, i);
+                        batch.ways[i].node_refs = slice(batch.refs, batch.ref_begin, i);
+                        project(batch.ways[i]);
+                    }
+                    parser_enabled = deliver(reader.way_handler, batch.ways);
+                    break;
+                case current_tag_t::relation:
+                    batch.members.resize(batch.member_columns.size());
+                    for (size_t i = 0; i < batch.member_columns.size(); i++)
+                    {
+                        const auto &m = batch.member_columns[i];
+                        batch.members[i] = relation_member_t{m.type, m.id, batch.strings.data() + m.role};
+                    }
+                    for (size_t i = 0; i < batch.relations.size(); i++)
+                    {
+                        batch.relations[i].tags = slice(batch.tags, batch.tag_begin, i);
+                        batch.relations[i].members = slice(batch.members, batch.member_begin, i);
+                        project(batch.relations[i]);
+                    }
+                    parser_enabled = deliver(reader.relation_handler, batch.relations);
+                    break;
+                case current_tag_t::none:
+                    break;
+            }
+        }
+        batch.clear();
+    }
+
+    void start_entity(current_tag_t kind, entity_kind_t entity_kind, uint32_t fields)
+    {
+        if (batch.kind != kind) flush_batch();
+        batch.kind = kind;
+        current_tag = kind;
+        entity_strings = batch.strings.size();
+        entity_tags = batch.tag_columns.size();
+        entity_refs = batch.refs.size();
+        entity_members = batch.member_columns.size();
+        collect_tags = (fields & PROJECT_TAGS) || reader.tag_matcher.applies(entity_kind);
+        collect_refs = fields & PROJECT_REFS;
+    }
+
+    // whether the entity passes the tag filter of set_tag_filter
+    bool tags_pass(entity_kind_t kind)
     {
-        size_t istart = current_strings.size();
+        if (!reader.tag_matcher.applies(kind)) return true;
+        thread_local std::vector<tag_t> tags;
+        tags.clear();
+        for (size_t i = entity_tags; i < batch.tag_columns.size(); i++)
+        {
+            const auto &t = batch.tag_columns[i];
+            tags.emplace_back(
+                tag_t{batch.strings.data() + t.key, batch.strings.data() + t.value, t.key_length, t.value_length});
+        }
+        return reader.tag_matcher.filter.matches({tags.data(), tags.size()});
+    }
+
+    // whether the entity passes the id filter of set_id_filter
+    bool id_passes(entity_kind_t kind, int64_t id) const
+    {
+        const id_set_t *ids = reader.id_filter(kind);
+        return !ids || ids->contains(id);
+    }
+
+    // keep the current entity in the batch, or drop what it appended to the columns
+    template <typename T>
+    void end_entity(bool keep, std::vector<T> &list, const T &entity)
+    {
+        current_tag = current_tag_t::none;
+        if (keep)
+        {
+            list.push_back(entity);
+            batch.tag_begin.push_back(uint32_t(entity_tags));
+            batch.ref_begin.push_back(uint32_t(entity_refs));
+            batch.member_begin.push_back(uint32_t(entity_members));
+            if (list.size() >= k_batch_size) flush_batch();
+        }
+        else
+        {
+            batch.strings.resize(entity_strings);
+            batch.tag_columns.resize(entity_tags);
+            batch.refs.resize(entity_refs);
+            batch.member_columns.resize(entity_members);
+        }
+    }
+
+    void start_node(const char **attr)
+    {
+        // node start
+        start_entity(current_tag_t::node, ENTITY_NODES, reader.node_fields);
+        current_node = node_t();
         for (int i = 0; attr[i]; i += 2)
         {
-            if (strcmp(attr[i], "k") == 0) current_strings.emplace_back(attr[i + 1]);
-            if (strcmp(attr[i], "v") == 0) current_strings.emplace_back(attr[i + 1]);
+            if (strcmp(attr[i], "id") == 0)
+                current_node.id = atoll(attr[i + 1]);
+            else if (strcmp(attr[i], "lat") == 0)
+                // rounded, 7 decimals do not survive the double exactly
+                current_node.raw_latitude = std::llround(atof(attr[i + 1]) * 10000000);
+            else if (strcmp(attr[i], "lon") == 0)
+                current_node.raw_longitude = std::llround(atof(attr[i + 1]) * 10000000);
+            else
+                read_metadata(current_node, attr[i], attr[i + 1], reader.node_fields);
         }
-        for (auto i = istart; i < current_strings.size(); i += 2)
-            current_tags.emplace_back(std::pair<int, int>{i, i + 1});
     }
-}
 
-static void xml_start_nd(const char **attr)
-{
-    // nd start
-    if (current_tag == current_tag_t::way)
+    void end_node()
     {
+        // node end
+        end_entity(parser_enabled && reader.node_handler && current_tag == current_tag_t::node &&
+                       id_passes(ENTITY_NODES, current_node.id) &&
+                       reader.spatial_filter.contains(current_node.raw_latitude, current_node.raw_longitude) &&
+                       tags_pass(ENTITY_NODES),
+                   batch.nodes,
+                   current_node);
+    }
+
+    void start_way(const char **attr)
+    {
+        // way start
+        start_entity(current_tag_t::way, ENTITY_WAYS, reader.way_fields);
+        current_way = way_t();
         for (int i = 0; attr[i]; i += 2)
         {
-            if (strcmp(attr[i], "ref") == 0) current_refs.emplace_back(atoll(attr[i + 1]));
+            if (strcmp(attr[i], "id") == 0)
+                current_way.id = atoll(attr[i + 1]);
+            else
+                read_metadata(current_way, attr[i], attr[i + 1], reader.way_fields);
         }
     }
-}
 
-static void xml_start_member(const char **attr)
-{
-    // member start
-    if (current_tag == current_tag_t::relation)
+    void end_way()
+    {
+        // way end
+        end_entity(parser_enabled && reader.way_handler && current_tag == current_tag_t::way &&
+                       id_passes(ENTITY_WAYS, current_way.id) && tags_pass(ENTITY_WAYS),
+                   batch.ways,
+                   current_way);
+    }
+
+    void start_relation(const char **attr)
     {
-        ext_relation_member_t member;
+        // relation start
+        start_entity(current_tag_t::relation, ENTITY_RELATIONS, reader.relation_fields);
+        current_relation = relation_t();
         for (int i = 0; attr[i]; i += 2)
         {
-            if (strcmp(attr[i], "ref") == 0) member.id = atoll(attr[i + 1]);
-            if (strcmp(attr[i], "type") == 0)
+            if (strcmp(attr[i], "id") == 0)
+                current_relation.id = atoll(attr[i + 1]);
+            else
+                read_metadata(current_relation, attr[i], attr[i + 1], reader.relation_fields);
+        }
+    }
+
+    void end_relation()
+    {
+        // end relation
+        end_entity(parser_enabled && reader.relation_handler && current_tag == current_tag_t::relation &&
+                       id_passes(ENTITY_RELATIONS, current_relation.id) && tags_pass(ENTITY_RELATIONS),
+                   batch.relations,
+                   current_relation);
+    }
+
+    void start_xtag(const char **attr)
+    {
+        // tag start
+        if (current_tag != current_tag_t::none && collect_tags)
+        {
+            const char *key = nullptr;
+            const char *value = nullptr;
+            for (int i = 0; attr[i]; i += 2)
+            {
+                if (strcmp(attr[i], "k") == 0) key = attr[i + 1];
+                if (strcmp(attr[i], "v") == 0) value = attr[i + 1];
+            }
+            if (!key || !value) return;
+            tag_offsets_t tag;
+            tag.key_length = uint32_t(strlen(key));
+            tag.value_length = uint32_t(strlen(value));
+            tag.key = add_string(key, tag.key_length);
+            tag.value = add_string(value, tag.value_length);
+            batch.tag_columns.push_back(tag);
+        }
+    }
+
+    void start_nd(const char **attr)
+    {
+        // nd start
+        if (current_tag == current_tag_t::way && collect_refs)
+        {
+            for (int i = 0; attr[i]; i += 2)
             {
-                if (strcmp(attr[i + 1], "node") == 0) member.type = 0;
-                if (strcmp(attr[i + 1], "way") == 0) member.type = 1;
-                if (strcmp(attr[i + 1], "relation") == 0) member.type = 2;
+                if (strcmp(attr[i], "ref") == 0) batch.refs.push_back(atoll(attr[i + 1]));
             }
-            if (strcmp(attr[i], "role") == 0)
+        }
+    }
+
+    void start_member(const char **attr)
+    {
+        // member start
+        if (current_tag == current_tag_t::relation && collect_refs)
+        {
+            member_offsets_t member;
+            const char *role = "";
+            for (int i = 0; attr[i]; i += 2)
             {
-                current_strings.emplace_back(attr[i + 1]);
-                member.role_index = current_strings.size() - 1;
+                if (strcmp(attr[i], "ref") == 0) member.id = atoll(attr[i + 1]);
+                if (strcmp(attr[i], "type") == 0)
+                {
+                    if (strcmp(attr[i + 1], "node") == 0) member.type = 0;
+                    if (strcmp(attr[i + 1], "way") == 0) member.type = 1;
+                    if (strcmp(attr[i + 1], "relation") == 0) member.type = 2;
+                }
+                if (strcmp(attr[i], "role") == 0) role = attr[i + 1];
             }
+            member.role = add_string(role, strlen(role));
+            batch.member_columns.push_back(member);
         }
-        if (member.role_index < 0)
+    }
+
+    // the batch is handed over before the osc section changes, osc_mode holds for all its entities
+    void set_osc_mode(mode_t mode)
+    {
+        flush_batch();
+        osc_mode = mode;
+    }
+
+    void start_tag(const char *el, const char **attr)
+    {
+        // XML tag start, the most frequent elements first
+        switch (el[0])
+        {
+            case 'n':
+                if (strcmp(el, "nd") == 0)
+                    start_nd(attr);
+                else if (strcmp(el, "node") == 0)
+                    start_node(attr);
+                break;
+            case 't':
+                if (strcmp(el, "tag") == 0) start_xtag(attr);
+                break;
+            case 'w':
+                if (strcmp(el, "way") == 0) start_way(attr);
+                break;
+            case 'm':
+                if (strcmp(el, "member") == 0)
+                    start_member(attr);
+                else if (strcmp(el, "modify") == 0)
+                    set_osc_mode(mode_t::modify);
+                break;
+            case 'r':
+                if (strcmp(el, "relation") == 0) start_relation(attr);
+                break;
+            case 'c':
+                if (strcmp(el, "create") == 0) set_osc_mode(mode_t::create);
+                break;
+            case 'd':
+                if (strcmp(el, "delete") == 0) set_osc_mode(mode_t::destroy);
+                break;
+        }
+    }
+
+    void end_tag(const char *el)
+    {
+        // XML tag end
+        switch (el[0])
         {
-            current_strings.emplace_back();
-            member.role_index = current_strings.size() - 1;
+            case 'n':
+                if (strcmp(el, "node") == 0) end_node();
+                break;
+            case 'w':
+                if (strcmp(el, "way") == 0) end_way();
+                break;
+            case 'r':
+                if (strcmp(el, "relation") == 0) end_relation();
+                break;
+            case 'c':
+            case 'm':
+            case 'd':
+                if (strcmp(el, "create") == 0 || strcmp(el, "modify") == 0 || strcmp(el, "delete") == 0)
+                    set_osc_mode(mode_t::bulk);
+                break;
         }
-        current_members.emplace_back(member);
     }
+};
+
+void xml_start_tag(void *data, const char *el, const char **attr)
+{
+    static_cast<xml_reader_t *>(data)->start_tag(el, attr);
 }
 
-static void xml_start_tag(void * /*data*/, const char *el, const char **attr)
+void xml_end_tag(void *data, const char *el)
 {
-    // XML tag start
-    if (strcmp(el, "node") == 0) xml_start_node(attr);
-    if (strcmp(el, "way") == 0) xml_start_way(attr);
-    if (strcmp(el, "relation") == 0) xml_start_relation(attr);
-
-    if (strcmp(el, "tag") == 0) xml_start_xtag(attr);
-    if (strcmp(el, "nd") == 0) xml_start_nd(attr);
-    if (strcmp(el, "member") == 0) xml_start_member(attr);
-
-    if (strcmp(el, "create") == 0) osc_mode = mode_t::create;
-    if (strcmp(el, "modify") == 0) osc_mode = mode_t::modify;
-    if (strcmp(el, "delete") == 0) osc_mode = mode_t::destroy;
+    static_cast<xml_reader_t *>(data)->end_tag(el);
 }
+} // namespace
 
-static void xml_end_tag(void * /*data*/, const char *el)
+batch_handle_t retain_xml_batch()
 {
-    // XML tag end
-    if (strcmp(el, "node") == 0) xml_end_node();
-    if (strcmp(el, "way") == 0) xml_end_way();
-    if (strcmp(el, "relation") == 0) xml_end_relation();
-
-    if (strcmp(el, "create") == 0) osc_mode = mode_t::bulk;
-    if (strcmp(el, "modify") == 0) osc_mode = mode_t::bulk;
-    if (strcmp(el, "delete") == 0) osc_mode = mode_t::bulk;
+    if (!delivering_batch) return {};
+    if (delivered_xml_handle) return delivered_xml_handle;
+    // the nodes the columnar and compact handlers get are converted into other buffers
+    const reader_state_t &reader = *current_reader;
+    if (delivering_batch->kind == current_tag_t::node && (reader.node_columns_handler || reader.compact_node_handler))
+        return {};
+    // the parser goes on with a pooled batch, the spans handed out keep pointing to the swapped one
+    std::shared_ptr<xml_batch_t> retained = buffer_pool<xml_batch_t>().acquire();
+    std::swap(*retained, *delivering_batch);
+    delivered_xml_handle = std::move(retained);
+    return delivered_xml_handle;
 }
 
 bool input_xml(const char *filename)
@@ -272,22 +548,24 @@ bool input_xml(const char *filename)
         fclose(f);
         return false;
     }
+    xml_reader_t xml_reader(*current_reader);
+    XML_SetUserData(parser, &xml_reader);
     XML_SetElementHandler(parser, xml_start_tag, xml_end_tag);
     const size_t BUFFSIZE = 8192;
     char xml_buff[BUFFSIZE + 1];
     int done = 0;
     int len;
-    parser_enabled = true;
-    current_tag = current_tag_t::none;
     while (!done)
     {
+        // a handler returned false, or the read was cancelled or timed out
+        if (!xml_reader.parser_enabled || current_reader->stopped()) break;
         len = fread(xml_buff, 1, BUFFSIZE - 1, f);
         if (ferror(f))
         {
             result = false;
             break;
         }
-        done = feof(f) || !parser_enabled;
+        done = feof(f);
         if (!XML_Parse(parser, xml_buff, len, done))
         {
             result = false;
@@ -296,6 +574,8 @@ bool input_xml(const char *filename)
             break;
         }
     }
+    // the last batch, unless the file could not be read or parsed to its end
+    if (result) xml_reader.flush_batch();
     if (parser)
     {
         XML_ParserFree(parser);
@@ -306,7 +586,7 @@ bool input_xml(const char *filename)
         fclose(f);
         f = nullptr;
     }
-    return result;
+    return result && !current_reader->stopped();
 }
 
-} // namespace input_osm
\ No newline at end of file
+} // namespace input_osm
@@ -0,0 +1,130 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "normalize.h"
+
+#include <numeric>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define INPUTOSM_NORMALIZE_X86
+#include <immintrin.h>
+#endif
+
+namespace input_osm
+{
+
+namespace
+{
+
+void scale_column_scalar(int64_t* values, size_t count, const linear_scale_t& scale) noexcept
+{
+    if (scale.divisor == 1)
+    {
+        for (size_t i = 0; i < count; i++) values[i] = scale.offset + scale.multiplier * values[i];
+        return;
+    }
+    for (size_t i = 0; i < count; i++) values[i] = scale.apply(values[i]);
+}
+
+void to_degrees_scalar(const int64_t* values, size_t count, double* out) noexcept
+{
+    for (size_t i = 0; i < count; i++) out[i] = static_cast<double>(values[i]) * 1e-7;
+}
+
+#ifdef INPUTOSM_NORMALIZE_X86
+
+// low 64 bits of the product, AVX2 has no 64 bit multiply
+__attribute__((target("avx2"))) inline __m256i mullo_epi64(__m256i a, __m256i b) noexcept
+{
+    const __m256i low = _mm256_mul_epu32(a, b);
+    const __m256i cross =
+        _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2"))) void scale_column_avx2(int64_t* values,
+                                                         size_t count,
+                                                         const linear_scale_t& scale) noexcept
+{
+    if (scale.divisor != 1)
+    {
+        scale_column_scalar(values, count, scale);
+        return;
+    }
+    const __m256i multiplier = _mm256_set1_epi64x(scale.multiplier);
+    const __m256i offset = _mm256_set1_epi64x(scale.offset);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i* p = reinterpret_cast<__m256i*>(values + i);
+        _mm256_storeu_si256(p, _mm256_add_epi64(offset, mullo_epi64(_mm256_loadu_si256(p), multiplier)));
+    }
+    scale_column_scalar(values + i, count - i, scale);
+}
+
+// adding 1.5 * 2^52 puts a small integer into the mantissa of a double with that exponent
+__attribute__((target("avx2"))) void to_degrees_avx2(const int64_t* values, size_t count, double* out) noexcept
+{
+    const __m256i magic_bits = _mm256_set1_epi64x(0x4338000000000000);
+    const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+    const __m256d unit = _mm256_set1_pd(1e-7);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        const __m256d exact = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(value, magic_bits)), magic);
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(exact, unit));
+    }
+    to_degrees_scalar(values + i, count - i, out + i);
+}
+
+#endif
+
+struct normalize_kernels_t
+{
+    void (*scale_column)(int64_t*, size_t, const linear_scale_t&) noexcept;
+    void (*to_degrees)(const int64_t*, size_t, double*) noexcept;
+};
+
+const normalize_kernels_t& kernels() noexcept
+{
+    static const normalize_kernels_t selected = []() -> normalize_kernels_t {
+#ifdef INPUTOSM_NORMALIZE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return {scale_column_avx2, to_degrees_avx2};
+#endif
+        return {scale_column_scalar, to_degrees_scalar};
+    }();
+    return selected;
+}
+
+} // namespace
+
+linear_scale_t linear_scale_t::make(int64_t multiplier, int64_t offset, int64_t divisor) noexcept
+{
+    const int64_t common = std::gcd(std::gcd(multiplier, offset), divisor);
+    if (common <= 1) return {multiplier, offset, divisor};
+    return {multiplier / common, offset / common, divisor / common};
+}
+
+void scale_column(int64_t* values, size_t count, const linear_scale_t& scale) noexcept
+{
+    kernels().scale_column(values, count, scale);
+}
+
+void to_degrees(const int64_t* values, size_t count, double* out) noexcept
+{
+    kernels().to_degrees(values, count, out);
+}
+
+} // namespace input_osm
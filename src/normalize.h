@@ -0,0 +1,47 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _NORMALIZE_H_
+#define _NORMALIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace input_osm
+{
+
+/**
+ * @brief value -> (offset + multiplier * value) / divisor, rounded toward zero
+ * @details make() reduces the fraction, so the default PBF granularities come out as the identity and coarser ones
+ * that are multiples of the output unit need no division.
+ */
+struct linear_scale_t
+{
+    int64_t multiplier = 1;
+    int64_t offset = 0;
+    int64_t divisor = 1;
+
+    static linear_scale_t make(int64_t multiplier, int64_t offset, int64_t divisor) noexcept;
+    bool identity() const { return multiplier == 1 && offset == 0 && divisor == 1; }
+    int64_t apply(int64_t value) const { return (offset + multiplier * value) / divisor; }
+};
+
+// scale a column in place; SIMD when no division is left
+void scale_column(int64_t* values, size_t count, const linear_scale_t& scale) noexcept;
+
+// 1e-7 degree fixed point to degrees, exact for |value| < 2^51
+void to_degrees(const int64_t* values, size_t count, double* out) noexcept;
+
+} // namespace input_osm
+
+#endif // _NORMALIZE_H_
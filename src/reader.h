@@ -0,0 +1,141 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _READER_H_
+#define _READER_H_
+
+#include <inputosm/inputosm.h>
+
+#include "decompress.h"
+#include "tagfilter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace input_osm
+{
+
+struct pbf_read_t;
+
+/**
+ * @brief Options, handlers and statistics of one reader_t
+ * @details The options are set between reads. The other fields describe the read in progress; the decoders reach
+ * them through current_reader.
+ */
+struct reader_state_t
+{
+    // options
+    size_t thread_count = 0;
+    scheduler_t scheduler = scheduler_t::queue;
+    bool ordered_delivery = false;
+    bool use_block_index = false;
+    std::function<bool(const block_summary_t&)> block_filter;
+    uint32_t projection[3] = {PROJECT_ALL, PROJECT_ALL, PROJECT_ALL}; // nodes, ways, relations
+    tag_matcher_t tag_matcher;
+    spatial_filter_t spatial_filter;
+    id_set_t id_filters[3]; // nodes, ways, relations
+    bool batch_retention = false;
+    std::chrono::milliseconds timeout{0};
+    decompressor_t decompressor = fastest_decompressor();
+
+    // the read in progress
+    bool decode_metadata = false;
+    // projection_t fields of the current read, the projection combined with decode_metadata
+    uint32_t node_fields = PROJECT_ALL;
+    uint32_t way_fields = PROJECT_ALL;
+    uint32_t relation_fields = PROJECT_ALL;
+    // bound to the handlers passed to the read for its duration, the decode loops call them through one thunk
+    function_ref_t<bool(span_t<node_t>)> node_handler;
+    function_ref_t<bool(const node_columns_t&)> node_columns_handler;
+    function_ref_t<bool(span_t<compact_node_t>)> compact_node_handler;
+    function_ref_t<bool(span_t<way_t>)> way_handler;
+    function_ref_t<bool(span_t<relation_t>)> relation_handler;
+    pbf_read_t* pbf = nullptr; // queues and delivery order of a PBF read
+    std::atomic<uint64_t> blocks_decoded{0};
+    std::atomic<uint64_t> groups_decoded{0};
+    std::atomic<uint64_t> buffer_grows{0};
+    std::vector<double> idle_seconds; // by thread_index, of the last multi-threaded read
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // set once by whoever stops the read first, from any thread
+    mutable std::atomic<stop_reason_t> stop_reason{stop_reason_t::none};
+    // between begin_read and end_read
+    std::atomic<bool> reading{false};
+    // a cancel() that no read has consumed yet, the next read starts stopped
+    std::atomic<bool> cancel_pending{false};
+
+    size_t threads() const { return thread_count ? thread_count : 1; }
+
+    // unbinds the handlers once a read returned, they refer to callables of the caller
+    void clear_handlers()
+    {
+        node_handler = nullptr;
+        node_columns_handler = nullptr;
+        compact_node_handler = nullptr;
+        way_handler = nullptr;
+        relation_handler = nullptr;
+    }
+
+    // stops the read in progress, or else the next one; begin_read stores reading before it consumes
+    // cancel_pending, so one of the two sides sees the other
+    void cancel()
+    {
+        cancel_pending = true;
+        if (reading) stop(stop_reason_t::cancel);
+    }
+    // the first reason sticks
+    void stop(stop_reason_t reason) const
+    {
+        stop_reason_t none = stop_reason_t::none;
+        stop_reason.compare_exchange_strong(none, reason, std::memory_order_relaxed);
+    }
+    // whether the read has to stop, checked between blocks, groups and batches
+    bool stopped() const
+    {
+        if (stop_reason.load(std::memory_order_relaxed) != stop_reason_t::none) return true;
+        if (deadline == std::chrono::steady_clock::time_point::max() || std::chrono::steady_clock::now() < deadline)
+            return false;
+        stop(stop_reason_t::timeout);
+        return true;
+    }
+
+    // the id filter of this kind, nullptr without one
+    const id_set_t* id_filter(entity_kind_t kind) const
+    {
+        const id_set_t& ids = id_filters[kind >> 1];
+        return ids.empty() ? nullptr : &ids;
+    }
+};
+
+// retain_batch for the batch a PBF or XML decoder is handing to a handler on this thread, empty between handlers
+batch_handle_t retain_pbf_batch();
+batch_handle_t retain_xml_batch();
+
+// the reader whose read runs on this thread: the calling thread and the workers of a read
+extern thread_local reader_state_t* current_reader;
+
+// points current_reader to a reader for the scope, reads started from a handler restore the outer one
+struct current_reader_scope_t
+{
+    reader_state_t* outer = current_reader;
+    explicit current_reader_scope_t(reader_state_t* reader) { current_reader = reader; }
+    ~current_reader_scope_t() { current_reader = outer; }
+    current_reader_scope_t(const current_reader_scope_t&) = delete;
+    current_reader_scope_t& operator=(const current_reader_scope_t&) = delete;
+};
+
+} // namespace input_osm
+
+#endif // _READER_H_
@@ -0,0 +1,204 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "spatialfilter.h"
+
+#include "reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define INPUTOSM_SPATIAL_X86
+#include <immintrin.h>
+#endif
+
+namespace input_osm
+{
+
+namespace
+{
+
+// even-odd rule over all rings; the products stay within int64 for points inside the bounding box of the rings
+bool in_rings(const std::vector<std::vector<spatial_filter_t::point_t>>& rings,
+              int64_t latitude,
+              int64_t longitude) noexcept
+{
+    bool inside = false;
+    for (const auto& ring : rings)
+    {
+        for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+        {
+            const auto& a = ring[i];
+            const auto& b = ring[j];
+            if ((a.latitude > latitude) == (b.latitude > latitude)) continue;
+            // is the point west of where the edge crosses its parallel, compared without division
+            const int64_t delta_latitude = b.latitude - a.latitude;
+            const int64_t lhs = (longitude - a.longitude) * delta_latitude;
+            const int64_t rhs = (latitude - a.latitude) * (b.longitude - a.longitude);
+            if (delta_latitude > 0 ? lhs < rhs : lhs > rhs) inside = !inside;
+        }
+    }
+    return inside;
+}
+
+size_t mark_in_box_scalar(const spatial_filter_t& filter,
+                          const int64_t* latitude,
+                          const int64_t* longitude,
+                          size_t count,
+                          uint8_t* inside) noexcept
+{
+    size_t result = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        inside[i] = (latitude[i] >= filter.min_latitude) & (latitude[i] <= filter.max_latitude) &
+                    (longitude[i] >= filter.min_longitude) & (longitude[i] <= filter.max_longitude);
+        result += inside[i];
+    }
+    return result;
+}
+
+#ifdef INPUTOSM_SPATIAL_X86
+
+// four points per step, the scalar kernel finishes the tail
+__attribute__((target("avx2"))) size_t mark_in_box_avx2(const spatial_filter_t& filter,
+                                                          const int64_t* latitude,
+                                                          const int64_t* longitude,
+                                                          size_t count,
+                                                          uint8_t* inside) noexcept
+{
+    const __m256i min_latitude = _mm256_set1_epi64x(filter.min_latitude);
+    const __m256i max_latitude = _mm256_set1_epi64x(filter.max_latitude);
+    const __m256i min_longitude = _mm256_set1_epi64x(filter.min_longitude);
+    const __m256i max_longitude = _mm256_set1_epi64x(filter.max_longitude);
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i lat = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(latitude + i));
+        const __m256i lon = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(longitude + i));
+        const __m256i outside = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi64(min_latitude, lat), _mm256_cmpgt_epi64(lat, max_latitude)),
+            _mm256_or_si256(_mm256_cmpgt_epi64(min_longitude, lon), _mm256_cmpgt_epi64(lon, max_longitude)));
+        const unsigned mask = ~static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(outside))) & 0xf;
+        // spread the four mask bits to four bytes, bit k lands on bit 8k
+        const uint32_t bytes = (mask * 0x00204081u) & 0x01010101u;
+        memcpy(inside + i, &bytes, sizeof(bytes));
+        result += __builtin_popcount(mask);
+    }
+    return result + mark_in_box_scalar(filter, latitude + i, longitude + i, count - i, inside + i);
+}
+
+#endif
+
+using mark_in_box_t = size_t (*)(const spatial_filter_t&, const int64_t*, const int64_t*, size_t, uint8_t*) noexcept;
+
+mark_in_box_t mark_in_box() noexcept
+{
+    static const mark_in_box_t kernel = []() -> mark_in_box_t {
+#ifdef INPUTOSM_SPATIAL_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return mark_in_box_avx2;
+#endif
+        return mark_in_box_scalar;
+    }();
+    return kernel;
+}
+
+} // namespace
+
+spatial_filter_t spatial_filter_t::box(int64_t min_latitude,
+                                       int64_t min_longitude,
+                                       int64_t max_latitude,
+                                       int64_t max_longitude)
+{
+    spatial_filter_t filter;
+    filter.bounded = true;
+    filter.min_latitude = min_latitude;
+    filter.min_longitude = min_longitude;
+    filter.max_latitude = max_latitude;
+    filter.max_longitude = max_longitude;
+    return filter;
+}
+
+spatial_filter_t spatial_filter_t::polygon(std::vector<std::vector<point_t>> rings)
+{
+    // without points the box is empty
+    spatial_filter_t filter = box(std::numeric_limits<int64_t>::max(),
+                                  std::numeric_limits<int64_t>::max(),
+                                  std::numeric_limits<int64_t>::min(),
+                                  std::numeric_limits<int64_t>::min());
+    rings.erase(std::remove_if(rings.begin(), rings.end(), [](const auto& ring) { return ring.empty(); }),
+                rings.end());
+    for (const auto& ring : rings)
+    {
+        for (const auto& point : ring)
+        {
+            filter.min_latitude = std::min(filter.min_latitude, point.latitude);
+            filter.min_longitude = std::min(filter.min_longitude, point.longitude);
+            filter.max_latitude = std::max(filter.max_latitude, point.latitude);
+            filter.max_longitude = std::max(filter.max_longitude, point.longitude);
+        }
+    }
+    filter.rings = std::move(rings);
+    return filter;
+}
+
+bool spatial_filter_t::contains(int64_t raw_latitude, int64_t raw_longitude) const
+{
+    if (!bounded) return true;
+    if (raw_latitude < min_latitude || raw_latitude > max_latitude || raw_longitude < min_longitude ||
+        raw_longitude > max_longitude)
+        return false;
+    return rings.empty() || in_rings(rings, raw_latitude, raw_longitude);
+}
+
+bool spatial_filter_t::intersects(const block_summary_t& summary) const
+{
+    if (!bounded) return true;
+    if (!(summary.kinds & BLOCK_HAS_NODES)) return false;
+    // one unit of slack, the summary bounds are rounded toward zero for non default granularities
+    return int64_t{summary.min_latitude} - 1 <= max_latitude && int64_t{summary.max_latitude} + 1 >= min_latitude &&
+           int64_t{summary.min_longitude} - 1 <= max_longitude && int64_t{summary.max_longitude} + 1 >= min_longitude;
+}
+
+void reader_t::set_spatial_filter(spatial_filter_t filter)
+{
+    state->spatial_filter = std::move(filter);
+}
+
+void set_spatial_filter(spatial_filter_t filter)
+{
+    default_reader().set_spatial_filter(std::move(filter));
+}
+
+size_t mark_inside(const spatial_filter_t& filter,
+                   const int64_t* latitude,
+                   const int64_t* longitude,
+                   size_t count,
+                   uint8_t* inside) noexcept
+{
+    size_t result = mark_in_box()(filter, latitude, longitude, count, inside);
+    if (filter.rings.empty() || !result) return result;
+    result = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!inside[i]) continue;
+        inside[i] = in_rings(filter.rings, latitude[i], longitude[i]);
+        result += inside[i];
+    }
+    return result;
+}
+
+} // namespace input_osm
@@ -0,0 +1,39 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SPATIALFILTER_H_
+#define _SPATIALFILTER_H_
+
+#include <inputosm/inputosm.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace input_osm
+{
+
+/**
+ * @brief Test a batch of coordinates against a non-empty spatial filter
+ * @details Sets inside[i] to 1 if point i is inside, else to 0. The box is tested for all points at once with the
+ * widest compares this CPU supports, the rings only for the points inside the box.
+ * @return the number of points inside
+ */
+size_t mark_inside(const spatial_filter_t& filter,
+                   const int64_t* latitude,
+                   const int64_t* longitude,
+                   size_t count,
+                   uint8_t* inside) noexcept;
+
+} // namespace input_osm
+
+#endif // _SPATIALFILTER_H_
@@ -0,0 +1,80 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace input_osm
+{
+
+/**
+ * @brief Bounded lock-free ring with one producer and one consumer thread
+ * @details The consumer reads the front item in place and pops it once done with it, so the producer knows when an
+ * item is released. head is written by the producer only, tail by the consumer only; each sits on its own cache line.
+ */
+template <typename T, size_t Capacity>
+struct spsc_ring_t
+{
+    static_assert(Capacity > 0);
+
+    std::array<T, Capacity> items;
+    alignas(64) std::atomic<size_t> head{0}; // items pushed
+    alignas(64) std::atomic<size_t> tail{0}; // items popped
+
+    // producer: false if the ring is full
+    bool try_push(const T& item)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+        items[h % Capacity] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    // producer: block until try_push can succeed
+    void wait_not_full()
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        for (size_t t = tail.load(std::memory_order_acquire); h - t == Capacity;
+             t = tail.load(std::memory_order_acquire))
+            tail.wait(t, std::memory_order_acquire);
+    }
+    // producer: block until the consumer popped every pushed item
+    void wait_drained()
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        for (size_t t = tail.load(std::memory_order_acquire); t != h; t = tail.load(std::memory_order_acquire))
+            tail.wait(t, std::memory_order_acquire);
+    }
+    // consumer: the oldest item, nullptr if the ring is empty
+    T* front()
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        return head.load(std::memory_order_acquire) == t ? nullptr : &items[t % Capacity];
+    }
+    // consumer: number of items pushed and not popped yet
+    size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed); }
+    // consumer: release the front item
+    void pop()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        tail.notify_one();
+    }
+};
+
+} // namespace input_osm
+
+#endif // _SPSCRING_H_
@@ -0,0 +1,203 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tagfilter.h"
+
+#include "inputosmlog.h"
+#include "reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace input_osm
+{
+
+namespace
+{
+// append the terms and program of src to dst, an empty src accepts everything
+void append(tag_filter_t& dst, const tag_filter_t& src)
+{
+    const uint32_t offset = static_cast<uint32_t>(dst.terms.size());
+    dst.terms.insert(dst.terms.end(), src.terms.begin(), src.terms.end());
+    if (src.program.empty()) dst.program.push_back(tag_filter_t::OP_TRUE);
+    for (uint32_t op : src.program) dst.program.push_back(op < tag_filter_t::OP_TRUE ? op + offset : op);
+}
+
+tag_filter_t combine(std::vector<tag_filter_t>& filters, tag_filter_t::op_t op)
+{
+    tag_filter_t result;
+    for (size_t i = 0; i < filters.size(); i++)
+    {
+        append(result, filters[i]);
+        if (i) result.program.push_back(op);
+    }
+    return result;
+}
+
+std::string_view view(const char* data, uint32_t length)
+{
+    // tags built by hand may leave the length 0
+    if (!data) return {};
+    return length ? std::string_view(data, length) : std::string_view(data);
+}
+} // namespace
+
+tag_filter_t tag_filter_t::has_key(std::string key)
+{
+    return key_in(std::move(key), {});
+}
+
+tag_filter_t tag_filter_t::key_value(std::string key, std::string value)
+{
+    return key_in(std::move(key), {std::move(value)});
+}
+
+tag_filter_t tag_filter_t::key_in(std::string key, std::vector<std::string> values)
+{
+    tag_filter_t filter;
+    filter.terms.push_back(term_t{std::move(key), std::move(values)});
+    filter.program.push_back(0);
+    return filter;
+}
+
+tag_filter_t tag_filter_t::all_of(std::vector<tag_filter_t> filters)
+{
+    return combine(filters, OP_AND);
+}
+
+tag_filter_t tag_filter_t::any_of(std::vector<tag_filter_t> filters)
+{
+    if (filters.empty()) return !tag_filter_t();
+    return combine(filters, OP_OR);
+}
+
+tag_filter_t tag_filter_t::operator!() const
+{
+    tag_filter_t filter;
+    append(filter, *this);
+    filter.program.push_back(OP_NOT);
+    return filter;
+}
+
+bool tag_filter_t::valid() const
+{
+    if (terms.size() > 64) return false;
+    size_t depth = 0;
+    for (uint32_t op : program)
+    {
+        switch (op)
+        {
+            case OP_NOT:
+                if (!depth) return false;
+                break;
+            case OP_AND:
+            case OP_OR:
+                if (depth < 2) return false;
+                depth--;
+                break;
+            default:
+                if (op != OP_TRUE && op >= terms.size()) return false;
+                if (++depth > 64) return false;
+        }
+    }
+    return program.empty() || depth == 1;
+}
+
+bool tag_filter_t::evaluate(uint64_t matched_terms) const
+{
+    if (program.empty()) return true;
+    bool stack[64];
+    size_t depth = 0;
+    for (uint32_t op : program)
+    {
+        switch (op)
+        {
+            case OP_TRUE:
+                stack[depth++] = true;
+                break;
+            case OP_NOT:
+                stack[depth - 1] = !stack[depth - 1];
+                break;
+            case OP_AND:
+                depth--;
+                stack[depth - 1] = stack[depth - 1] && stack[depth];
+                break;
+            case OP_OR:
+                depth--;
+                stack[depth - 1] = stack[depth - 1] || stack[depth];
+                break;
+            default:
+                stack[depth++] = (matched_terms >> op) & 1;
+        }
+    }
+    return stack[0];
+}
+
+bool tag_filter_t::matches(span_t<tag_t> tags) const
+{
+    if (!valid()) return false;
+    uint64_t matched_terms = 0;
+    for (size_t i = 0; i < terms.size(); i++)
+    {
+        for (const auto& tag : tags)
+        {
+            if (view(tag.key, tag.key_length) != terms[i].key) continue;
+            const std::string_view value = view(tag.value, tag.value_length);
+            if (terms[i].values.empty() ||
+                std::find(terms[i].values.begin(), terms[i].values.end(), value) != terms[i].values.end())
+            {
+                matched_terms |= uint64_t{1} << i;
+                break;
+            }
+        }
+    }
+    return evaluate(matched_terms);
+}
+
+void tag_matcher_t::compile(tag_filter_t new_filter, uint32_t new_entity_kinds)
+{
+    filter = std::move(new_filter);
+    entity_kinds = filter.empty() ? 0 : new_entity_kinds;
+    key_only_terms = 0;
+    std::fill(std::begin(short_lengths), std::end(short_lengths), 0);
+    strings.clear();
+    for (size_t i = 0; i < filter.terms.size(); i++)
+    {
+        const uint64_t bit = uint64_t{1} << i;
+        const auto& term = filter.terms[i];
+        strings[term.key].key |= bit;
+        if (term.values.empty()) key_only_terms |= bit;
+        for (const auto& value : term.values) strings[value].value |= bit;
+    }
+    for (const auto& [string, terms] : strings)
+        if (string.size() < 256) short_lengths[string.size() >> 6] |= uint64_t{1} << (string.size() & 63);
+    accepts_untagged = filter.evaluate(0);
+}
+
+bool reader_t::set_tag_filter(tag_filter_t filter, uint32_t entity_kinds)
+{
+    if (!filter.valid())
+    {
+        IOSM_ERROR("invalid tag filter: more than 64 terms or operands");
+        return false;
+    }
+    state->tag_matcher.compile(std::move(filter), entity_kinds);
+    return true;
+}
+
+bool set_tag_filter(tag_filter_t filter, uint32_t entity_kinds)
+{
+    return default_reader().set_tag_filter(std::move(filter), entity_kinds);
+}
+
+} // namespace input_osm
@@ -0,0 +1,59 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _TAGFILTER_H_
+#define _TAGFILTER_H_
+
+#include <inputosm/inputosm.h>
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+namespace input_osm
+{
+
+/**
+ * @brief The tag filter of set_tag_filter, prepared for matching string table entries
+ * @details strings maps every key and value of the filter terms to the terms that use it, so one lookup per string
+ * table entry is enough. Most strings of a block are ruled out by their length alone.
+ */
+struct tag_matcher_t
+{
+    struct string_terms_t
+    {
+        uint64_t key = 0;   // terms with this key
+        uint64_t value = 0; // terms with this among their values
+    };
+
+    tag_filter_t filter;
+    uint32_t entity_kinds = 0;      // entity_kind_t bits the filter applies to, 0 without filter
+    uint64_t key_only_terms = 0;    // terms without values
+    bool accepts_untagged = true;   // result for an entity none of whose tags matches a term
+    uint64_t short_lengths[4] = {}; // bit n set if a filter string has length n < 256
+    // views into filter.terms
+    std::unordered_map<std::string_view, string_terms_t> strings;
+
+    void compile(tag_filter_t new_filter, uint32_t new_entity_kinds);
+    bool applies(entity_kind_t kind) const { return entity_kinds & kind; }
+    string_terms_t lookup(const char* data, uint32_t length) const
+    {
+        if (length < 256 && !(short_lengths[length >> 6] & (uint64_t{1} << (length & 63)))) return {};
+        const auto it = strings.find(std::string_view(data, length));
+        return it == strings.end() ? string_terms_t{} : it->second;
+    }
+};
+
+} // namespace input_osm
+
+#endif // _TAGFILTER_H_
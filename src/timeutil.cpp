@@ -15,6 +15,7 @@
 #include <chrono>
 #include <ctime>
 #include <cinttypes>
+#include <cstring>
 
 int64_t now_ms()
 {
@@ -28,8 +29,48 @@ int64_t now_us()
     return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
 }
 
+namespace
+{
+// digits of str[first] .. str[first + count - 1], or -1
+int parse_digits(const char* str, int first, int count)
+{
+    int value = 0;
+    for (int i = first; i < first + count; i++)
+    {
+        if (str[i] < '0' || str[i] > '9') return -1;
+        value = value * 10 + (str[i] - '0');
+    }
+    return value;
+}
+
+// days since 1970-01-01 of a proleptic Gregorian date
+int64_t days_from_civil(int64_t year, int64_t month, int64_t day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t year_of_era = year - era * 400;
+    const int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+} // namespace
+
 time_t str_to_timestamp(const char* str)
 {
+    // the canonical form of OSM files, YYYY-MM-DDTHH:MM:SSZ, without strptime and timegm
+    if (strlen(str) == 20 && str[4] == '-' && str[7] == '-' && str[10] == 'T' && str[13] == ':' && str[16] == ':' &&
+        str[19] == 'Z')
+    {
+        const int year = parse_digits(str, 0, 4);
+        const int month = parse_digits(str, 5, 2);
+        const int day = parse_digits(str, 8, 2);
+        const int hour = parse_digits(str, 11, 2);
+        const int minute = parse_digits(str, 14, 2);
+        const int second = parse_digits(str, 17, 2);
+        if (year >= 0 && month >= 1 && month <= 12 && day >= 1 && day <= 31 && hour >= 0 && hour <= 23 &&
+            minute >= 0 && minute <= 59 && second >= 0 && second <= 60)
+            return time_t(days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second);
+    }
     struct tm timeinfo{};
     if (strptime(str, "%FT%TZ", &timeinfo) == nullptr)
     {
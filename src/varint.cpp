@@ -0,0 +1,290 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "varint.h"
+
+#include <cstring>
+#include <initializer_list>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define INPUTOSM_VARINT_X86
+#include <immintrin.h>
+#endif
+
+namespace input_osm
+{
+
+namespace
+{
+
+inline int64_t zigzag_decode(uint64_t value) noexcept
+{
+    return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+// one varint, false if it runs past end
+inline bool read_varint(const uint8_t*& ptr, const uint8_t* end, uint64_t& value) noexcept
+{
+    value = 0;
+    for (unsigned shift = 0; ptr < end && shift < 64; shift += 7)
+    {
+        const uint64_t c = *ptr++;
+        value |= (c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+// the scalar kernels also finish the tail of the SIMD ones
+template <bool delta>
+size_t decode_scalar(const uint8_t* ptr, const uint8_t* end, void* out_begin, size_t count, int64_t previous) noexcept
+{
+    uint64_t value;
+    while (read_varint(ptr, end, value))
+    {
+        if constexpr (delta)
+            static_cast<int64_t*>(out_begin)[count++] = previous += zigzag_decode(value);
+        else
+            static_cast<uint64_t*>(out_begin)[count++] = value;
+    }
+    return count;
+}
+
+size_t decode_uint64_scalar(const uint8_t* ptr, const uint8_t* end, uint64_t* out)
+{
+    return decode_scalar<false>(ptr, end, out, 0, 0);
+}
+
+size_t decode_delta_sint64_scalar(const uint8_t* ptr, const uint8_t* end, int64_t* out)
+{
+    return decode_scalar<true>(ptr, end, out, 0, 0);
+}
+
+#ifdef INPUTOSM_VARINT_X86
+
+inline uint64_t load64(const uint8_t* ptr) noexcept
+{
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    return word;
+}
+
+// 9 and 10 byte varints only occur for negative int64 or huge values, take them one byte at a time
+inline uint64_t read_long_varint(const uint8_t* ptr) noexcept
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 70; shift += 7)
+    {
+        const uint64_t c = *ptr++;
+        value |= (c & 0x7f) << shift;
+        if (!(c & 0x80)) break;
+    }
+    return value;
+}
+
+template <bool delta>
+inline size_t decode_tail(const uint8_t* ptr, const uint8_t* end, void* out, size_t count, int64_t previous) noexcept
+{
+    return decode_scalar<delta>(ptr, end, out, count, delta ? previous : 0);
+}
+
+/*
+ * The delta kernels decode like the plain ones and then undo zigzag and delta coding in registers: after the zigzag
+ * decode, an in-register scan adds each lane to the lanes above it by shifting by one and two lanes and adding, and
+ * the running total of the previous values is added to all lanes. The AVX2 kernel scans whole vectors of decoded
+ * values after each window; the SSE4.1 kernel scans its runs of single byte varints and sums up the few values of a
+ * window with longer varints as it reads them.
+ */
+
+// zigzag decodes values[0, count) and replaces them by their running sum after previous, returns the last sum
+__attribute__((target("sse4.1"))) int64_t delta_scan_sse41(uint64_t* values, size_t count, int64_t previous) noexcept
+{
+    const __m128i one = _mm_set1_epi64x(1);
+    __m128i carry = _mm_set1_epi64x(previous);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        x = _mm_xor_si128(_mm_srli_epi64(x, 1), _mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(x, one)));
+        x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi64(x, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), x);
+        carry = _mm_unpackhi_epi64(x, x);
+    }
+    previous = _mm_cvtsi128_si64(carry);
+    for (; i < count; i++) values[i] = static_cast<uint64_t>(previous += zigzag_decode(values[i]));
+    return previous;
+}
+
+__attribute__((target("avx2"))) int64_t delta_scan_avx2(uint64_t* values, size_t count, int64_t previous) noexcept
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi64x(1);
+    __m256i carry = _mm256_set1_epi64x(previous);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        x = _mm256_xor_si256(_mm256_srli_epi64(x, 1), _mm256_sub_epi64(zero, _mm256_and_si256(x, one)));
+        // [a0, a0 + a1, a2, a2 + a3], then lane 1 added to lanes 2 and 3
+        x = _mm256_add_epi64(x, _mm256_slli_si256(x, 8));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 1, 1, 1)), zero, 0x0f));
+        x = _mm256_add_epi64(x, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), x);
+        carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    previous = _mm256_extract_epi64(carry, 0);
+    for (; i < count; i++) values[i] = static_cast<uint64_t>(previous += zigzag_decode(values[i]));
+    return previous;
+}
+
+/*
+ * Both kernels load a window and get the terminator bit of every byte with one movemask. A window without
+ * continuation bits is a run of single byte varints and is widened in bulk. Otherwise the AVX2 kernel decodes each
+ * varint ending in the window with one unaligned 8 byte load and pext, without a per byte branch; it needs 8
+ * readable bytes past the window for that load. The rest is left to the scalar kernel.
+ */
+
+template <bool delta>
+__attribute__((target("sse4.1"))) size_t decode_sse41(const uint8_t* ptr, const uint8_t* end, void* out) noexcept
+{
+    uint64_t* values = static_cast<uint64_t*>(out);
+    size_t count = 0;
+    int64_t previous = 0;
+    while (end - ptr >= 16)
+    {
+        const size_t window_begin = count;
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        const unsigned continuation = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+        if (!continuation)
+        {
+            // 16 single byte varints
+            for (unsigned i = 0; i < 16; i += 2)
+            {
+                uint16_t pair;
+                memcpy(&pair, ptr + i, sizeof(pair));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(values + count + i),
+                                 _mm_cvtepu8_epi64(_mm_cvtsi32_si128(pair)));
+            }
+            count += 16;
+            ptr += 16;
+            if constexpr (delta) previous = delta_scan_sse41(values + window_begin, 16, previous);
+            continue;
+        }
+        // without pext, bit compaction costs more than it saves; decode this window one varint at a time, and sum up
+        // the few values as they come
+        const uint8_t* window_end = ptr + 16;
+        uint64_t value;
+        while (ptr < window_end && read_varint(ptr, end, value))
+        {
+            if constexpr (delta)
+                values[count++] = static_cast<uint64_t>(previous += zigzag_decode(value));
+            else
+                values[count++] = value;
+        }
+    }
+    return decode_tail<delta>(ptr, end, out, count, previous);
+}
+
+template <bool delta>
+__attribute__((target("avx2,bmi2"))) size_t decode_avx2(const uint8_t* ptr, const uint8_t* end, void* out) noexcept
+{
+    uint64_t* values = static_cast<uint64_t*>(out);
+    size_t count = 0;
+    size_t scanned = 0; // values summed up so far, the delta kernel's
+    int64_t previous = 0;
+    while (end - ptr >= 32 + 8)
+    {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+        const uint32_t continuation = static_cast<uint32_t>(_mm256_movemask_epi8(bytes));
+        if (!continuation)
+        {
+            // 32 single byte varints
+            for (unsigned i = 0; i < 32; i += 4)
+            {
+                uint32_t quad;
+                memcpy(&quad, ptr + i, sizeof(quad));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + count + i),
+                                    _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(static_cast<int>(quad))));
+            }
+            count += 32;
+            ptr += 32;
+        }
+        else
+        {
+            uint64_t stops = ~uint64_t(continuation) & 0xffffffffu;
+            unsigned consumed = 0;
+            while (stops)
+            {
+                const unsigned last = static_cast<unsigned>(__builtin_ctzll(stops));
+                const unsigned length = last + 1 - consumed;
+                values[count++] = length <= 8 ? _pext_u64(load64(ptr + consumed),
+                                                          0x7f7f7f7f7f7f7f7fULL >> (64 - 8 * length))
+                                              : read_long_varint(ptr + consumed);
+                consumed = last + 1;
+                stops &= stops - 1;
+            }
+            if (!consumed) break;
+            ptr += consumed;
+        }
+        if constexpr (delta)
+        {
+            // whole vectors only, the rest waits for the next window
+            const size_t scan = (count - scanned) & ~size_t(3);
+            previous = delta_scan_avx2(values + scanned, scan, previous);
+            scanned += scan;
+        }
+    }
+    if constexpr (delta) previous = delta_scan_avx2(values + scanned, count - scanned, previous);
+    return decode_tail<delta>(ptr, end, out, count, previous);
+}
+
+const varint_kernels_t sse41_kernels{
+    "sse4.1",
+    [](const uint8_t* ptr, const uint8_t* end, uint64_t* out) { return decode_sse41<false>(ptr, end, out); },
+    [](const uint8_t* ptr, const uint8_t* end, int64_t* out) { return decode_sse41<true>(ptr, end, out); }};
+
+const varint_kernels_t avx2_kernels{
+    "avx2",
+    [](const uint8_t* ptr, const uint8_t* end, uint64_t* out) { return decode_avx2<false>(ptr, end, out); },
+    [](const uint8_t* ptr, const uint8_t* end, int64_t* out) { return decode_avx2<true>(ptr, end, out); }};
+
+#endif
+
+} // namespace
+
+const varint_kernels_t varint_scalar_kernels{"scalar", decode_uint64_scalar, decode_delta_sint64_scalar};
+
+const varint_kernels_t* find_varint_kernels(const char* name) noexcept
+{
+    if (!strcmp(name, varint_scalar_kernels.name)) return &varint_scalar_kernels;
+#ifdef INPUTOSM_VARINT_X86
+    __builtin_cpu_init();
+    if (!strcmp(name, sse41_kernels.name) && __builtin_cpu_supports("sse4.1")) return &sse41_kernels;
+    if (!strcmp(name, avx2_kernels.name) && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+        return &avx2_kernels;
+#endif
+    return nullptr;
+}
+
+const varint_kernels_t& varint_kernels() noexcept
+{
+    static const varint_kernels_t& kernels = []() -> const varint_kernels_t& {
+        for (const char* name : {"avx2", "sse4.1"})
+            if (const varint_kernels_t* found = find_varint_kernels(name)) return *found;
+        return varint_scalar_kernels;
+    }();
+    return kernels;
+}
+
+} // namespace input_osm
@@ -0,0 +1,60 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _VARINT_H_
+#define _VARINT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace input_osm
+{
+
+/**
+ * @brief Bulk decoders for packed protobuf varint fields
+ * @details Every kernel decodes the whole range [ptr, end) into out, which must have room for end - ptr values
+ * (a varint is at least one byte). They return the number of values written. A varint cut off by end is dropped.
+ * The delta kernels undo zigzag encoding and delta coding, so out receives the absolute values.
+ * The SIMD kernels widen runs of single byte varints in bulk. The AVX2 kernel also finds all varint boundaries of
+ * a 32 byte window at once and extracts each value with pext instead of testing one byte at a time. Their delta
+ * kernels zigzag decode and prefix sum the decoded values in registers, two or four lanes at a time.
+ */
+struct varint_kernels_t
+{
+    const char* name;
+    size_t (*decode_uint64)(const uint8_t* ptr, const uint8_t* end, uint64_t* out);
+    size_t (*decode_delta_sint64)(const uint8_t* ptr, const uint8_t* end, int64_t* out);
+};
+
+// one byte at a time, available everywhere
+extern const varint_kernels_t varint_scalar_kernels;
+
+// the fastest kernels this CPU supports, picked once
+const varint_kernels_t& varint_kernels() noexcept;
+
+// kernels with the given name ("scalar", "sse4.1", "avx2") if this CPU supports them, else nullptr
+const varint_kernels_t* find_varint_kernels(const char* name) noexcept;
+
+inline size_t decode_packed_uint64(const uint8_t* ptr, const uint8_t* end, uint64_t* out) noexcept
+{
+    return varint_kernels().decode_uint64(ptr, end, out);
+}
+
+inline size_t decode_packed_delta_sint64(const uint8_t* ptr, const uint8_t* end, int64_t* out) noexcept
+{
+    return varint_kernels().decode_delta_sint64(ptr, end, out);
+}
+
+} // namespace input_osm
+
+#endif // _VARINT_H_
@@ -0,0 +1,96 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "workerpool.h"
+
+#include "inputosmlog.h"
+
+namespace input_osm
+{
+
+worker_pool_t::~worker_pool_t()
+{
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        stopping = true;
+        for (auto& w : workers) w->cv_job.notify_one();
+    }
+    for (auto& w : workers)
+    {
+        if (w->thread.joinable()) w->thread.join();
+    }
+}
+
+void worker_pool_t::start(run_t& run, size_t count, const std::function<void(size_t)>& job)
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    run.remaining = count;
+    size_t index = 0;
+    // idle threads first
+    for (auto& w : workers)
+    {
+        if (index == count) break;
+        if (w->job) continue;
+        w->job = &job;
+        w->index = index++;
+        w->run = &run;
+        w->cv_job.notify_one();
+    }
+    // then grow
+    for (; index < count; index++)
+    {
+        auto& w = workers.emplace_back(std::make_unique<worker_t>());
+        w->job = &job;
+        w->index = index;
+        w->run = &run;
+        w->thread = std::thread(&worker_pool_t::loop, this, std::ref(*w));
+        IOSM_TRACE("worker pool grew to %zu threads", workers.size());
+    }
+}
+
+void worker_pool_t::wait(run_t& run)
+{
+    std::unique_lock<std::mutex> lck(mtx);
+    run.cv_done.wait(lck, [&run] { return !run.remaining; });
+}
+
+size_t worker_pool_t::size()
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    return workers.size();
+}
+
+void worker_pool_t::loop(worker_t& worker)
+{
+    std::unique_lock<std::mutex> lck(mtx);
+    while (true)
+    {
+        worker.cv_job.wait(lck, [this, &worker] { return worker.job || stopping; });
+        if (!worker.job) return;
+        const auto* job = worker.job;
+        const size_t index = worker.index;
+        lck.unlock();
+        (*job)(index);
+        lck.lock();
+        worker.job = nullptr;
+        if (!--worker.run->remaining) worker.run->cv_done.notify_all();
+    }
+}
+
+worker_pool_t& worker_pool()
+{
+    static worker_pool_t pool;
+    return pool;
+}
+
+} // namespace input_osm
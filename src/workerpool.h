@@ -0,0 +1,83 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace input_osm
+{
+
+/**
+ * @brief Long-lived worker threads reused across input_file calls
+ * @details Threads are created on first use and only when more are needed than are idle, then they park until the
+ * next run. Their thread_local decode buffers stay allocated and warm between runs.
+ */
+class worker_pool_t
+{
+public:
+    // one job running on some of the pool threads
+    struct run_t
+    {
+        size_t remaining = 0;
+        std::condition_variable cv_done;
+    };
+
+    worker_pool_t() = default;
+    worker_pool_t(const worker_pool_t&) = delete;
+    worker_pool_t& operator=(const worker_pool_t&) = delete;
+    ~worker_pool_t();
+
+    /**
+     * @brief Start job(index) for index in [0, count) on `count` pool threads
+     * @note job and run must stay alive until wait(run) returns; may be called concurrently, each run gets its own
+     * threads
+     */
+    void start(run_t& run, size_t count, const std::function<void(size_t)>& job);
+
+    // wait for all the threads of the run to finish the job
+    void wait(run_t& run);
+
+    // number of threads created so far
+    size_t size();
+
+private:
+    struct worker_t
+    {
+        std::thread thread;
+        std::condition_variable cv_job;
+        const std::function<void(size_t)>* job = nullptr;
+        size_t index = 0;
+        run_t* run = nullptr;
+    };
+
+    void loop(worker_t& worker);
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<worker_t>> workers;
+    bool stopping = false;
+};
+
+// process wide pool used by input_file
+worker_pool_t& worker_pool();
+
+} // namespace input_osm
+
+#endif // _WORKERPOOL_H_
@@ -11,15 +11,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "counter.h"
-
 #include <inputosm/inputosm.h>
 
 #include <iostream>
 #include <cstdint>
-#include <numeric>
-#include <vector>
-#include <span>
 
 int main(int argc, char** argv)
 {
@@ -32,45 +27,53 @@ int main(int argc, char** argv)
     std::cout << path << "\n";
     bool read_metadata = (argc >= 3);
     if (read_metadata) std::cout << "reading metadata\n";
+    // counting needs the ids only, unless the full decode is measured
+    if (!read_metadata) input_osm::set_projection(input_osm::ENTITY_ALL, input_osm::PROJECT_ID);
     input_osm::set_max_thread_count();
 
-    const size_t actual_thread_count = input_osm::thread_count();
-
-    std::cout << "running on " << actual_thread_count << " threads\n";
-
-    // do a single allocation
-    std::vector<input_osm::Counter<uint64_t>> all_counters(3 * actual_thread_count);
+    std::cout << "running on " << input_osm::thread_count() << " threads\n";
 
-    // use spans to split counters for each entity
-    std::span<input_osm::Counter<uint64_t>> node_count(all_counters.data(), actual_thread_count);
-    std::span<input_osm::Counter<uint64_t>> way_count(all_counters.data() + actual_thread_count, actual_thread_count);
-    std::span<input_osm::Counter<uint64_t>> relation_count(all_counters.data() + 2 * actual_thread_count,
-                                                           actual_thread_count);
-
-    if (!input_osm::input_file(
-            path,
-            read_metadata,
-            [&node_count](input_osm::span_t<input_osm::node_t> node_list) -> bool {
-                node_count[input_osm::thread_index] += node_list.size();
-                return true;
-            },
-            [&way_count](input_osm::span_t<input_osm::way_t> way_list) -> bool {
-                way_count[input_osm::thread_index] += way_list.size();
-                return true;
+    // every worker counts into its own state, the states are summed once the read is over
+    struct counts_t
+    {
+        uint64_t nodes = 0;
+        uint64_t ways = 0;
+        uint64_t relations = 0;
+    };
+    input_osm::reduction_t<counts_t> reduction{
+        .node_handler = [](counts_t& counts, input_osm::span_t<input_osm::node_t> node_list) -> bool {
+            counts.nodes += node_list.size();
+            return true;
+        },
+        .way_handler = [](counts_t& counts, input_osm::span_t<input_osm::way_t> way_list) -> bool {
+            counts.ways += way_list.size();
+            return true;
+        },
+        .relation_handler = [](counts_t& counts, input_osm::span_t<input_osm::relation_t> relation_list) -> bool {
+            counts.relations += relation_list.size();
+            return true;
+        },
+        .merge =
+            [](counts_t& total, counts_t& counts) {
+                total.nodes += counts.nodes;
+                total.ways += counts.ways;
+                total.relations += counts.relations;
             },
-            [&relation_count](input_osm::span_t<input_osm::relation_t> relation_list) -> bool {
-                relation_count[input_osm::thread_index] += relation_list.size();
-                return true;
-            }))
+    };
+    counts_t total;
+    if (!input_osm::input_file_reduce(path, read_metadata, reduction, total))
     {
         std::cerr << "Error while processing pbf\n";
         return EXIT_FAILURE;
     }
 
     std::cout.imbue(std::locale(""));
-    std::cout << "nodes: " << std::accumulate(node_count.begin(), node_count.end(), 0LLU) << "\n";
-    std::cout << "ways: " << std::accumulate(way_count.begin(), way_count.end(), 0LLU) << "\n";
-    std::cout << "relations: " << std::accumulate(relation_count.begin(), relation_count.end(), 0LLU) << "\n";
+    std::cout << "nodes: " << total.nodes << "\n";
+    std::cout << "ways: " << total.ways << "\n";
+    std::cout << "relations: " << total.relations << "\n";
+    const auto statistics = input_osm::decode_statistics();
+    std::cout << "blocks: " << statistics.blocks << " groups: " << statistics.groups
+              << " buffer grows: " << statistics.buffer_grows << "\n";
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,319 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inputosm/inputosm.h>
+
+#include "decompress.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef INPUTOSM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef INPUTOSM_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace
+{
+struct blob_t
+{
+    input_osm::blob_compression_t compression = input_osm::blob_compression_t::raw;
+    const uint8_t* zip_ptr = nullptr;
+    size_t zip_size = 0;
+    size_t raw_size = 0;
+};
+
+uint64_t read_varint(const uint8_t*& ptr, const uint8_t* end)
+{
+    uint64_t value = 0;
+    for (int shift = 0; ptr < end && shift < 64; shift += 7)
+    {
+        const uint8_t byte = *ptr++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return value;
+}
+
+// visit the fields of a message, only varint and length delimited wire types occur in blob headers and blobs
+template <typename Handler>
+bool iterate_fields(const uint8_t* ptr, const uint8_t* end, Handler&& handler)
+{
+    while (ptr < end)
+    {
+        const uint64_t key = read_varint(ptr, end);
+        const uint64_t value = read_varint(ptr, end);
+        if ((key & 7) == 2)
+        {
+            if (value > uint64_t(end - ptr)) return false;
+            handler(key >> 3, value, ptr);
+            ptr += value;
+        }
+        else if ((key & 7) == 0)
+            handler(key >> 3, value, nullptr);
+        else
+            return false;
+    }
+    return true;
+}
+
+// compressed blobs of the file
+bool collect_blobs(const std::vector<uint8_t>& file, std::vector<blob_t>& blobs)
+{
+    const uint8_t* ptr = file.data();
+    const uint8_t* end = ptr + file.size();
+    while (end - ptr >= 4)
+    {
+        const uint32_t header_size = uint32_t(ptr[0]) << 24 | uint32_t(ptr[1]) << 16 | uint32_t(ptr[2]) << 8 | ptr[3];
+        ptr += 4;
+        if (header_size > uint64_t(end - ptr)) return false;
+        uint64_t blob_size = 0;
+        if (!iterate_fields(ptr, ptr + header_size, [&blob_size](uint64_t field, uint64_t value, const uint8_t*) {
+                if (field == 3) blob_size = value;
+            }))
+            return false;
+        ptr += header_size;
+        if (blob_size > uint64_t(end - ptr)) return false;
+        blob_t blob;
+        if (!iterate_fields(ptr, ptr + blob_size, [&blob](uint64_t field, uint64_t value, const uint8_t* data) {
+                if (field == 2) blob.raw_size = value;
+                if (field >= 3 && field <= 7)
+                {
+                    blob.compression = static_cast<input_osm::blob_compression_t>(field);
+                    blob.zip_ptr = data;
+                    blob.zip_size = value;
+                }
+            }))
+            return false;
+        if (blob.zip_ptr && blob.raw_size) blobs.push_back(blob);
+        ptr += blob_size;
+    }
+    return true;
+}
+
+const char* name(input_osm::decompressor_t decompressor)
+{
+    switch (decompressor)
+    {
+        case input_osm::decompressor_t::zlib:
+            return "zlib";
+        case input_osm::decompressor_t::zlib_ng:
+            return "zlib-ng";
+        case input_osm::decompressor_t::libdeflate:
+            return "libdeflate";
+        case input_osm::decompressor_t::isal:
+            return "isa-l";
+    }
+    return "?";
+}
+
+// blobs of one compression, with the storage of the recompressed ones
+struct fixture_t
+{
+    std::string label;
+    std::vector<blob_t> blobs;
+    std::vector<std::vector<uint8_t>> storage;
+};
+
+#if defined(INPUTOSM_HAVE_ZSTD) || defined(INPUTOSM_HAVE_LZ4)
+// inflate the zlib blobs and compress them again with another codec
+template <typename Compress>
+fixture_t recompress(const std::string& label,
+                     input_osm::blob_compression_t compression,
+                     const std::vector<blob_t>& zlib_blobs,
+                     Compress&& compress)
+{
+    fixture_t fixture{label, {}, {}};
+    std::vector<uint8_t> raw;
+    for (const auto& blob : zlib_blobs)
+    {
+        raw.resize(blob.raw_size);
+        if (!input_osm::inflate_zlib(
+                input_osm::decompressor_t::zlib, blob.zip_ptr, blob.zip_size, raw.data(), raw.size()))
+            continue;
+        auto& zipped = fixture.storage.emplace_back();
+        if (!compress(raw, zipped)) return {};
+        fixture.blobs.push_back({compression, zipped.data(), zipped.size(), raw.size()});
+    }
+    return fixture;
+}
+#endif
+
+// best wall time of inflating all blobs, split round robin over the threads
+template <typename Decompress>
+double measure(const std::vector<blob_t>& blobs, size_t threads, int repetitions, Decompress&& decompress)
+{
+    size_t raw_max = 0;
+    for (const auto& blob : blobs) raw_max = std::max(raw_max, blob.raw_size);
+    double best = 0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        std::vector<std::thread> workers;
+        std::vector<char> results(threads, 1);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t]() {
+                std::vector<uint8_t> raw(raw_max);
+                for (size_t i = t; i < blobs.size(); i += threads)
+                    if (!decompress(blobs[i], raw.data())) results[t] = 0;
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!std::all_of(results.begin(), results.end(), [](char result) { return result; })) return -1;
+        if (!r || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+} // namespace
+
+// MB/s of decompressed output, total and per core, for each built in decompressor and blob compression.
+// The zlib blobs are also recompressed in memory with zstd and lz4 when those are built in, so all codecs are
+// compared on the same blocks. Nothing is decoded.
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage " << argv[0] << " <path-to-pbf> [repetitions] [zstd-level]\n";
+        return EXIT_FAILURE;
+    }
+    const int repetitions = argc >= 3 ? std::max(1, atoi(argv[2])) : 3;
+    [[maybe_unused]] const int zstd_level = argc >= 4 ? atoi(argv[3]) : 3;
+    const size_t max_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    std::ifstream in(argv[1], std::ios::binary);
+    const std::vector<uint8_t> file{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    std::vector<blob_t> blobs;
+    if (!in || !collect_blobs(file, blobs) || blobs.empty())
+    {
+        std::cerr << "No compressed blobs found in " << argv[1] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // one fixture per compression found in the file
+    std::vector<fixture_t> fixtures;
+    for (auto compression : {input_osm::blob_compression_t::zlib,
+                             input_osm::blob_compression_t::lz4,
+                             input_osm::blob_compression_t::zstd})
+    {
+        fixture_t fixture{input_osm::blob_compression_name(compression), {}, {}};
+        for (const auto& blob : blobs)
+            if (blob.compression == compression) fixture.blobs.push_back(blob);
+        if (!fixture.blobs.empty() && input_osm::blob_compression_supported(compression))
+            fixtures.push_back(std::move(fixture));
+    }
+    if (!fixtures.empty() && fixtures.front().label == "zlib")
+    {
+        [[maybe_unused]] const auto& zlib_blobs = fixtures.front().blobs;
+#ifdef INPUTOSM_HAVE_ZSTD
+        fixtures.push_back(recompress("zstd (recompressed)",
+                                      input_osm::blob_compression_t::zstd,
+                                      zlib_blobs,
+                                      [zstd_level](const std::vector<uint8_t>& raw, std::vector<uint8_t>& zipped) {
+                                          zipped.resize(ZSTD_compressBound(raw.size()));
+                                          const size_t size = ZSTD_compress(
+                                              zipped.data(), zipped.size(), raw.data(), raw.size(), zstd_level);
+                                          zipped.resize(size);
+                                          return !ZSTD_isError(size);
+                                      }));
+#endif
+#ifdef INPUTOSM_HAVE_LZ4
+        fixtures.push_back(recompress("lz4 (recompressed)",
+                                      input_osm::blob_compression_t::lz4,
+                                      zlib_blobs,
+                                      [](const std::vector<uint8_t>& raw, std::vector<uint8_t>& zipped) {
+                                          zipped.resize(LZ4_compressBound(static_cast<int>(raw.size())));
+                                          const int size =
+                                              LZ4_compress_default(reinterpret_cast<const char*>(raw.data()),
+                                                                   reinterpret_cast<char*>(zipped.data()),
+                                                                   static_cast<int>(raw.size()),
+                                                                   static_cast<int>(zipped.size()));
+                                          zipped.resize(std::max(size, 0));
+                                          return size > 0;
+                                      }));
+#endif
+    }
+
+    std::vector<size_t> thread_counts;
+    for (size_t t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    std::cout << "| blobs               | decompressor | ratio | threads |   best s |     MB/s | MB/s/core |\n";
+    std::cout << "| ------------------- | ------------ | ----- | ------- | -------- | -------- | --------- |\n";
+    for (const auto& fixture : fixtures)
+    {
+        if (fixture.blobs.empty())
+        {
+            std::cerr << fixture.label << ": recompression failed\n";
+            return EXIT_FAILURE;
+        }
+        uint64_t raw_total = 0;
+        uint64_t zip_total = 0;
+        for (const auto& blob : fixture.blobs)
+        {
+            raw_total += blob.raw_size;
+            zip_total += blob.zip_size;
+        }
+        const auto compression = fixture.blobs.front().compression;
+        std::vector<input_osm::decompressor_t> decompressors{input_osm::decompressor()};
+        if (compression == input_osm::blob_compression_t::zlib)
+        {
+            // every inflate implementation
+            decompressors.clear();
+            for (auto decompressor : {input_osm::decompressor_t::zlib,
+                                      input_osm::decompressor_t::zlib_ng,
+                                      input_osm::decompressor_t::libdeflate,
+                                      input_osm::decompressor_t::isal})
+                if (input_osm::decompressor_available(decompressor)) decompressors.push_back(decompressor);
+        }
+        for (auto decompressor : decompressors)
+        {
+            for (size_t threads : thread_counts)
+            {
+                const double best =
+                    measure(fixture.blobs, threads, repetitions, [decompressor](const blob_t& blob, uint8_t* raw) {
+                        if (blob.compression == input_osm::blob_compression_t::zlib)
+                            return input_osm::inflate_zlib(
+                                decompressor, blob.zip_ptr, blob.zip_size, raw, blob.raw_size);
+                        return input_osm::decompress_blob(
+                            decompressor, blob.compression, blob.zip_ptr, blob.zip_size, raw, blob.raw_size);
+                    });
+                if (best < 0)
+                {
+                    std::cerr << fixture.label << " failed to decompress\n";
+                    return EXIT_FAILURE;
+                }
+                const double mb_per_s = raw_total / best / 1e6;
+                std::cout << "| " << std::setw(19) << std::left << fixture.label << " | " << std::setw(12)
+                          << (compression == input_osm::blob_compression_t::zlib ? name(decompressor) : "-")
+                          << std::right << " | " << std::setw(5) << std::fixed << std::setprecision(2)
+                          << double(raw_total) / zip_total << " | " << std::setw(7) << threads << " | " << std::setw(8)
+                          << std::setprecision(3) << best << " | " << std::setw(8) << std::setprecision(1) << mb_per_s
+                          << " | " << std::setw(9) << mb_per_s / threads << " |\n";
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
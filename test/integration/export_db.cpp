@@ -144,8 +144,8 @@ int main(int argc, char **argv)
                     ::write(fd, &size, sizeof(int16_t));
                     for (auto &tag : n.tags)
                     {
-                        ::write(fd, tag.key, strlen(tag.key) + 1);
-                        ::write(fd, tag.value, strlen(tag.value) + 1);
+                        ::write(fd, tag.key, tag.key_length + 1);
+                        ::write(fd, tag.value, tag.value_length + 1);
                     }
                 }
                 return true;
@@ -163,8 +163,8 @@ int main(int argc, char **argv)
                     ::write(fd, &size, sizeof(int16_t));
                     for (auto &tag : w.tags)
                     {
-                        ::write(fd, tag.key, strlen(tag.key) + 1);
-                        ::write(fd, tag.value, strlen(tag.value) + 1);
+                        ::write(fd, tag.key, tag.key_length + 1);
+                        ::write(fd, tag.value, tag.value_length + 1);
                     }
                 }
                 return true;
@@ -187,8 +187,8 @@ int main(int argc, char **argv)
                     ::write(fd, &size, sizeof(int16_t));
                     for (auto &tag : r.tags)
                     {
-                        ::write(fd, tag.key, strlen(tag.key) + 1);
-                        ::write(fd, tag.value, strlen(tag.value) + 1);
+                        ::write(fd, tag.key, tag.key_length + 1);
+                        ::write(fd, tag.value, tag.value_length + 1);
                     }
                 }
                 return true;
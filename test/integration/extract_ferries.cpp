@@ -17,7 +17,6 @@
 #include <cstdlib>
 #include <numeric>
 #include <map>
-#include <cstring>
 #include <vector>
 
 int main(int argc, char **argv)
@@ -40,6 +39,8 @@ int main(int argc, char **argv)
     };
     std::vector<std::vector<ferry_info>> ferry(input_osm::thread_count());
 
+    // only route=ferry ways reach the handler
+    input_osm::set_tag_filter(input_osm::tag_filter_t::key_value("route", "ferry"), input_osm::ENTITY_WAYS);
     if (!input_osm::input_file(
             path,
             false,
@@ -47,16 +48,10 @@ int main(int argc, char **argv)
             [&ferry_count, &ferry](input_osm::span_t<input_osm::way_t> way_list) -> bool {
                 for (auto &way : way_list)
                 {
-                    for (auto &tag : way.tags)
-                    {
-                        if (strcmp(tag.key, "route") == 0 && strcmp(tag.value, "ferry") == 0)
-                        {
-                            ferry_count[input_osm::thread_index]++;
-                            ferry[input_osm::thread_index].emplace_back(ferry_info{
-                                .way_id = way.id,
-                                .node_id = std::vector<int64_t>(way.node_refs.begin(), way.node_refs.end())});
-                        }
-                    }
+                    ferry_count[input_osm::thread_index]++;
+                    ferry[input_osm::thread_index].emplace_back(
+                        ferry_info{.way_id = way.id,
+                                   .node_id = std::vector<int64_t>(way.node_refs.begin(), way.node_refs.end())});
                 }
                 return true;
             },
@@ -65,6 +60,7 @@ int main(int argc, char **argv)
         printf("Error while processing pbf\n");
         return EXIT_FAILURE;
     }
+    input_osm::set_tag_filter(input_osm::tag_filter_t());
 
     printf("%llu ferries\n", std::accumulate(ferry_count.begin(), ferry_count.end(), 0LLU));
     struct pos
@@ -72,30 +68,24 @@ int main(int argc, char **argv)
         int64_t raw_longitude;
         int64_t raw_latitude;
     };
-    std::map<int64_t, pos> node_coord;
+    std::vector<int64_t> node_ids;
     for (auto &fv : ferry)
-    {
-        for (auto &f : fv)
-        {
-            for (auto &nid : f.node_id)
-            {
-                node_coord[nid] = pos{0, 0};
-            }
-        }
-    }
-    printf("%zu unique nodes used by ferries\n", node_coord.size());
+        for (auto &f : fv) node_ids.insert(node_ids.end(), f.node_id.begin(), f.node_id.end());
+    input_osm::id_set_t ferry_nodes(std::move(node_ids));
+    printf("%zu unique nodes used by ferries\n", ferry_nodes.size());
     printf("retrieving ferry node coordinates...\n");
+
+    // the decoder drops every other node, so the handler only sees the ones to record
+    input_osm::set_id_filter(input_osm::ENTITY_NODES, std::move(ferry_nodes));
+    std::vector<std::map<int64_t, pos>> node_coord(input_osm::thread_count());
     if (!input_osm::input_file(
             path,
             false,
             [&node_coord](input_osm::span_t<input_osm::node_t> node_list) -> bool {
                 for (auto &node : node_list)
                 {
-                    auto it = node_coord.find(node.id);
-                    if (node_coord.end() != it)
-                    {
-                        it->second = {.raw_longitude = node.raw_latitude, .raw_latitude = node.raw_latitude};
-                    }
+                    node_coord[input_osm::thread_index][node.id] = {.raw_longitude = node.raw_longitude,
+                                                                    .raw_latitude = node.raw_latitude};
                 }
                 return true;
             },
@@ -105,6 +95,10 @@ int main(int argc, char **argv)
         printf("Error while processing pbf\n");
         return EXIT_FAILURE;
     }
+    input_osm::set_id_filter(input_osm::ENTITY_NODES, input_osm::id_set_t());
+    size_t resolved = 0;
+    for (auto &coords : node_coord) resolved += coords.size();
+    printf("%zu nodes resolved\n", resolved);
     printf("done.\n");
 
     return EXIT_SUCCESS;
@@ -11,13 +11,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "counter.h"
-
 #include <inputosm/inputosm.h>
 
 #include <iostream>
 #include <iomanip>
+#include <cmath>
 #include <cstdint>
+#include <cstdlib>
 #include <numeric>
 #include <vector>
 
@@ -25,49 +25,46 @@ int main(int argc, char **argv)
 {
     if (argc < 2)
     {
-        std::cerr << "Usage" << argv[0] << "<path-to-pbf>\n";
+        std::cerr << "Usage" << argv[0] << "<path-to-pbf> [min-lat min-lon max-lat max-lon]\n";
         return EXIT_FAILURE;
     }
     const char *path = argv[1];
     std::cout << path << "\n";
+    if (argc >= 6)
+    {
+        // only count the nodes in the box; the block index lets whole blocks outside it be skipped
+        auto raw = [](const char *degrees) { return static_cast<int64_t>(std::llround(std::atof(degrees) * 1e7)); };
+        input_osm::set_spatial_filter(
+            input_osm::spatial_filter_t::box(raw(argv[2]), raw(argv[3]), raw(argv[4]), raw(argv[5])));
+        input_osm::set_use_block_index(true);
+    }
     bool read_metadata = false;
     input_osm::set_max_thread_count();
     std::cout << "running on " << input_osm::thread_count() << " threads\n";
 
-    // single allocation
+    // nodes per latitude degree, counted per worker and summed once the read is over; only the latitude column is
+    // touched
     constexpr unsigned total_lat_degree_values = 91;
-    std::vector<input_osm::u64_64B> node_count_by_lat(total_lat_degree_values * input_osm::thread_count(), 0);
-
-    if (!input_osm::input_file(
-            path,
-            read_metadata,
-            [&node_count_by_lat,
-             actual_thread_count = input_osm::thread_count()](input_osm::span_t<input_osm::node_t> node_list) -> bool {
-                for (auto &n : node_list)
-                {
-                    ++node_count_by_lat[input_osm::thread_index * actual_thread_count + std::abs(n.raw_latitude / 1e7)];
-                }
-                return true;
+    using histogram_t = std::vector<int64_t>;
+    input_osm::reduction_t<histogram_t> reduction{
+        .make_state = [] { return histogram_t(total_lat_degree_values, 0); },
+        .node_columns_handler = [](histogram_t &histogram, const input_osm::node_columns_t &nodes) -> bool {
+            for (int64_t raw_latitude : nodes.raw_latitude) ++histogram[std::abs(raw_latitude / 1e7)];
+            return true;
+        },
+        .merge =
+            [](histogram_t &total, histogram_t &histogram) {
+                for (unsigned degree = 0; degree < total_lat_degree_values; ++degree)
+                    total[degree] += histogram[degree];
             },
-            nullptr,
-            nullptr))
+    };
+    std::vector<int64_t> lats(total_lat_degree_values, 0);
+    if (!input_osm::input_file_reduce(path, read_metadata, reduction, lats))
     {
         std::cerr << "Error while processing pbf\n";
         return EXIT_FAILURE;
     }
-
-    // aggregate
-    std::vector<int64_t> lats(total_lat_degree_values, 0);
-    int64_t sum = 0;
-
-    for (size_t ti = 0; ti < input_osm::thread_count(); ++ti)
-    {
-        for (unsigned int degree = 0; degree < total_lat_degree_values; ++degree)
-        {
-            lats[degree] += node_count_by_lat[ti * total_lat_degree_values + degree];
-            sum += node_count_by_lat[ti * total_lat_degree_values + degree];
-        }
-    }
+    const int64_t sum = std::accumulate(lats.begin(), lats.end(), int64_t{0});
 
     std::cout.imbue(std::locale(""));
     std::cout << "|   degree |      count    |   percent  |\n";
@@ -77,7 +74,7 @@ int main(int argc, char **argv)
     for (size_t i = 0; i < total_lat_degree_values; ++i)
     {
         std::cout << "| " << std::setw(8) << i << " | " << std::setw(13) << lats[i] << " | " << std::setw(9)
-                  << (lats[i] * 100.0 / sum) << "% |\n";
+                  << (sum ? lats[i] * 100.0 / sum : 0.0) << "% |\n";
     }
 
     std::cout << "|   total  | " << std::setw(13) << sum << " |    100.00% |\n";
@@ -0,0 +1,83 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "counter.h"
+
+#include <inputosm/inputosm.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// Entities per second for a list of files, read one input_file call after the other and in a single input_files call.
+// With many small files the first leaves the workers idle at the tail of every file.
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage " << argv[0] << " <file> [<file> ...]\n";
+        return EXIT_FAILURE;
+    }
+    const std::vector<std::string> filenames(argv + 1, argv + argc);
+    constexpr int k_repetitions = 3;
+    input_osm::set_projection(input_osm::ENTITY_ALL, input_osm::PROJECT_ID);
+    input_osm::set_max_thread_count();
+
+    std::vector<input_osm::u64_64B> counts(input_osm::thread_count(), 0);
+    auto count = [&counts](size_t size) {
+        counts[input_osm::thread_index] += size;
+        return true;
+    };
+    auto node_handler = [&count](input_osm::span_t<input_osm::node_t> list) { return count(list.size()); };
+    auto way_handler = [&count](input_osm::span_t<input_osm::way_t> list) { return count(list.size()); };
+    auto relation_handler = [&count](input_osm::span_t<input_osm::relation_t> list) { return count(list.size()); };
+
+    std::cout << filenames.size() << " files, " << input_osm::thread_count() << " threads\n";
+    std::cout << "| mode        |   entities |   best s |  entities/s |\n";
+    std::cout << "| ----------- | ---------- | -------- | ----------- |\n";
+    for (bool single_run : {false, true})
+    {
+        double best = 0;
+        uint64_t entities = 0;
+        for (int r = 0; r < k_repetitions; r++)
+        {
+            std::fill(counts.begin(), counts.end(), 0);
+            auto start = std::chrono::steady_clock::now();
+            bool ok = true;
+            if (single_run)
+                ok = input_osm::input_files(filenames, false, node_handler, way_handler, relation_handler);
+            else
+                for (const auto &filename : filenames)
+                    ok = ok &&
+                         input_osm::input_file(filename.c_str(), false, node_handler, way_handler, relation_handler);
+            if (!ok)
+            {
+                std::cerr << "Error while processing the files\n";
+                return EXIT_FAILURE;
+            }
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!r || elapsed < best) best = elapsed;
+            entities = std::accumulate(counts.begin(), counts.end(), uint64_t{0});
+        }
+        std::cout << "| " << std::setw(11) << std::left << (single_run ? "input_files" : "input_file") << std::right
+                  << " | " << std::setw(10) << entities << " | " << std::setw(8) << std::fixed << std::setprecision(3)
+                  << best << " | " << std::setw(11) << std::setprecision(0) << entities / best << " |\n";
+    }
+    return EXIT_SUCCESS;
+}
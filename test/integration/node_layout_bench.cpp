@@ -0,0 +1,85 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "counter.h"
+
+#include <inputosm/inputosm.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+// Nodes per second for node_t versus compact_node_t.
+// The handlers read every id and coordinate, ways and relations are not requested.
+template <class Node>
+bool run(const char *path, int repetitions, const char *name)
+{
+    std::vector<input_osm::u64_64B> node_count(input_osm::thread_count(), 0);
+    std::vector<input_osm::i64_64B> checksum(input_osm::thread_count(), 0);
+    double best = 0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        std::fill(node_count.begin(), node_count.end(), 0);
+        std::fill(checksum.begin(), checksum.end(), 0);
+        auto start = std::chrono::steady_clock::now();
+        if (!input_osm::input_file_as<Node>(
+                path,
+                false,
+                [&node_count, &checksum](input_osm::span_t<Node> node_list) {
+                    int64_t sum = 0;
+                    for (const auto &n : node_list) sum += n.id + n.raw_latitude + n.raw_longitude;
+                    checksum[input_osm::thread_index] += sum;
+                    node_count[input_osm::thread_index] += node_list.size();
+                    return true;
+                },
+                nullptr,
+                nullptr))
+        {
+            std::cerr << "Error while processing pbf\n";
+            return false;
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!r || elapsed < best) best = elapsed;
+    }
+    const uint64_t nodes = std::accumulate(node_count.begin(), node_count.end(), uint64_t{0});
+    const int64_t sum = std::accumulate(checksum.begin(), checksum.end(), int64_t{0});
+    std::cout << "| " << std::setw(14) << std::left << name << std::right << " | " << std::setw(5) << sizeof(Node)
+              << " | " << std::setw(10) << nodes << " | " << std::setw(8) << std::fixed << std::setprecision(3) << best
+              << " | " << std::setw(10) << std::setprecision(0) << nodes / best << " | " << std::setw(20) << sum
+              << " |\n";
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage " << argv[0] << " <path-to-pbf> [repetitions]\n";
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[1];
+    const int repetitions = argc >= 3 ? std::max(1, atoi(argv[2])) : 3;
+    input_osm::set_verbose(false);
+    input_osm::set_max_thread_count();
+
+    std::cout << "| layout         | bytes |      nodes |   best s |    nodes/s |             checksum |\n";
+    std::cout << "| -------------- | ----- | ---------- | -------- | ---------- | -------------------- |\n";
+    if (!run<input_osm::node_t>(path, repetitions, "node_t")) return EXIT_FAILURE;
+    if (!run<input_osm::compact_node_t>(path, repetitions, "compact_node_t")) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "counter.h"
+
+#include <inputosm/inputosm.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const char *scheduler_name(input_osm::scheduler_t scheduler)
+{
+    switch (scheduler)
+    {
+        case input_osm::scheduler_t::queue:
+            return "queue";
+        case input_osm::scheduler_t::work_stealing:
+            return "work_stealing";
+        case input_osm::scheduler_t::largest_first:
+            return "largest_first";
+    }
+    return "";
+}
+} // namespace
+
+// Blocks per second versus thread count for each block scheduler, and how long the workers sat idle.
+// The handlers only record the block index, so the run is dominated by inflating and scheduling.
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage " << argv[0] << " <path-to-pbf> [repetitions]\n";
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[1];
+    const int repetitions = argc >= 3 ? std::max(1, atoi(argv[2])) : 3;
+    const size_t max_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    std::vector<size_t> thread_counts;
+    for (size_t t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    // idle time of every worker in the best run with the most threads, by scheduler
+    std::vector<std::pair<input_osm::scheduler_t, std::vector<double>>> idle_per_thread;
+
+    std::cout << "| scheduler     | threads |   blocks |   best s |   blocks/s | mean idle s | max idle s |\n";
+    std::cout << "| ------------- | ------- | -------- | -------- | ---------- | ----------- | ---------- |\n";
+    for (auto scheduler :
+         {input_osm::scheduler_t::queue, input_osm::scheduler_t::work_stealing, input_osm::scheduler_t::largest_first})
+    {
+        input_osm::set_scheduler(scheduler);
+        for (size_t threads : thread_counts)
+        {
+            input_osm::set_thread_count(threads);
+            std::vector<input_osm::u64_64B> max_block(input_osm::thread_count(), 0);
+            auto record = [&max_block]() {
+                auto &m = max_block[input_osm::thread_index];
+                m = std::max<uint64_t>(m, input_osm::block_index);
+                return true;
+            };
+            double best = 0;
+            std::vector<double> idle;
+            for (int r = 0; r < repetitions; r++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                if (!input_osm::input_file(
+                        path,
+                        false,
+                        [&record](input_osm::span_t<input_osm::node_t>) { return record(); },
+                        [&record](input_osm::span_t<input_osm::way_t>) { return record(); },
+                        [&record](input_osm::span_t<input_osm::relation_t>) { return record(); }))
+                {
+                    std::cerr << "Error while processing pbf\n";
+                    return EXIT_FAILURE;
+                }
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (!r || elapsed < best)
+                {
+                    best = elapsed;
+                    idle = input_osm::decode_statistics().idle_seconds;
+                }
+            }
+            const uint64_t blocks = *std::max_element(max_block.begin(), max_block.end()) + 1;
+            const double mean_idle = idle.empty() ? 0 : std::accumulate(idle.begin(), idle.end(), 0.0) / idle.size();
+            const double max_idle = idle.empty() ? 0 : *std::max_element(idle.begin(), idle.end());
+            std::cout << "| " << std::setw(13) << std::left << scheduler_name(scheduler) << std::right << " | "
+                      << std::setw(7) << input_osm::thread_count() << " | " << std::setw(8) << blocks << " | "
+                      << std::setw(8) << std::fixed << std::setprecision(3) << best << " | " << std::setw(10)
+                      << std::setprecision(0) << blocks / best << " | " << std::setw(11) << std::setprecision(3)
+                      << mean_idle << " | " << std::setw(10) << max_idle << " |\n";
+            if (threads == thread_counts.back()) idle_per_thread.emplace_back(scheduler, idle);
+        }
+    }
+
+    std::cout << "\nidle seconds per thread at " << input_osm::thread_count() << " threads\n";
+    for (const auto &[scheduler, idle] : idle_per_thread)
+    {
+        std::cout << std::setw(13) << std::left << scheduler_name(scheduler) << std::right;
+        for (double seconds : idle) std::cout << ' ' << std::setprecision(3) << seconds;
+        std::cout << '\n';
+    }
+    return EXIT_SUCCESS;
+}
@@ -11,19 +11,63 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "counter.h"
-
 #include <inputosm/inputosm.h>
 
 #include <iostream>
 #include <cstdint>
-#include <numeric>
-#include <vector>
 #include <algorithm>
 #include <sstream>
 #include <chrono>
 #include <iomanip>
 
+namespace
+{
+// the statistics of one entity kind, gathered per worker and merged once the read is over
+struct kind_stats_t
+{
+    uint64_t count = 0;
+    uint64_t max_per_block = 0;
+    uint64_t max_tags_per_block = 0;
+    uint64_t max_refs_per_block = 0; // way nodes or relation members
+    int32_t max_timestamp = 0;
+    uint64_t with_tags = 0;
+    int64_t max_id = 0;
+
+    template <typename T>
+    void add(input_osm::span_t<T> list, size_t (*refs)(const T &))
+    {
+        count += list.size();
+        max_per_block = std::max<uint64_t>(max_per_block, list.size());
+        uint64_t tags = 0, ref_count = 0;
+        for (auto &e : list)
+        {
+            tags += e.tags.size();
+            ref_count += refs(e);
+            max_timestamp = std::max<int32_t>(max_timestamp, e.timestamp);
+            if (!e.tags.empty()) with_tags++;
+            max_id = std::max<int64_t>(max_id, e.id);
+        }
+        max_tags_per_block = std::max(max_tags_per_block, tags);
+        max_refs_per_block = std::max(max_refs_per_block, ref_count);
+    }
+    void merge(const kind_stats_t &other)
+    {
+        count += other.count;
+        max_per_block = std::max(max_per_block, other.max_per_block);
+        max_tags_per_block = std::max(max_tags_per_block, other.max_tags_per_block);
+        max_refs_per_block = std::max(max_refs_per_block, other.max_refs_per_block);
+        max_timestamp = std::max(max_timestamp, other.max_timestamp);
+        with_tags += other.with_tags;
+        max_id = std::max(max_id, other.max_id);
+    }
+};
+struct stats_t
+{
+    kind_stats_t nodes, ways, relations;
+    uint64_t max_block_index = 0;
+};
+} // namespace
+
 int main(int argc, char **argv)
 {
     if (argc < 2)
@@ -38,151 +82,55 @@ int main(int argc, char **argv)
     input_osm::set_max_thread_count();
     std::cout << "running on " << input_osm::thread_count() << " threads\n";
 
-    std::vector<input_osm::u64_64B> node_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> way_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> relation_count(input_osm::thread_count(), 0);
-
-    std::vector<input_osm::u64_64B> max_node_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> max_node_tag_count(input_osm::thread_count(), 0);
-
-    std::vector<input_osm::u64_64B> max_way_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> max_way_tag_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> max_way_node_count(input_osm::thread_count(), 0);
-
-    std::vector<input_osm::u64_64B> max_relation_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> max_relation_tag_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> max_relation_member_count(input_osm::thread_count(), 0);
-
-    std::vector<input_osm::i32_64B> node_timestamp(input_osm::thread_count(), 0);
-    std::vector<input_osm::i32_64B> way_timestamp(input_osm::thread_count(), 0);
-    std::vector<input_osm::i32_64B> relation_timestamp(input_osm::thread_count(), 0);
-
-    std::vector<input_osm::u64_64B> block_index(input_osm::thread_count(), 0);
-
-    std::vector<input_osm::u64_64B> node_with_tags_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> ways_with_tags_count(input_osm::thread_count(), 0);
-    std::vector<input_osm::u64_64B> relations_with_tags_count(input_osm::thread_count(), 0);
-
-    std::vector<input_osm::i64_64B> max_node_id(input_osm::thread_count(), 0);
-    std::vector<input_osm::i64_64B> max_way_id(input_osm::thread_count(), 0);
-    std::vector<input_osm::i64_64B> max_relation_id(input_osm::thread_count(), 0);
-
-    if (!input_osm::input_file(
-            path,
-            read_metadata,
-            [&node_count,
-             &max_node_count,
-             &max_node_tag_count,
-             &node_timestamp,
-             &block_index,
-             &node_with_tags_count,
-             &max_node_id](input_osm::span_t<input_osm::node_t> node_list) noexcept -> bool {
-                auto cnt = node_list.size();
-                node_count[input_osm::thread_index] += cnt;
-                if (cnt > max_node_count[input_osm::thread_index]) max_node_count[input_osm::thread_index] = cnt;
-                cnt = 0;
-                for (auto &n : node_list) cnt += n.tags.size();
-                if (cnt > max_node_tag_count[input_osm::thread_index])
-                    max_node_tag_count[input_osm::thread_index] = cnt;
-                for (auto &n : node_list)
-                    node_timestamp[input_osm::thread_index] = std::max<int32_t>(node_timestamp[input_osm::thread_index],
-                                                                                n.timestamp);
-                block_index[input_osm::thread_index] = std::max<uint64_t>(block_index[input_osm::thread_index],
-                                                                          input_osm::block_index);
-                for (auto &n : node_list)
-                    if (!n.tags.empty()) node_with_tags_count[input_osm::thread_index]++;
-                for (auto &n : node_list)
-                    max_node_id[input_osm::thread_index] = std::max<int64_t>(max_node_id[input_osm::thread_index],
-                                                                             n.id);
-                return true;
+    input_osm::reduction_t<stats_t> reduction{
+        .node_handler = [](stats_t &stats, input_osm::span_t<input_osm::node_t> node_list) noexcept -> bool {
+            stats.nodes.add<input_osm::node_t>(node_list, [](const input_osm::node_t &) -> size_t { return 0; });
+            stats.max_block_index = std::max<uint64_t>(stats.max_block_index, input_osm::block_index);
+            return true;
+        },
+        .way_handler = [](stats_t &stats, input_osm::span_t<input_osm::way_t> way_list) noexcept -> bool {
+            stats.ways.add<input_osm::way_t>(way_list,
+                                             [](const input_osm::way_t &w) -> size_t { return w.node_refs.size(); });
+            stats.max_block_index = std::max<uint64_t>(stats.max_block_index, input_osm::block_index);
+            return true;
+        },
+        .relation_handler = [](stats_t &stats,
+                               input_osm::span_t<input_osm::relation_t> relation_list) noexcept -> bool {
+            stats.relations.add<input_osm::relation_t>(
+                relation_list, [](const input_osm::relation_t &r) -> size_t { return r.members.size(); });
+            stats.max_block_index = std::max<uint64_t>(stats.max_block_index, input_osm::block_index);
+            return true;
+        },
+        .merge =
+            [](stats_t &total, stats_t &stats) {
+                total.nodes.merge(stats.nodes);
+                total.ways.merge(stats.ways);
+                total.relations.merge(stats.relations);
+                total.max_block_index = std::max(total.max_block_index, stats.max_block_index);
             },
-            [&way_count,
-             &max_way_count,
-             &max_way_tag_count,
-             &max_way_node_count,
-             &way_timestamp,
-             &block_index,
-             &ways_with_tags_count,
-             &max_way_id](input_osm::span_t<input_osm::way_t> way_list) noexcept -> bool {
-                auto cnt = way_list.size();
-                way_count[input_osm::thread_index] += cnt;
-                if (cnt > max_way_count[input_osm::thread_index]) max_way_count[input_osm::thread_index] = cnt;
-                cnt = 0;
-                for (auto &w : way_list) cnt += w.tags.size();
-                if (cnt > max_way_tag_count[input_osm::thread_index]) max_way_tag_count[input_osm::thread_index] = cnt;
-                cnt = 0;
-                for (auto &w : way_list) cnt += w.node_refs.size();
-                if (cnt > max_way_node_count[input_osm::thread_index])
-                    max_way_node_count[input_osm::thread_index] = cnt;
-                for (auto &w : way_list)
-                    way_timestamp[input_osm::thread_index] = std::max<int32_t>(way_timestamp[input_osm::thread_index],
-                                                                               w.timestamp);
-                block_index[input_osm::thread_index] = std::max<uint64_t>(block_index[input_osm::thread_index],
-                                                                          input_osm::block_index);
-                for (auto &w : way_list)
-                    if (!w.tags.empty()) ways_with_tags_count[input_osm::thread_index]++;
-                for (auto &w : way_list)
-                    max_way_id[input_osm::thread_index] = std::max<int64_t>(max_way_id[input_osm::thread_index], w.id);
-                return true;
-            },
-            [&relation_count,
-             &max_relation_count,
-             &max_relation_tag_count,
-             &max_relation_member_count,
-             &relation_timestamp,
-             &block_index,
-             &relations_with_tags_count,
-             &max_relation_id](input_osm::span_t<input_osm::relation_t> relation_list) noexcept -> bool {
-                auto cnt = relation_list.size();
-                relation_count[input_osm::thread_index] += cnt;
-                if (cnt > max_relation_count[input_osm::thread_index])
-                    max_relation_count[input_osm::thread_index] = cnt;
-                cnt = 0;
-                for (auto &r : relation_list) cnt += r.tags.size();
-                if (cnt > max_relation_tag_count[input_osm::thread_index])
-                    max_relation_tag_count[input_osm::thread_index] = cnt;
-                cnt = 0;
-                for (auto &r : relation_list) cnt += r.members.size();
-                if (cnt > max_relation_member_count[input_osm::thread_index])
-                    max_relation_member_count[input_osm::thread_index] = cnt;
-                for (auto &r : relation_list)
-                    relation_timestamp[input_osm::thread_index] = std::max<int32_t>(
-                        relation_timestamp[input_osm::thread_index], r.timestamp);
-                block_index[input_osm::thread_index] = std::max<uint64_t>(block_index[input_osm::thread_index],
-                                                                          input_osm::block_index);
-                for (auto &r : relation_list)
-                    if (!r.tags.empty()) relations_with_tags_count[input_osm::thread_index]++;
-                for (auto &r : relation_list)
-                    max_relation_id[input_osm::thread_index] = std::max<int64_t>(
-                        max_relation_id[input_osm::thread_index], r.id);
-                return true;
-            }))
+    };
+    stats_t total;
+    if (!input_osm::input_file_reduce(path, read_metadata, reduction, total))
     {
         std::cerr << "Error while processing pbf\n";
         return EXIT_FAILURE;
     }
 
     std::cout.imbue(std::locale(""));
-    std::cout << "nodes: " << std::accumulate(node_count.begin(), node_count.end(), 0LLU) << "\n";
-    std::cout << "ways: " << std::accumulate(way_count.begin(), way_count.end(), 0LLU) << "\n";
-    std::cout << "relations: " << std::accumulate(relation_count.begin(), relation_count.end(), 0LLU) << "\n";
-
-    std::cout << "max nodes per block: " << *std::max_element(max_node_count.begin(), max_node_count.end()) << "\n";
-    std::cout << "max node tags per block: " << *std::max_element(max_node_tag_count.begin(), max_node_tag_count.end())
-              << "\n";
-
-    std::cout << "max ways per block: " << *std::max_element(max_way_count.begin(), max_way_count.end()) << "\n";
-    std::cout << "max way tags per block: " << *std::max_element(max_way_tag_count.begin(), max_way_tag_count.end())
-              << "\n";
-    std::cout << "max way nodes per block: " << *std::max_element(max_way_node_count.begin(), max_way_node_count.end())
-              << "\n";
-
-    std::cout << "max relations per block: " << *std::max_element(max_relation_count.begin(), max_relation_count.end())
-              << "\n";
-    std::cout << "max relation tags per block: "
-              << *std::max_element(max_relation_tag_count.begin(), max_relation_tag_count.end()) << "\n";
-    std::cout << "max relation members per block: "
-              << *std::max_element(max_relation_member_count.begin(), max_relation_member_count.end()) << "\n";
+    std::cout << "nodes: " << total.nodes.count << "\n";
+    std::cout << "ways: " << total.ways.count << "\n";
+    std::cout << "relations: " << total.relations.count << "\n";
+
+    std::cout << "max nodes per block: " << total.nodes.max_per_block << "\n";
+    std::cout << "max node tags per block: " << total.nodes.max_tags_per_block << "\n";
+
+    std::cout << "max ways per block: " << total.ways.max_per_block << "\n";
+    std::cout << "max way tags per block: " << total.ways.max_tags_per_block << "\n";
+    std::cout << "max way nodes per block: " << total.ways.max_refs_per_block << "\n";
+
+    std::cout << "max relations per block: " << total.relations.max_per_block << "\n";
+    std::cout << "max relation tags per block: " << total.relations.max_tags_per_block << "\n";
+    std::cout << "max relation members per block: " << total.relations.max_refs_per_block << "\n";
 
     auto timestamp_to_str = [](const time_t in_time_t) -> std::string {
         std::stringstream ss;
@@ -190,25 +138,19 @@ int main(int argc, char **argv)
         return ss.str();
     };
 
-    std::cout << "max node timestamp: "
-              << timestamp_to_str(*std::max_element(node_timestamp.begin(), node_timestamp.end())) << std::endl;
-    std::cout << "max way timestamp: "
-              << timestamp_to_str(*std::max_element(way_timestamp.begin(), way_timestamp.end())) << std::endl;
-    std::cout << "max relation timestamp: "
-              << timestamp_to_str(*std::max_element(relation_timestamp.begin(), relation_timestamp.end())) << std::endl;
+    std::cout << "max node timestamp: " << timestamp_to_str(total.nodes.max_timestamp) << std::endl;
+    std::cout << "max way timestamp: " << timestamp_to_str(total.ways.max_timestamp) << std::endl;
+    std::cout << "max relation timestamp: " << timestamp_to_str(total.relations.max_timestamp) << std::endl;
 
-    std::cout << "max file block index: " << *std::max_element(block_index.begin(), block_index.end()) << std::endl;
+    std::cout << "max file block index: " << total.max_block_index << std::endl;
 
-    std::cout << "nodes with tags: " << std::accumulate(node_with_tags_count.begin(), node_with_tags_count.end(), 0LLU)
-              << "\n";
-    std::cout << "ways with tags: " << std::accumulate(ways_with_tags_count.begin(), ways_with_tags_count.end(), 0LLU)
-              << "\n";
-    std::cout << "relations with tags: "
-              << std::accumulate(relations_with_tags_count.begin(), relations_with_tags_count.end(), 0LLU) << "\n";
+    std::cout << "nodes with tags: " << total.nodes.with_tags << "\n";
+    std::cout << "ways with tags: " << total.ways.with_tags << "\n";
+    std::cout << "relations with tags: " << total.relations.with_tags << "\n";
 
-    std::cout << "max node id: " << *std::max_element(max_node_id.begin(), max_node_id.end()) << "\n";
-    std::cout << "max way id: " << *std::max_element(max_way_id.begin(), max_way_id.end()) << "\n";
-    std::cout << "max relation id: " << *std::max_element(max_relation_id.begin(), max_relation_id.end()) << "\n";
+    std::cout << "max node id: " << total.nodes.max_id << "\n";
+    std::cout << "max way id: " << total.ways.max_id << "\n";
+    std::cout << "max relation id: " << total.relations.max_id << "\n";
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
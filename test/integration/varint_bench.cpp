@@ -0,0 +1,121 @@
+// Copyright 2021-2022 Stefan Karschti
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "varint.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+void put_varint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+uint64_t zigzag(int64_t v)
+{
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+// a packed field shaped like one kind of PBF column
+struct column_t
+{
+    const char* name;
+    bool delta;
+    std::vector<uint8_t> packed;
+    size_t count;
+};
+
+column_t make_column(const char* name, bool delta, size_t count, const std::function<int64_t()>& next)
+{
+    column_t column{name, delta, {}, count};
+    for (size_t i = 0; i < count; i++)
+    {
+        const int64_t value = next();
+        put_varint(column.packed, delta ? zigzag(value) : static_cast<uint64_t>(value));
+    }
+    return column;
+}
+} // namespace
+
+// ns per decoded value of each varint kernel, on synthetic columns shaped like dense node blocks
+int main(int argc, char** argv)
+{
+    const int repetitions = argc >= 2 ? std::max(1, atoi(argv[1])) : 200;
+    constexpr size_t k_count = 8000; // a dense nodes group
+
+    std::mt19937_64 rng(1);
+    std::vector<column_t> columns;
+    columns.push_back(make_column("ids (delta 1)", true, k_count, [] { return 1; }));
+    columns.push_back(make_column("ids (sparse)", true, k_count, [&rng] { return 1 + int64_t(rng() % 5000); }));
+    columns.push_back(make_column(
+        "lat/lon deltas", true, k_count, [&rng] { return int64_t(rng() % 200001) - 100000; }));
+    columns.push_back(make_column(
+        "way node refs", true, k_count, [&rng] { return int64_t(rng() % 2000001) - 1000000; }));
+    columns.push_back(make_column(
+        "keys_vals", false, k_count, [&rng] { return rng() % 4 ? int64_t(rng() % 400) : 0; }));
+    columns.push_back(make_column("versions", false, k_count, [&rng] { return 1 + int64_t(rng() % 20); }));
+
+    std::vector<const input_osm::varint_kernels_t*> kernels;
+    for (const char* name : {"scalar", "sse4.1", "avx2"})
+        if (const auto* found = input_osm::find_varint_kernels(name)) kernels.push_back(found);
+
+    std::cout << "| column         | bytes/value | kernel |  ns/value | speedup |\n";
+    std::cout << "| -------------- | ----------- | ------ | --------- | ------- |\n";
+    std::vector<uint64_t> out(k_count * 10);
+    for (const auto& column : columns)
+    {
+        double scalar_ns = 0;
+        for (const auto* kernel : kernels)
+        {
+            const uint8_t* begin = column.packed.data();
+            const uint8_t* end = begin + column.packed.size();
+            double best = 0;
+            size_t decoded = 0;
+            for (int r = 0; r < repetitions; r++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                decoded = column.delta ? kernel->decode_delta_sint64(begin, end, reinterpret_cast<int64_t*>(out.data()))
+                                       : kernel->decode_uint64(begin, end, out.data());
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (!r || elapsed < best) best = elapsed;
+            }
+            if (decoded != column.count)
+            {
+                std::cerr << kernel->name << " decoded " << decoded << " of " << column.count << " values\n";
+                return EXIT_FAILURE;
+            }
+            const double ns = best * 1e9 / column.count;
+            if (kernel == kernels.front()) scalar_ns = ns;
+            std::cout << "| " << std::setw(14) << std::left << column.name << std::right << " | " << std::setw(11)
+                      << std::fixed << std::setprecision(2) << double(column.packed.size()) / column.count << " | "
+                      << std::setw(6) << kernel->name << " | " << std::setw(9) << std::setprecision(3) << ns << " | "
+                      << std::setw(6) << std::setprecision(2) << scalar_ns / ns << "x |\n";
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr int k_block_count = 10;
+constexpr int64_t k_entities_per_block = 100;
+constexpr int64_t k_entity_count = k_block_count * k_entities_per_block;
+
+// block b holds the nodes, ways and relations with ids 1 + b * 100 .. (b + 1) * 100; a node's latitude is its id
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_entities_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id, id, -id, {{"ref", std::to_string(id)}}));
+        block.ways.push_back(pbf_writer::make_way(id, {id, id + 1}));
+        block.relations.push_back(pbf_writer::make_relation(id, {{0, id, "stop"}}));
+    });
+}
+
+struct pulled_t
+{
+    std::vector<int64_t> nodes, ways, relations;
+    size_t corrupt = 0; // entities whose fields do not match their id
+    size_t batches = 0;
+    bool in_block_order = true;
+
+    void add(const input_osm::batch_t& batch, size_t& last_block)
+    {
+        batches++;
+        in_block_order = in_block_order && batch.block_index >= last_block;
+        last_block = batch.block_index;
+        for (const auto& n : batch.nodes)
+        {
+            nodes.push_back(n.id);
+            corrupt += n.tags.size() != 1 || std::string(n.tags[0].value) != std::to_string(n.id) ||
+                       std::abs(n.raw_latitude - n.id) > 1;
+        }
+        for (const auto& w : batch.ways)
+        {
+            ways.push_back(w.id);
+            corrupt += w.node_refs.size() != 2 || w.node_refs[1] != w.id + 1;
+        }
+        for (const auto& r : batch.relations)
+        {
+            relations.push_back(r.id);
+            corrupt += r.members.size() != 1 || r.members[0].id != r.id || std::string(r.members[0].role) != "stop";
+        }
+        const size_t kind_size = batch.kind == input_osm::ENTITY_NODES  ? batch.nodes.size()
+                                 : batch.kind == input_osm::ENTITY_WAYS ? batch.ways.size()
+                                                                        : batch.relations.size();
+        corrupt += kind_size != batch.size();
+    }
+    void sort()
+    {
+        std::sort(nodes.begin(), nodes.end());
+        std::sort(ways.begin(), ways.end());
+        std::sort(relations.begin(), relations.end());
+    }
+};
+
+std::vector<int64_t> all_ids()
+{
+    std::vector<int64_t> ids;
+    for (int64_t id = 1; id <= k_entity_count; id++) ids.push_back(id);
+    return ids;
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto pbf_path = dir / "inputosm_batch_reader_test.osm.pbf";
+    const auto xml_path = dir / "inputosm_batch_reader_test.osm";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(pbf_path, pbf_writer::encode_file(blocks)) || !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    input_osm::set_max_thread_count();
+    const std::vector<int64_t> ids = all_ids();
+    for (bool ordered : {false, true})
+    {
+        input_osm::set_ordered_delivery(ordered);
+        for (const auto& path : {pbf_path, xml_path})
+        {
+            const std::string what = path.filename().string() + (ordered ? " ordered" : "");
+            // a range for loop, with a consumer slower than the decoding: batches must stay intact while held
+            {
+                input_osm::batch_reader_t reader({path.string()}, false);
+                pulled_t pulled;
+                size_t last_block = 0;
+                for (const auto& batch : reader)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    pulled.add(batch, last_block);
+                }
+                pulled.sort();
+                ok = check(reader.finished() && reader.ok(), what + ": read failed") && ok;
+                ok = check(pulled.nodes == ids && pulled.ways == ids && pulled.relations == ids,
+                           what + ": unexpected entities") &&
+                     ok;
+                ok = check(!pulled.corrupt, what + ": batch changed while held") && ok;
+                ok = check(!ordered || pulled.in_block_order, what + ": batches out of order") && ok;
+            }
+            // polling try_next from another thread, ways only
+            {
+                input_osm::batch_reader_t reader({path.string()}, false, input_osm::ENTITY_WAYS);
+                pulled_t pulled;
+                std::thread consumer([&reader, &pulled] {
+                    size_t last_block = 0;
+                    while (!reader.finished())
+                    {
+                        if (const input_osm::batch_t* batch = reader.try_next())
+                            pulled.add(*batch, last_block);
+                        else
+                            std::this_thread::yield();
+                    }
+                });
+                consumer.join();
+                pulled.sort();
+                ok = check(reader.ok() && pulled.nodes.empty() && pulled.ways == ids && pulled.relations.empty() &&
+                               !pulled.corrupt,
+                           what + ": unexpected ways when polling") &&
+                     ok;
+            }
+        }
+    }
+    input_osm::set_ordered_delivery(false);
+
+    // dropping the batch reader early stops the read, the reader can then read again
+    for (int round = 0; round < 3; round++)
+    {
+        input_osm::batch_reader_t reader({pbf_path.string()}, false);
+        for (int i = 0; i < 2; i++) reader.next();
+    }
+    {
+        input_osm::reader_t reader;
+        reader.set_max_thread_count();
+        pulled_t pulled;
+        size_t last_block = 0;
+        {
+            input_osm::batch_reader_t batches(reader, {pbf_path.string(), xml_path.string()}, false);
+            while (const input_osm::batch_t* batch = batches.next()) pulled.add(*batch, last_block);
+            ok = check(batches.ok(), "two files: read failed") && ok;
+        }
+        ok = check(pulled.nodes.size() == 2 * ids.size() && pulled.ways.size() == 2 * ids.size() && !pulled.corrupt,
+                   "two files: unexpected entities") &&
+             ok;
+    }
+    // a read that fails is reported by ok()
+    {
+        input_osm::batch_reader_t reader({(dir / "inputosm_batch_reader_test_missing.osm.pbf").string()}, false);
+        ok = check(!reader.next() && reader.finished() && !reader.ok(), "missing file not reported") && ok;
+    }
+
+    std::filesystem::remove(pbf_path);
+    std::filesystem::remove(xml_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
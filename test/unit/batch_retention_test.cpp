@@ -0,0 +1,227 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr int k_block_count = 10;
+constexpr int64_t k_entities_per_block = 100;
+constexpr int64_t k_entity_count = k_block_count * k_entities_per_block;
+
+// block b holds the nodes, ways and relations with ids 1 + b * 100 .. (b + 1) * 100; a node's latitude is its id
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_entities_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id, id, -id, {{"ref", std::to_string(id)}}));
+        block.ways.push_back(pbf_writer::make_way(id, {id, id + 1}, {{"name", "way " + std::to_string(id)}}));
+        block.relations.push_back(pbf_writer::make_relation(id, {{0, id, "stop " + std::to_string(id)}}));
+    });
+}
+
+// the batches a read handed over, kept with their handles until the read is over
+struct retained_t
+{
+    std::mutex mtx;
+    std::vector<input_osm::batch_t> batches;
+    size_t unretained = 0;
+    size_t unstable = 0; // retain_batch returned a different handle for the same batch
+
+    template <typename T>
+    bool add(input_osm::span_t<T> list, input_osm::span_t<T> input_osm::batch_t::*field)
+    {
+        input_osm::batch_t batch;
+        batch.*field = list;
+        batch.handle = input_osm::retain_batch();
+        const bool stable = batch.handle == input_osm::retain_batch();
+        std::lock_guard<std::mutex> lck(mtx);
+        unretained += !batch.handle;
+        unstable += !stable;
+        batches.push_back(batch);
+        return true;
+    }
+
+    // entities whose fields do not match their id, and the ids seen of each kind
+    size_t check(std::vector<int64_t>& nodes, std::vector<int64_t>& ways, std::vector<int64_t>& relations) const
+    {
+        size_t corrupt = 0;
+        for (const auto& batch : batches)
+        {
+            for (const auto& n : batch.nodes)
+            {
+                nodes.push_back(n.id);
+                corrupt += n.tags.size() != 1 || std::string(n.tags[0].value) != std::to_string(n.id) ||
+                           std::abs(n.raw_latitude - n.id) > 1;
+            }
+            for (const auto& w : batch.ways)
+            {
+                ways.push_back(w.id);
+                corrupt += w.node_refs.size() != 2 || w.node_refs[1] != w.id + 1 || w.tags.size() != 1 ||
+                           std::string(w.tags[0].value) != "way " + std::to_string(w.id);
+            }
+            for (const auto& r : batch.relations)
+            {
+                relations.push_back(r.id);
+                corrupt += r.members.size() != 1 || r.members[0].id != r.id ||
+                           std::string(r.members[0].role) != "stop " + std::to_string(r.id);
+            }
+        }
+        std::sort(nodes.begin(), nodes.end());
+        std::sort(ways.begin(), ways.end());
+        std::sort(relations.begin(), relations.end());
+        return corrupt;
+    }
+};
+
+bool read_retained(input_osm::reader_t& reader, const std::string& filename, retained_t& retained)
+{
+    return reader.input_file(
+        filename.c_str(),
+        false,
+        [&retained](input_osm::span_t<input_osm::node_t> list) {
+            return retained.add(list, &input_osm::batch_t::nodes);
+        },
+        [&retained](input_osm::span_t<input_osm::way_t> list) {
+            return retained.add(list, &input_osm::batch_t::ways);
+        },
+        [&retained](input_osm::span_t<input_osm::relation_t> list) {
+            return retained.add(list, &input_osm::batch_t::relations);
+        });
+}
+
+std::vector<int64_t> all_ids()
+{
+    std::vector<int64_t> ids;
+    for (int64_t id = 1; id <= k_entity_count; id++) ids.push_back(id);
+    return ids;
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto zlib_path = dir / "inputosm_batch_retention_test.osm.pbf";
+    const auto raw_path = dir / "inputosm_batch_retention_test_raw.osm.pbf";
+    const auto xml_path = dir / "inputosm_batch_retention_test.osm";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(zlib_path, pbf_writer::encode_file(blocks)) ||
+        !pbf_writer::write_file(raw_path, pbf_writer::encode_file(blocks, pbf_writer::compression::raw)) ||
+        !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    const std::vector<int64_t> ids = all_ids();
+    input_osm::reader_t reader;
+    reader.set_max_thread_count();
+    reader.set_batch_retention(true);
+    // every batch is checked once the read is over, after the workers decoded all the later blocks; the second
+    // round runs on recycled buffers
+    for (int round = 0; round < 2; round++)
+    {
+        for (const auto& path : {zlib_path, raw_path, xml_path})
+        {
+            const std::string what = path.filename().string() + " round " + std::to_string(round);
+            retained_t retained;
+            ok = check(read_retained(reader, path.string(), retained), what + ": read failed") && ok;
+            std::vector<int64_t> nodes, ways, relations;
+            ok = check(!retained.check(nodes, ways, relations), what + ": retained batch changed") && ok;
+            ok = check(nodes == ids && ways == ids && relations == ids, what + ": unexpected entities") && ok;
+            ok = check(!retained.unretained && !retained.unstable, what + ": batch not retained") && ok;
+        }
+    }
+
+    // retained columns stay valid as well
+    {
+        std::vector<input_osm::node_columns_t> columns;
+        std::vector<input_osm::batch_handle_t> handles;
+        std::mutex mtx;
+        ok = check(reader.input_file_columnar(
+                       zlib_path.string().c_str(),
+                       false,
+                       [&](const input_osm::node_columns_t& batch) {
+                           std::lock_guard<std::mutex> lck(mtx);
+                           columns.push_back(batch);
+                           handles.push_back(input_osm::retain_batch());
+                           return true;
+                       },
+                       nullptr,
+                       nullptr),
+                   "columnar: read failed") &&
+             ok;
+        size_t corrupt = 0, count = 0;
+        for (const auto& batch : columns)
+        {
+            for (size_t i = 0; i < batch.size(); i++)
+                corrupt += std::abs(batch.raw_latitude[i] - batch.id[i]) > 1 ||
+                           std::string(batch.tags[batch.tag_offsets[i]].value) != std::to_string(batch.id[i]);
+            count += batch.size();
+        }
+        ok = check(count == ids.size() && !corrupt && std::all_of(handles.begin(), handles.end(), [](const auto& h) {
+                       return bool(h);
+                   }),
+                   "columnar: retained columns changed") &&
+             ok;
+    }
+
+    // no handle without retention, outside a handler, and for nodes converted from XML
+    {
+        std::atomic<size_t> handles{0};
+        auto count_handles = [&handles](input_osm::span_t<input_osm::compact_node_t>) {
+            handles += bool(input_osm::retain_batch());
+            return true;
+        };
+        ok = check(reader.input_file_as<input_osm::compact_node_t>(
+                       xml_path.string().c_str(), false, count_handles, nullptr, nullptr) &&
+                       !handles,
+                   "converted XML nodes retained") &&
+             ok;
+        ok = check(!input_osm::retain_batch(), "retained outside a handler") && ok;
+        reader.set_batch_retention(false);
+        ok = check(reader.input_file_as<input_osm::compact_node_t>(
+                       zlib_path.string().c_str(), false, count_handles, nullptr, nullptr) &&
+                       !handles,
+                   "retained with retention off") &&
+             ok;
+    }
+
+    // a batch reader keeps retained batches in its rings; they stay valid while the batch_t copies are kept
+    {
+        reader.set_batch_retention(true);
+        retained_t pulled;
+        {
+            input_osm::batch_reader_t batches(reader, {zlib_path.string()}, false);
+            for (const auto& batch : batches) pulled.batches.push_back(batch);
+            ok = check(batches.ok(), "batch reader: read failed") && ok;
+        }
+        std::vector<int64_t> nodes, ways, relations;
+        ok = check(!pulled.check(nodes, ways, relations) && nodes == ids && ways == ids && relations == ids &&
+                       std::all_of(pulled.batches.begin(),
+                                   pulled.batches.end(),
+                                   [](const auto& batch) { return bool(batch.handle); }),
+                   "batch reader: retained batch changed") &&
+             ok;
+    }
+
+    std::filesystem::remove(zlib_path);
+    std::filesystem::remove(raw_path);
+    std::filesystem::remove(xml_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
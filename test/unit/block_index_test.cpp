@@ -0,0 +1,197 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr int k_node_blocks = 20;
+constexpr int k_nodes_per_block = 50;
+constexpr int k_way_blocks = 5;
+
+// node only blocks, then way only blocks, then one relation block
+std::vector<pbf_writer::block> make_blocks()
+{
+    auto blocks = pbf_writer::make_blocks(k_node_blocks, k_nodes_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id, id * 10, id * 20));
+    });
+    for (int b = 0; b < k_way_blocks; b++)
+        blocks.emplace_back().ways.push_back(pbf_writer::make_way(1000 + b, {1, 2, 3}));
+    blocks.emplace_back().relations.push_back(pbf_writer::make_relation(5000, {{1, 1000, "outer"}}));
+    return blocks;
+}
+
+struct delivery_t
+{
+    std::mutex mtx;
+    std::vector<size_t> node_blocks;
+    std::vector<int64_t> node_ids;
+    std::vector<int64_t> way_ids;
+    std::vector<int64_t> relation_ids;
+};
+
+bool read(const std::filesystem::path& path, delivery_t& delivery, bool nodes, bool ways, bool relations)
+{
+    auto node_handler = [&delivery](input_osm::span_t<input_osm::node_t> batch) {
+        std::lock_guard<std::mutex> lck(delivery.mtx);
+        delivery.node_blocks.push_back(input_osm::block_index);
+        for (const auto& n : batch) delivery.node_ids.push_back(n.id);
+        return true;
+    };
+    auto way_handler = [&delivery](input_osm::span_t<input_osm::way_t> batch) {
+        std::lock_guard<std::mutex> lck(delivery.mtx);
+        for (const auto& w : batch) delivery.way_ids.push_back(w.id);
+        return true;
+    };
+    auto relation_handler = [&delivery](input_osm::span_t<input_osm::relation_t> batch) {
+        std::lock_guard<std::mutex> lck(delivery.mtx);
+        for (const auto& r : batch) delivery.relation_ids.push_back(r.id);
+        return true;
+    };
+    return input_osm::input_file(path.string().c_str(),
+                                 false,
+                                 nodes ? node_handler : std::function<bool(input_osm::span_t<input_osm::node_t>)>(),
+                                 ways ? way_handler : std::function<bool(input_osm::span_t<input_osm::way_t>)>(),
+                                 relations ? relation_handler
+                                           : std::function<bool(input_osm::span_t<input_osm::relation_t>)>());
+}
+
+bool check(bool condition, const char* message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto path = dir / "inputosm_block_index_test.osm.pbf";
+    const auto index_path = dir / "inputosm_block_index_test.osm.pbf.idx";
+    std::filesystem::remove(index_path);
+    if (!pbf_writer::write_file(path, pbf_writer::encode_file(make_blocks())))
+    {
+        std::cerr << "Failed to write test fixture\n";
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    input_osm::set_use_block_index(true);
+    for (size_t threads : {size_t{1}, size_t{4}})
+    {
+        input_osm::set_thread_count(threads);
+
+        // first read builds the index on the fly
+        std::filesystem::remove(index_path);
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, true, true, true), "full read failed") && ok;
+            ok = check(delivery.node_ids.size() == k_node_blocks * k_nodes_per_block, "full read missed nodes") && ok;
+            ok = check(std::filesystem::exists(index_path), "index not written during read") && ok;
+        }
+
+        // explicit build
+        std::filesystem::remove(index_path);
+        ok = check(input_osm::build_block_index(path.string().c_str()), "build_block_index failed") && ok;
+        ok = check(std::filesystem::exists(index_path), "index not written") && ok;
+
+        // ways only: node and relation blocks are skipped, block indices still match the file
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, false, true, false), "way read failed") && ok;
+            std::sort(delivery.way_ids.begin(), delivery.way_ids.end());
+            ok = check(delivery.way_ids == std::vector<int64_t>{1000, 1001, 1002, 1003, 1004}, "unexpected ways") && ok;
+        }
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, false, false, true), "relation read failed") && ok;
+            ok = check(delivery.relation_ids == std::vector<int64_t>{5000}, "unexpected relations") && ok;
+        }
+
+        // block filter on the node id range
+        input_osm::set_block_filter([](const input_osm::block_summary_t& summary) {
+            return summary.max_node_id >= 301 && summary.min_node_id <= 400;
+        });
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, true, false, false), "filtered read failed") && ok;
+            std::sort(delivery.node_blocks.begin(), delivery.node_blocks.end());
+            ok = check(delivery.node_blocks == std::vector<size_t>{7, 8}, "unexpected filtered blocks") && ok;
+            ok = check(delivery.node_ids.size() == 2 * k_nodes_per_block, "unexpected filtered nodes") && ok;
+        }
+        input_osm::set_block_filter(nullptr);
+
+        // skipped blocks must not stall ordered delivery
+        input_osm::set_ordered_delivery(true);
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, false, true, true), "ordered read failed") && ok;
+            ok = check(delivery.way_ids.size() == k_way_blocks && delivery.relation_ids.size() == 1,
+                       "ordered read missed entities") &&
+                 ok;
+        }
+        input_osm::set_ordered_delivery(false);
+
+        // a stale index is ignored and rebuilt
+        std::filesystem::resize_file(index_path, 16);
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, true, true, true), "read with stale index failed") && ok;
+            ok = check(delivery.node_ids.size() == k_node_blocks * k_nodes_per_block, "stale index lost nodes") && ok;
+            ok = check(std::filesystem::file_size(index_path) > 16, "stale index not rebuilt") && ok;
+        }
+
+        // a block count beyond the sidecar size is rejected before anything is allocated
+        {
+            std::fstream index(index_path, std::ios::in | std::ios::out | std::ios::binary);
+            const uint64_t count = uint64_t{1} << 60;
+            index.seekp(32); // magic, version, record size, file size and modification time come first
+            index.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        }
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, true, true, true) &&
+                           delivery.node_ids.size() == k_node_blocks * k_nodes_per_block,
+                       "read with corrupt block count failed") &&
+                 ok;
+        }
+    }
+
+    // the file is rewritten with the same size and modification time, so only the BlobHeaders at the indexed offsets
+    // tell that the index is stale: the read walks the file instead and rebuilds the index
+    input_osm::set_thread_count(1);
+    {
+        const auto mtime = std::filesystem::last_write_time(path);
+        auto blocks = make_blocks();
+        std::rotate(blocks.begin(), blocks.end() - 1, blocks.end());
+        const auto rewritten = pbf_writer::encode_file(blocks);
+        ok = check(rewritten.size() == std::filesystem::file_size(path) && pbf_writer::write_file(path, rewritten),
+                   "failed to rewrite the fixture") &&
+             ok;
+        std::filesystem::last_write_time(path, mtime);
+        for (const char* what : {"rewritten file: read with stale index", "rewritten file: read with rebuilt index"})
+        {
+            delivery_t delivery;
+            ok = check(read(path, delivery, false, true, true), what) && ok;
+            std::sort(delivery.way_ids.begin(), delivery.way_ids.end());
+            ok = check(delivery.way_ids == std::vector<int64_t>{1000, 1001, 1002, 1003, 1004} &&
+                           delivery.relation_ids == std::vector<int64_t>{5000},
+                       what) &&
+                 ok;
+        }
+    }
+    input_osm::set_use_block_index(false);
+
+    std::filesystem::remove(index_path);
+    std::filesystem::remove(path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
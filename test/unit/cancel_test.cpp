@@ -0,0 +1,198 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr int k_block_count = 40;
+constexpr int64_t k_entities_per_block = 500;
+
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_entities_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id));
+        block.ways.push_back(pbf_writer::make_way(id, {id, id + 1}));
+        block.relations.push_back(pbf_writer::make_relation(id, {{0, id, ""}}));
+    });
+}
+
+// handlers counting the batches they got, each one busy for `delay`; the `fail_after`th batch and later ones fail
+struct slow_handlers_t
+{
+    std::chrono::milliseconds delay{0};
+    size_t fail_after = SIZE_MAX;
+    std::atomic<size_t> batches{0};
+
+    template <typename T>
+    std::function<bool(input_osm::span_t<T>)> handler()
+    {
+        return [this](input_osm::span_t<T>) {
+            if (++batches >= fail_after) return false;
+            std::this_thread::sleep_for(delay);
+            return true;
+        };
+    }
+    bool read(input_osm::reader_t& reader, const std::vector<std::string>& filenames)
+    {
+        batches = 0;
+        return reader.input_files(filenames,
+                                  false,
+                                  handler<input_osm::node_t>(),
+                                  handler<input_osm::way_t>(),
+                                  handler<input_osm::relation_t>());
+    }
+};
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto pbf_path = dir / "inputosm_cancel_test.osm.pbf";
+    const auto truncated_path = dir / "inputosm_cancel_test_truncated.osm.pbf";
+    const auto xml_path = dir / "inputosm_cancel_test.osm";
+    const auto blocks = make_blocks();
+    const auto encoded = pbf_writer::encode_file(blocks);
+    if (!pbf_writer::write_file(pbf_path, encoded) ||
+        !pbf_writer::write_file(truncated_path, encoded.substr(0, encoded.size() / 2)) ||
+        !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+    const std::string pbf = pbf_path.string(), truncated = truncated_path.string(), xml = xml_path.string();
+
+    bool ok = true;
+    input_osm::reader_t reader;
+    reader.set_max_thread_count();
+    size_t batch_count = 0; // of a full PBF read
+    {
+        slow_handlers_t handlers;
+        ok = check(handlers.read(reader, {pbf}) && reader.stop_reason() == input_osm::stop_reason_t::none,
+                   "full read failed") &&
+             ok;
+        batch_count = handlers.batches;
+    }
+
+    // a handler returning false stops every worker, with and without ordered delivery
+    for (bool ordered : {false, true})
+    {
+        const std::string what = ordered ? "ordered: " : "unordered: ";
+        reader.set_ordered_delivery(ordered);
+        slow_handlers_t handlers;
+        handlers.delay = std::chrono::milliseconds(1);
+        handlers.fail_after = 1;
+        ok = check(!handlers.read(reader, {pbf}), what + "read did not fail") && ok;
+        ok = check(reader.stop_reason() == input_osm::stop_reason_t::handler, what + "wrong stop reason") && ok;
+        // at most the batches already in flight on the other workers follow
+        ok = check(handlers.batches <= 2 * reader.thread_count(),
+                   what + std::to_string(handlers.batches) + " batches after the handler failed") &&
+             ok;
+    }
+    reader.set_ordered_delivery(false);
+
+    // cancel from another thread while the handlers are busy
+    {
+        slow_handlers_t handlers;
+        handlers.delay = std::chrono::milliseconds(5);
+        std::thread canceller([&] {
+            while (handlers.batches < 2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            reader.cancel();
+        });
+        ok = check(!handlers.read(reader, {pbf}), "cancel: read did not fail") && ok;
+        canceller.join();
+        ok = check(reader.stop_reason() == input_osm::stop_reason_t::cancel, "cancel: wrong stop reason") && ok;
+        ok = check(handlers.batches < batch_count, "cancel: read everything") && ok;
+    }
+
+    // a cancel before the read starts is not lost: the next read stops right away, the one after it is not affected
+    for (const auto& filename : {pbf, xml})
+    {
+        slow_handlers_t handlers;
+        reader.cancel();
+        ok = check(!handlers.read(reader, {filename}) && !handlers.batches &&
+                       reader.stop_reason() == input_osm::stop_reason_t::cancel,
+                   filename + ": cancel before start ignored") &&
+             ok;
+        ok = check(handlers.read(reader, {filename}) && reader.stop_reason() == input_osm::stop_reason_t::none,
+                   filename + ": cancel before start carried over") &&
+             ok;
+    }
+
+    // a batch reader destroyed right away stops its read, also if that has not started yet, and leaves no cancel behind
+    for (int round = 0; round < 20; round++)
+        input_osm::batch_reader_t(reader, {pbf}, false);
+    {
+        slow_handlers_t handlers;
+        ok = check(handlers.read(reader, {pbf}) && handlers.batches == batch_count,
+                   "read after a destroyed batch reader failed") &&
+             ok;
+    }
+
+    // the timeout stops a read that takes too long, PBF and XML
+    reader.set_timeout(std::chrono::milliseconds(50));
+    for (const auto& filename : {pbf, xml})
+    {
+        slow_handlers_t handlers;
+        handlers.delay = std::chrono::milliseconds(20);
+        const auto start = std::chrono::steady_clock::now();
+        ok = check(!handlers.read(reader, {filename}), filename + ": timeout: read did not fail") && ok;
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        ok = check(reader.stop_reason() == input_osm::stop_reason_t::timeout,
+                   filename + ": timeout: wrong stop reason") &&
+             ok;
+        ok = check(elapsed < std::chrono::seconds(1), filename + ": timeout: read took too long") && ok;
+    }
+    reader.set_timeout(std::chrono::milliseconds(0));
+
+    // XML stops at the batch whose handler failed, also inside a list of files
+    {
+        slow_handlers_t handlers;
+        handlers.fail_after = 1;
+        ok = check(!handlers.read(reader, {xml}) && handlers.batches == 1 &&
+                       reader.stop_reason() == input_osm::stop_reason_t::handler,
+                   "xml: handler failure ignored") &&
+             ok;
+        ok = check(!handlers.read(reader, {xml, pbf}) && handlers.batches < batch_count &&
+                       reader.stop_reason() == input_osm::stop_reason_t::handler,
+                   "xml in a list: handler failure ignored") &&
+             ok;
+    }
+
+    // a broken file is an error
+    {
+        slow_handlers_t handlers;
+        ok = check(!handlers.read(reader, {truncated}) && reader.stop_reason() == input_osm::stop_reason_t::error,
+                   "truncated file: no error") &&
+             ok;
+    }
+
+    // a stop does not carry over to the next read
+    {
+        slow_handlers_t handlers;
+        ok = check(handlers.read(reader, {pbf}) && handlers.batches == batch_count &&
+                       reader.stop_reason() == input_osm::stop_reason_t::none,
+                   "read after a stop failed") &&
+             ok;
+    }
+
+    std::filesystem::remove(pbf_path);
+    std::filesystem::remove(truncated_path);
+    std::filesystem::remove(xml_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,200 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+using input_osm::id_set_t;
+
+constexpr int k_block_count = 10;
+constexpr int64_t k_entities_per_block = 100;
+
+// block b holds the nodes, ways and relations with ids 1 + b * 100 .. (b + 1) * 100
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_entities_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id, id, -id, {{"ref", std::to_string(id)}}));
+        block.ways.push_back(pbf_writer::make_way(id, {id}));
+        block.relations.push_back(pbf_writer::make_relation(id, {{0, id, "stop"}}));
+    });
+}
+
+struct ids_t
+{
+    std::vector<int64_t> nodes;
+    std::vector<int64_t> ways;
+    std::vector<int64_t> relations;
+    bool operator==(const ids_t&) const = default;
+};
+
+bool read_ids(const std::filesystem::path& path, ids_t& ids, bool ways_and_relations = true)
+{
+    std::mutex mtx;
+    std::function<bool(input_osm::span_t<input_osm::way_t>)> way_handler;
+    std::function<bool(input_osm::span_t<input_osm::relation_t>)> relation_handler;
+    if (ways_and_relations)
+    {
+        way_handler = [&](input_osm::span_t<input_osm::way_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& w : batch)
+                if (w.node_refs.size() == 1 && w.node_refs[0] == w.id) ids.ways.push_back(w.id);
+            return true;
+        };
+        relation_handler = [&](input_osm::span_t<input_osm::relation_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& r : batch)
+                if (r.members.size() == 1 && r.members[0].id == r.id) ids.relations.push_back(r.id);
+            return true;
+        };
+    }
+    const bool ok = input_osm::input_file(
+        path.string().c_str(),
+        false,
+        [&](input_osm::span_t<input_osm::node_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& n : batch) ids.nodes.push_back(n.id);
+            return true;
+        },
+        way_handler,
+        relation_handler);
+    std::sort(ids.nodes.begin(), ids.nodes.end());
+    std::sort(ids.ways.begin(), ids.ways.end());
+    std::sort(ids.relations.begin(), ids.relations.end());
+    return ok;
+}
+
+std::vector<int64_t> all_ids()
+{
+    std::vector<int64_t> ids;
+    for (int64_t id = 1; id <= k_block_count * k_entities_per_block; id++) ids.push_back(id);
+    return ids;
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    bool ok = true;
+
+    // the set against std::set: scattered ids, a dense run that turns its chunk into a bitmap, negative ids
+    {
+        std::mt19937_64 random(42);
+        std::vector<int64_t> ids;
+        for (int i = 0; i < 3000; i++) ids.push_back(int64_t(random() % 20000000));
+        for (int64_t id = 1 << 20; id < (1 << 20) + 10000; id += 2) ids.push_back(id);
+        for (int i = 0; i < 100; i++) ids.push_back(-int64_t(random() % 100000) - 1);
+        const std::set<int64_t> reference(ids.begin(), ids.end());
+        const id_set_t bulk(ids);
+        id_set_t inserted;
+        for (auto id : ids) inserted.insert(id);
+        ok = check(bulk.size() == reference.size() && inserted.size() == reference.size(), "set size") && ok;
+
+        std::vector<int64_t> probes;
+        for (int i = 0; i < 20000; i++) probes.push_back(int64_t(random() % 20000000));
+        for (int64_t id = (1 << 20) - 100; id < (1 << 20) + 10100; id++) probes.push_back(id);
+        for (int64_t id = -100000; id < 10; id++) probes.push_back(id);
+        std::vector<uint8_t> member(probes.size());
+        const size_t members = bulk.contains(probes.data(), probes.size(), member.data());
+        size_t expected_members = 0, mismatches = 0;
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            const bool expected = reference.count(probes[i]);
+            expected_members += expected;
+            mismatches += expected != bulk.contains(probes[i]) || expected != inserted.contains(probes[i]) ||
+                          expected != bool(member[i]);
+        }
+        ok = check(!mismatches && members == expected_members, "membership differs from std::set") && ok;
+
+        size_t overlap_mismatches = 0;
+        for (int i = 0; i < 2000; i++)
+        {
+            const int64_t first = int64_t(random() % 20100000) - 100000;
+            const int64_t last = first + int64_t(random() % (i % 2 ? 100 : 100000));
+            const auto it = reference.lower_bound(first);
+            const bool expected = it != reference.end() && *it <= last;
+            overlap_mismatches += expected != bulk.overlaps(first, last);
+        }
+        ok = check(!overlap_mismatches, "overlaps differs from std::set") && ok;
+        ok = check(!id_set_t().overlaps(0, 100) && !bulk.overlaps(5, 4), "empty overlaps") && ok;
+        ok = check(!input_osm::set_id_filter(input_osm::ENTITY_ALL, bulk), "set_id_filter accepted several kinds") &&
+             ok;
+    }
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto zlib_path = dir / "inputosm_id_filter_test_zlib.osm.pbf";
+    const auto raw_path = dir / "inputosm_id_filter_test_raw.osm.pbf";
+    const auto xml_path = dir / "inputosm_id_filter_test.osm";
+    const auto index_path = dir / "inputosm_id_filter_test_zlib.osm.pbf.idx";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(zlib_path, pbf_writer::encode_file(blocks, pbf_writer::compression::zlib)) ||
+        !pbf_writer::write_file(raw_path, pbf_writer::encode_file(blocks, pbf_writer::compression::raw)) ||
+        !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+
+    // scattered nodes, a run of ways across a block boundary, relations missing from the file
+    const std::vector<int64_t> node_ids = {3, 150, 151, 420, 999, 1000};
+    std::vector<int64_t> way_ids;
+    for (int64_t id = 180; id <= 230; id++) way_ids.push_back(id);
+    const std::vector<int64_t> relation_ids = {5000, 6000};
+    input_osm::set_id_filter(input_osm::ENTITY_NODES, id_set_t(node_ids));
+    input_osm::set_id_filter(input_osm::ENTITY_WAYS, id_set_t(way_ids));
+    input_osm::set_id_filter(input_osm::ENTITY_RELATIONS, id_set_t(relation_ids));
+    const ids_t expected{node_ids, way_ids, {}};
+    for (size_t threads : {size_t{1}, size_t{4}})
+    {
+        input_osm::set_thread_count(threads);
+        for (const auto& path : {zlib_path, raw_path, xml_path})
+        {
+            ids_t ids;
+            ok = check(read_ids(path, ids) && ids == expected, "unexpected entities in " + path.filename().string()) &&
+                 ok;
+        }
+    }
+    input_osm::set_thread_count(1);
+
+    // with a block index only the blocks holding wanted nodes are inflated
+    input_osm::set_use_block_index(true);
+    ok = check(input_osm::build_block_index(zlib_path.string().c_str()), "build_block_index failed") && ok;
+    {
+        ids_t ids;
+        ok = check(read_ids(zlib_path, ids, false) && ids.nodes == node_ids, "unexpected nodes with block index") && ok;
+        // blocks 0, 1, 4 and 9
+        ok = check(input_osm::decode_statistics().blocks == 4, "blocks without wanted nodes were decoded") && ok;
+    }
+    input_osm::set_use_block_index(false);
+
+    // removing the filters delivers everything again
+    input_osm::set_id_filter(input_osm::ENTITY_NODES, id_set_t());
+    input_osm::set_id_filter(input_osm::ENTITY_WAYS, id_set_t());
+    input_osm::set_id_filter(input_osm::ENTITY_RELATIONS, id_set_t());
+    {
+        ids_t ids;
+        ok = check(read_ids(raw_path, ids) && ids == ids_t{all_ids(), all_ids(), all_ids()}, "filters not removed") &&
+             ok;
+    }
+
+    std::filesystem::remove(zlib_path);
+    std::filesystem::remove(raw_path);
+    std::filesystem::remove(xml_path);
+    std::filesystem::remove(index_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
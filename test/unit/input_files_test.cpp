@@ -0,0 +1,202 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+constexpr int k_pbf_files = 3;
+constexpr int k_blocks_per_file = 3;
+constexpr int64_t k_nodes_per_block = 50;
+constexpr size_t k_osc_index = 1; // the OSC file sits between the PBF files of the list
+constexpr int64_t k_osc_first_id = 9001;
+constexpr int64_t k_osc_nodes = 10;
+
+// PBF file f holds the nodes f * 1000 + 1 .. in blocks of 50, and one way per block
+std::vector<pbf_writer::block> make_blocks(int f)
+{
+    const int64_t first_id = f * 1000 + 1;
+    return pbf_writer::make_blocks(
+        k_blocks_per_file,
+        k_nodes_per_block,
+        [first_id](pbf_writer::block& block, int64_t id) {
+            block.nodes.push_back(pbf_writer::make_node(id, id, id));
+            // one way per block, at its first node
+            if ((id - first_id) % k_nodes_per_block == 0) block.ways.push_back(pbf_writer::make_way(id, {id, id + 1}));
+        },
+        first_id);
+}
+
+// the OSC file creates the nodes k_osc_first_id ..
+bool write_osc(const std::filesystem::path& path)
+{
+    const auto blocks = pbf_writer::make_blocks(
+        1,
+        k_osc_nodes,
+        [](pbf_writer::block& block, int64_t id) {
+            block.nodes.push_back(pbf_writer::make_node(id, 10000000, 20000000));
+        },
+        k_osc_first_id);
+    return pbf_writer::write_osc(path, blocks, "create");
+}
+
+// file index and block index the reader should report for a node
+std::pair<size_t, size_t> expected_origin(int64_t id)
+{
+    if (id >= k_osc_first_id) return {k_osc_index, 0};
+    const int f = static_cast<int>(id / 1000);
+    // block 0 is the OSMHeader
+    return {f < int(k_osc_index) ? f : f + 1, 1 + (id % 1000 - 1) / k_nodes_per_block};
+}
+
+struct node_origin_t
+{
+    int64_t id;
+    size_t file_index;
+    size_t block_index;
+    bool xml;
+    input_osm::mode_t mode;
+};
+
+bool read_all(const std::vector<std::string>& filenames,
+              std::vector<node_origin_t>& nodes,
+              size_t& ways,
+              int64_t stop_at = 0)
+{
+    std::mutex mtx;
+    return input_osm::input_files(
+        filenames,
+        false,
+        [&](input_osm::span_t<input_osm::node_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& n : batch)
+            {
+                if (n.id == stop_at) return false;
+                nodes.push_back({n.id,
+                                 input_osm::file_index,
+                                 input_osm::block_index,
+                                 input_osm::file_type == input_osm::file_type_t::xml,
+                                 input_osm::osc_mode});
+            }
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::way_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            ways += batch.size();
+            return true;
+        },
+        nullptr);
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    std::vector<std::string> filenames;
+    for (int f = 0; f < k_pbf_files; f++)
+    {
+        const auto path = dir / ("inputosm_input_files_test_" + std::to_string(f) + ".osm.pbf");
+        if (!pbf_writer::write_file(path, pbf_writer::encode_file(make_blocks(f))))
+        {
+            std::cerr << "Failed to write test fixtures\n";
+            return EXIT_FAILURE;
+        }
+        filenames.push_back(path.string());
+    }
+    const auto osc_path = dir / "inputosm_input_files_test.osc";
+    if (!write_osc(osc_path))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+    filenames.insert(filenames.begin() + k_osc_index, osc_path.string());
+
+    bool ok = true;
+    input_osm::set_max_thread_count();
+    const size_t expected_nodes = k_pbf_files * k_blocks_per_file * k_nodes_per_block + k_osc_nodes;
+    for (bool ordered : {false, true})
+    {
+        input_osm::set_ordered_delivery(ordered);
+        for (auto scheduler : {input_osm::scheduler_t::queue,
+                               input_osm::scheduler_t::work_stealing,
+                               input_osm::scheduler_t::largest_first})
+        {
+            input_osm::set_scheduler(scheduler);
+            const std::string what = std::string(ordered ? "ordered" : "unordered") +
+                                     (scheduler == input_osm::scheduler_t::queue           ? " queue"
+                                      : scheduler == input_osm::scheduler_t::work_stealing ? " work stealing"
+                                                                                           : " largest first");
+            std::vector<node_origin_t> nodes;
+            size_t ways = 0;
+            ok = check(read_all(filenames, nodes, ways), what + ": input_files failed") && ok;
+            ok = check(nodes.size() == expected_nodes && ways == size_t(k_pbf_files * k_blocks_per_file),
+                       what + ": unexpected entity counts") &&
+                 ok;
+            size_t misplaced = 0;
+            for (const auto& n : nodes)
+            {
+                const bool from_osc = n.id >= k_osc_first_id;
+                const input_osm::mode_t mode = from_osc ? input_osm::mode_t::create : input_osm::mode_t::bulk;
+                misplaced += expected_origin(n.id) != std::make_pair(n.file_index, n.block_index) ||
+                             n.xml != from_osc || n.mode != mode;
+            }
+            ok = check(!misplaced, what + ": wrong file_index, block_index, file_type or osc_mode") && ok;
+            if (ordered)
+            {
+                const bool in_order = std::is_sorted(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) {
+                    return std::make_pair(a.file_index, a.block_index) < std::make_pair(b.file_index, b.block_index);
+                });
+                ok = check(in_order, what + ": batches out of file order") && ok;
+            }
+            std::sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) { return a.id < b.id; });
+            ok = check(std::adjacent_find(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) {
+                           return a.id == b.id;
+                       }) == nodes.end(),
+                       what + ": duplicate nodes") &&
+                 ok;
+        }
+    }
+    input_osm::set_ordered_delivery(false);
+    input_osm::set_scheduler(input_osm::scheduler_t::queue);
+
+    // a handler returning false stops the whole run
+    {
+        std::vector<node_origin_t> nodes;
+        size_t ways = 0;
+        ok = check(!read_all(filenames, nodes, ways, 2001), "early stop not reported") && ok;
+    }
+    // nothing to read
+    {
+        std::vector<node_origin_t> nodes;
+        size_t ways = 0;
+        ok = check(read_all({}, nodes, ways) && nodes.empty() && !ways, "empty list") && ok;
+    }
+    // a missing file or an unknown extension fails before anything is delivered
+    for (const std::string& bad : {(dir / "inputosm_input_files_test_missing.osm.pbf").string(),
+                                  (dir / "inputosm_input_files_test.txt").string()})
+    {
+        std::vector<std::string> with_bad = filenames;
+        with_bad.push_back(bad);
+        std::vector<node_origin_t> nodes;
+        size_t ways = 0;
+        ok = check(!read_all(with_bad, nodes, ways) && nodes.empty(), "accepted " + bad) && ok;
+    }
+
+    for (const auto& filename : filenames) std::filesystem::remove(filename);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,530 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <zlib.h>
+#ifdef INPUTOSM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef INPUTOSM_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+// Minimal OSM PBF encoder, and the matching OSM XML writer, used to synthesize test fixtures at runtime.
+namespace pbf_writer
+{
+
+using bytes_t = std::string;
+
+inline void put_varint(bytes_t& out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline uint64_t zigzag(int64_t v)
+{
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline void put_key(bytes_t& out, uint32_t field, uint32_t wire_type)
+{
+    put_varint(out, (field << 3) | wire_type);
+}
+
+inline void put_uint(bytes_t& out, uint32_t field, uint64_t v)
+{
+    put_key(out, field, 0);
+    put_varint(out, v);
+}
+
+inline void put_sint(bytes_t& out, uint32_t field, int64_t v)
+{
+    put_uint(out, field, zigzag(v));
+}
+
+inline void put_bytes(bytes_t& out, uint32_t field, const bytes_t& payload)
+{
+    put_key(out, field, 2);
+    put_varint(out, payload.size());
+    out += payload;
+}
+
+inline bytes_t packed_uint(const std::vector<uint64_t>& values)
+{
+    bytes_t out;
+    for (auto v : values) put_varint(out, v);
+    return out;
+}
+
+inline bytes_t packed_delta(const std::vector<int64_t>& values)
+{
+    bytes_t out;
+    int64_t previous = 0;
+    for (auto v : values)
+    {
+        put_varint(out, zigzag(v - previous));
+        previous = v;
+    }
+    return out;
+}
+
+struct tag
+{
+    std::string key;
+    std::string value;
+};
+
+struct node
+{
+    int64_t id = 0;
+    int64_t lat = 0; // in granularity units
+    int64_t lon = 0;
+    std::vector<tag> tags;
+    int32_t version = 0;
+    int64_t timestamp = 0; // in date_granularity units
+    int64_t changeset = 0;
+};
+
+struct way
+{
+    int64_t id = 0;
+    std::vector<int64_t> refs;
+    std::vector<tag> tags;
+    int32_t version = 0;
+    int64_t timestamp = 0;
+    int64_t changeset = 0;
+};
+
+struct member
+{
+    uint8_t type = 0;
+    int64_t id = 0;
+    std::string role;
+};
+
+struct relation
+{
+    int64_t id = 0;
+    std::vector<member> members;
+    std::vector<tag> tags;
+    int32_t version = 0;
+    int64_t timestamp = 0;
+    int64_t changeset = 0;
+};
+
+inline node make_node(int64_t id, int64_t lat = 0, int64_t lon = 0, std::vector<tag> tags = {})
+{
+    node n;
+    n.id = id;
+    n.lat = lat;
+    n.lon = lon;
+    n.tags = std::move(tags);
+    return n;
+}
+
+inline way make_way(int64_t id, std::vector<int64_t> refs, std::vector<tag> tags = {})
+{
+    way w;
+    w.id = id;
+    w.refs = std::move(refs);
+    w.tags = std::move(tags);
+    return w;
+}
+
+inline relation make_relation(int64_t id, std::vector<member> members, std::vector<tag> tags = {})
+{
+    relation r;
+    r.id = id;
+    r.members = std::move(members);
+    r.tags = std::move(tags);
+    return r;
+}
+
+// zstd and lz4 only when the tests are built with INPUTOSM_WITH_ZSTD / INPUTOSM_WITH_LZ4
+enum class compression
+{
+    raw,
+    zlib,
+    zstd,
+    lz4
+};
+
+// One PrimitiveBlock: its own string table plus one primitive group per entity kind present
+struct block
+{
+    std::vector<node> nodes;
+    std::vector<way> ways;
+    std::vector<relation> relations;
+    int32_t granularity = 100;
+    int64_t lat_offset = 0;
+    int64_t lon_offset = 0;
+    int32_t date_granularity = 1000;
+};
+
+class string_table
+{
+public:
+    string_table() { strings_.emplace_back(); }
+
+    uint64_t index(const std::string& s)
+    {
+        for (size_t i = 1; i < strings_.size(); i++)
+            if (strings_[i] == s) return i;
+        strings_.push_back(s);
+        return strings_.size() - 1;
+    }
+
+    bytes_t encode() const
+    {
+        bytes_t out;
+        for (const auto& s : strings_) put_bytes(out, 1, s);
+        return out;
+    }
+
+private:
+    std::vector<std::string> strings_;
+};
+
+inline bytes_t encode_info(int32_t version, int64_t timestamp, int64_t changeset)
+{
+    bytes_t out;
+    put_uint(out, 1, version);
+    put_uint(out, 2, timestamp);
+    put_uint(out, 3, changeset);
+    return out;
+}
+
+inline bytes_t encode_block(const block& b)
+{
+    string_table st;
+    bytes_t groups;
+    if (!b.nodes.empty())
+    {
+        std::vector<int64_t> ids, lats, lons, timestamps, changesets;
+        std::vector<uint64_t> versions, keys_vals;
+        bool any_tags = false;
+        for (const auto& n : b.nodes)
+        {
+            ids.push_back(n.id);
+            lats.push_back(n.lat);
+            lons.push_back(n.lon);
+            versions.push_back(n.version);
+            timestamps.push_back(n.timestamp);
+            changesets.push_back(n.changeset);
+            for (const auto& t : n.tags)
+            {
+                keys_vals.push_back(st.index(t.key));
+                keys_vals.push_back(st.index(t.value));
+                any_tags = true;
+            }
+            keys_vals.push_back(0);
+        }
+        bytes_t dense_info;
+        put_bytes(dense_info, 1, packed_uint(versions));
+        put_bytes(dense_info, 2, packed_delta(timestamps));
+        put_bytes(dense_info, 3, packed_delta(changesets));
+        bytes_t dense;
+        put_bytes(dense, 1, packed_delta(ids));
+        put_bytes(dense, 5, dense_info);
+        put_bytes(dense, 8, packed_delta(lats));
+        put_bytes(dense, 9, packed_delta(lons));
+        if (any_tags) put_bytes(dense, 10, packed_uint(keys_vals));
+        bytes_t group;
+        put_bytes(group, 2, dense);
+        put_bytes(groups, 2, group);
+    }
+    if (!b.ways.empty())
+    {
+        bytes_t group;
+        for (const auto& w : b.ways)
+        {
+            std::vector<uint64_t> keys, vals;
+            for (const auto& t : w.tags)
+            {
+                keys.push_back(st.index(t.key));
+                vals.push_back(st.index(t.value));
+            }
+            bytes_t way;
+            put_uint(way, 1, w.id);
+            if (!keys.empty())
+            {
+                put_bytes(way, 2, packed_uint(keys));
+                put_bytes(way, 3, packed_uint(vals));
+            }
+            put_bytes(way, 4, encode_info(w.version, w.timestamp, w.changeset));
+            if (!w.refs.empty()) put_bytes(way, 8, packed_delta(w.refs));
+            put_bytes(group, 3, way);
+        }
+        put_bytes(groups, 2, group);
+    }
+    if (!b.relations.empty())
+    {
+        bytes_t group;
+        for (const auto& r : b.relations)
+        {
+            std::vector<uint64_t> keys, vals, roles, types;
+            std::vector<int64_t> ids;
+            for (const auto& t : r.tags)
+            {
+                keys.push_back(st.index(t.key));
+                vals.push_back(st.index(t.value));
+            }
+            for (const auto& m : r.members)
+            {
+                roles.push_back(st.index(m.role));
+                ids.push_back(m.id);
+                types.push_back(m.type);
+            }
+            bytes_t relation;
+            put_uint(relation, 1, r.id);
+            if (!keys.empty())
+            {
+                put_bytes(relation, 2, packed_uint(keys));
+                put_bytes(relation, 3, packed_uint(vals));
+            }
+            put_bytes(relation, 4, encode_info(r.version, r.timestamp, r.changeset));
+            if (!r.members.empty())
+            {
+                put_bytes(relation, 8, packed_uint(roles));
+                put_bytes(relation, 9, packed_delta(ids));
+                put_bytes(relation, 10, packed_uint(types));
+            }
+            put_bytes(group, 4, relation);
+        }
+        put_bytes(groups, 2, group);
+    }
+    bytes_t out;
+    put_bytes(out, 1, st.encode());
+    out += groups;
+    if (b.granularity != 100) put_uint(out, 17, b.granularity);
+    if (b.date_granularity != 1000) put_uint(out, 18, b.date_granularity);
+    if (b.lat_offset) put_uint(out, 19, b.lat_offset);
+    if (b.lon_offset) put_uint(out, 20, b.lon_offset);
+    return out;
+}
+
+inline bytes_t encode_blob(const bytes_t& payload, compression c)
+{
+    bytes_t blob;
+    if (c == compression::raw)
+    {
+        put_bytes(blob, 1, payload);
+        return blob;
+    }
+    bytes_t zipped;
+    uint32_t field = 3;
+    switch (c)
+    {
+        case compression::zstd:
+#ifdef INPUTOSM_HAVE_ZSTD
+            zipped.resize(ZSTD_compressBound(payload.size()));
+            zipped.resize(ZSTD_compress(zipped.data(), zipped.size(), payload.data(), payload.size(), 3));
+            field = 7;
+#endif
+            break;
+        case compression::lz4:
+#ifdef INPUTOSM_HAVE_LZ4
+            zipped.resize(LZ4_compressBound(static_cast<int>(payload.size())));
+            zipped.resize(LZ4_compress_default(
+                payload.data(), zipped.data(), static_cast<int>(payload.size()), static_cast<int>(zipped.size())));
+            field = 6;
+#endif
+            break;
+        default:
+        {
+            uLongf zip_size = compressBound(payload.size());
+            zipped.resize(zip_size);
+            compress(reinterpret_cast<Bytef*>(zipped.data()),
+                     &zip_size,
+                     reinterpret_cast<const Bytef*>(payload.data()),
+                     payload.size());
+            zipped.resize(zip_size);
+        }
+    }
+    put_uint(blob, 2, payload.size());
+    put_bytes(blob, field, zipped);
+    return blob;
+}
+
+// Blob holding data under any Blob field, e.g. 4 (lzma) or 7 (zstd)
+inline bytes_t encode_blob_field(uint32_t field, const bytes_t& data, size_t raw_size)
+{
+    bytes_t blob;
+    put_uint(blob, 2, raw_size);
+    put_bytes(blob, field, data);
+    return blob;
+}
+
+inline void append_fileblock(bytes_t& file, const char* type, const bytes_t& blob)
+{
+    bytes_t header;
+    put_bytes(header, 1, type);
+    put_uint(header, 3, blob.size());
+    const auto size = static_cast<uint32_t>(header.size());
+    file.push_back(static_cast<char>(size >> 24));
+    file.push_back(static_cast<char>(size >> 16));
+    file.push_back(static_cast<char>(size >> 8));
+    file.push_back(static_cast<char>(size));
+    file += header;
+    file += blob;
+}
+
+inline bytes_t encode_file(const std::vector<block>& blocks, compression c = compression::zlib)
+{
+    bytes_t header_block;
+    put_bytes(header_block, 4, std::string("OsmSchema-V0.6"));
+    put_bytes(header_block, 4, std::string("DenseNodes"));
+    bytes_t file;
+    append_fileblock(file, "OSMHeader", encode_blob(header_block, c));
+    for (const auto& b : blocks) append_fileblock(file, "OSMData", encode_blob(encode_block(b), c));
+    return file;
+}
+
+inline bool write_file(const std::filesystem::path& path, const bytes_t& content)
+{
+    FILE* f = fopen(path.string().c_str(), "wb");
+    if (!f) return false;
+    const bool ok = fwrite(content.data(), 1, content.size(), f) == content.size();
+    fclose(f);
+    return ok;
+}
+
+// block_count blocks, block b holding the ids first_id + b * ids_per_block .. first_id + (b + 1) * ids_per_block - 1;
+// fill adds the entities of one id to its block
+inline std::vector<block> make_blocks(int block_count,
+                                      int64_t ids_per_block,
+                                      const std::function<void(block&, int64_t id)>& fill,
+                                      int64_t first_id = 1)
+{
+    std::vector<block> blocks(block_count);
+    for (int b = 0; b < block_count; b++)
+        for (int64_t id = first_id + b * ids_per_block; id < first_id + (b + 1) * ids_per_block; id++)
+            fill(blocks[b], id);
+    return blocks;
+}
+
+// the XML elements of the entities of blocks: all nodes, then all ways, then all relations, with their tags and the
+// metadata that is set
+inline void write_entities(std::ostream& out, const std::vector<block>& blocks, const std::string& indent = " ")
+{
+    auto escape = [](const std::string& text) {
+        std::string escaped;
+        for (char c : text)
+        {
+            switch (c)
+            {
+                case '&':
+                    escaped += "&amp;";
+                    break;
+                case '<':
+                    escaped += "&lt;";
+                    break;
+                case '>':
+                    escaped += "&gt;";
+                    break;
+                case '"':
+                    escaped += "&quot;";
+                    break;
+                default:
+                    escaped += c;
+            }
+        }
+        return escaped;
+    };
+    auto write_metadata = [&out](const block& b, int32_t version, int64_t timestamp, int64_t changeset) {
+        if (version) out << " version=\"" << version << "\"";
+        if (timestamp)
+        {
+            const time_t seconds = static_cast<time_t>(timestamp * b.date_granularity / 1000);
+            tm utc{};
+            gmtime_r(&seconds, &utc);
+            char text[32];
+            strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+            out << " timestamp=\"" << text << "\"";
+        }
+        if (changeset) out << " changeset=\"" << changeset << "\"";
+    };
+    auto write_tags = [&](const std::vector<tag>& tags) {
+        for (const auto& t : tags)
+            out << indent << " <tag k=\"" << escape(t.key) << "\" v=\"" << escape(t.value) << "\"/>\n";
+    };
+    for (const auto& b : blocks)
+    {
+        for (const auto& n : b.nodes)
+        {
+            // nanodegrees, printed with the 1e-7 degree precision of the readers
+            char coordinates[64];
+            snprintf(coordinates,
+                     sizeof(coordinates),
+                     "lat=\"%.7f\" lon=\"%.7f\"",
+                     (b.lat_offset + n.lat * b.granularity) * 1e-9,
+                     (b.lon_offset + n.lon * b.granularity) * 1e-9);
+            out << indent << "<node id=\"" << n.id << "\" " << coordinates;
+            write_metadata(b, n.version, n.timestamp, n.changeset);
+            out << ">\n";
+            write_tags(n.tags);
+            out << indent << "</node>\n";
+        }
+    }
+    for (const auto& b : blocks)
+    {
+        for (const auto& w : b.ways)
+        {
+            out << indent << "<way id=\"" << w.id << "\"";
+            write_metadata(b, w.version, w.timestamp, w.changeset);
+            out << ">\n";
+            for (int64_t ref : w.refs) out << indent << " <nd ref=\"" << ref << "\"/>\n";
+            write_tags(w.tags);
+            out << indent << "</way>\n";
+        }
+    }
+    static const char* const member_types[] = {"node", "way", "relation"};
+    for (const auto& b : blocks)
+    {
+        for (const auto& r : b.relations)
+        {
+            out << indent << "<relation id=\"" << r.id << "\"";
+            write_metadata(b, r.version, r.timestamp, r.changeset);
+            out << ">\n";
+            for (const auto& m : r.members)
+                out << indent << " <member type=\"" << member_types[m.type] << "\" ref=\"" << m.id << "\" role=\""
+                    << escape(m.role) << "\"/>\n";
+            write_tags(r.tags);
+            out << indent << "</relation>\n";
+        }
+    }
+}
+
+// an OSM XML file with the same entities as encode_file(blocks)
+inline bool write_xml(const std::filesystem::path& path, const std::vector<block>& blocks)
+{
+    std::ofstream out(path);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm version=\"0.6\">\n";
+    write_entities(out, blocks);
+    out << "</osm>\n";
+    return bool(out);
+}
+
+// an OSC file with the entities of blocks in one section, action is "create", "modify" or "delete"
+inline bool write_osc(const std::filesystem::path& path, const std::vector<block>& blocks, const char* action)
+{
+    std::ofstream out(path);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osmChange version=\"0.6\">\n <" << action << ">\n";
+    write_entities(out, blocks, "  ");
+    out << " </" << action << ">\n</osmChange>\n";
+    return bool(out);
+}
+
+} // namespace pbf_writer
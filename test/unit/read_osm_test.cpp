@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <string>
@@ -327,5 +328,167 @@ int main()
         return EXIT_FAILURE;
     }
 
+    // the columnar API delivers the same nodes
+    std::vector<NodeData> column_nodes;
+    const bool columnar_ok = input_osm::input_file_columnar(
+        data_path.string().c_str(),
+        true,
+        [&column_nodes](const input_osm::node_columns_t& batch) {
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                NodeData& copy = column_nodes.emplace_back();
+                copy.id = batch.id[i];
+                copy.raw_latitude = batch.raw_latitude[i];
+                copy.raw_longitude = batch.raw_longitude[i];
+                copy.version = static_cast<int32_t>(batch.version[i]);
+                copy.timestamp = static_cast<int32_t>(batch.timestamp[i]);
+                copy.changeset = static_cast<int32_t>(batch.changeset[i]);
+                if (batch.tag_offsets.empty()) continue;
+                for (uint32_t t = batch.tag_offsets[i]; t < batch.tag_offsets[i + 1]; t++)
+                    copy.tags.emplace(batch.tags[t].key, batch.tags[t].value);
+            }
+            return true;
+        },
+        nullptr,
+        nullptr);
+    if (!columnar_ok || column_nodes.size() != nodes.size() ||
+        !std::equal(nodes.begin(), nodes.end(), column_nodes.begin(), [](const NodeData& a, const NodeData& b) {
+            return a.id == b.id && a.raw_latitude == b.raw_latitude && a.raw_longitude == b.raw_longitude &&
+                   a.version == b.version && a.timestamp == b.timestamp && a.changeset == b.changeset &&
+                   a.tags == b.tags;
+        }))
+    {
+        std::cerr << "Columnar nodes differ" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // the compact layout delivers the same nodes without metadata
+    std::vector<NodeData> compact_nodes;
+    const bool compact_ok = input_osm::input_file_as<input_osm::compact_node_t>(
+        data_path.string().c_str(),
+        true,
+        [&compact_nodes](input_osm::span_t<input_osm::compact_node_t> batch) {
+            for (const auto& node : batch)
+            {
+                NodeData& copy = compact_nodes.emplace_back();
+                copy.id = node.id;
+                copy.raw_latitude = node.raw_latitude;
+                copy.raw_longitude = node.raw_longitude;
+                for (const auto& tag : node.tags) copy.tags.emplace(tag.key, tag.value);
+            }
+            return true;
+        },
+        nullptr,
+        nullptr);
+    if (!compact_ok || compact_nodes.size() != nodes.size() ||
+        !std::equal(nodes.begin(), nodes.end(), compact_nodes.begin(), [](const NodeData& a, const NodeData& b) {
+            return a.id == b.id && a.raw_latitude == b.raw_latitude && a.raw_longitude == b.raw_longitude &&
+                   a.tags == b.tags;
+        }))
+    {
+        std::cerr << "Compact nodes differ" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // larger files arrive in batches; tags stay attached to their entity across batches and filtered entities
+    const auto batch_path = std::filesystem::temp_directory_path() / "inputosm_read_osm_test_batches.osm";
+    {
+        std::ofstream out(batch_path);
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm version=\"0.6\">\n";
+        for (int id = 1; id <= 20000; id++)
+        {
+            out << " <node id=\"" << id << "\" lat=\"1.0\" lon=\"2.0\" timestamp=\"2021-03-04T05:06:07Z\">\n";
+            out << "  <tag k=\"ref\" v=\"" << id << "\"/>\n";
+            if (id % 3) out << "  <tag k=\"amenity\" v=\"bench\"/>\n";
+            out << " </node>\n";
+        }
+        out << " <way id=\"1\">\n  <nd ref=\"1\"/>\n  <nd ref=\"2\"/>\n </way>\n</osm>\n";
+    }
+    input_osm::set_tag_filter(input_osm::tag_filter_t::has_key("amenity"), input_osm::ENTITY_NODES);
+    size_t batches = 0, batched_nodes = 0, largest_batch = 0;
+    bool batch_ok = true;
+    const bool batches_ok = input_osm::input_file(
+        batch_path.string().c_str(),
+        true,
+        [&](input_osm::span_t<input_osm::node_t> batch) {
+            batches++;
+            batched_nodes += batch.size();
+            largest_batch = std::max(largest_batch, batch.size());
+            for (const auto& node : batch)
+                batch_ok = batch_ok && node.id % 3 && node.tags.size() == 2 &&
+                           std::string(node.tags[0].value) == std::to_string(node.id) &&
+                           node.timestamp == 1614834367;
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::way_t> batch) {
+            batch_ok = batch_ok && batch.size() == 1 && batch[0].node_refs.size() == 2 && batch[0].node_refs[1] == 2;
+            return true;
+        },
+        nullptr);
+    input_osm::set_tag_filter(input_osm::tag_filter_t());
+    std::filesystem::remove(batch_path);
+    if (!batches_ok || !batch_ok || batched_nodes != 13334 || batches < 2 || largest_batch < 2)
+    {
+        std::cerr << "Unexpected XML batches" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // coordinates are rounded to 1e-7 degrees: 0.0000003 is 2.9999999999999996e-7 as a double
+    const auto coordinates_path = std::filesystem::temp_directory_path() / "inputosm_read_osm_test_coordinates.osm";
+    {
+        std::ofstream out(coordinates_path);
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm version=\"0.6\">\n";
+        out << " <node id=\"1\" lat=\"0.0000003\" lon=\"-0.0000003\"/>\n";
+        out << " <node id=\"2\" lat=\"-89.9999999\" lon=\"179.9999999\"/>\n</osm>\n";
+    }
+    std::vector<NodeData> rounded_nodes;
+    const bool coordinates_ok = input_osm::input_file(
+        coordinates_path.string().c_str(),
+        false,
+        [&rounded_nodes](input_osm::span_t<input_osm::node_t> batch) {
+            for (const auto& node : batch)
+            {
+                NodeData& copy = rounded_nodes.emplace_back();
+                copy.raw_latitude = node.raw_latitude;
+                copy.raw_longitude = node.raw_longitude;
+            }
+            return true;
+        },
+        nullptr,
+        nullptr);
+    std::filesystem::remove(coordinates_path);
+    if (!coordinates_ok || rounded_nodes.size() != 2 || rounded_nodes[0].raw_latitude != 3 ||
+        rounded_nodes[0].raw_longitude != -3 || rounded_nodes[1].raw_latitude != -899999999 ||
+        rounded_nodes[1].raw_longitude != 1799999999)
+    {
+        std::cerr << "XML coordinates not rounded" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // a parse error fails the read, the entities of the unfinished batch are not delivered
+    const auto broken_path = std::filesystem::temp_directory_path() / "inputosm_read_osm_test_broken.osm";
+    {
+        std::ofstream out(broken_path);
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm version=\"0.6\">\n";
+        for (int id = 1; id <= 10; id++) out << " <node id=\"" << id << "\" lat=\"1.0\" lon=\"2.0\"/>\n";
+        out << " <node id=\"11\" lat=\"1.0\" lon=\"2.0\">\n</osm>\n";
+    }
+    size_t broken_nodes = 0;
+    const bool broken_ok = input_osm::input_file(
+        broken_path.string().c_str(),
+        false,
+        [&broken_nodes](input_osm::span_t<input_osm::node_t> batch) {
+            broken_nodes += batch.size();
+            return true;
+        },
+        nullptr,
+        nullptr);
+    std::filesystem::remove(broken_path);
+    if (broken_ok || broken_nodes || input_osm::stop_reason() != input_osm::stop_reason_t::error)
+    {
+        std::cerr << "Nodes delivered from a broken XML file" << '\n';
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
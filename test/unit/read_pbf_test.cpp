@@ -0,0 +1,619 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr int k_block_count = 40;
+constexpr int k_nodes_per_block = 100;
+
+// nodes with metadata and a few tags, each block closed by a way over its last three nodes and a route relation
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_nodes_per_block, [](pbf_writer::block& block, int64_t id) {
+        const int64_t i = (id - 1) % k_nodes_per_block, b = (id - 1) / k_nodes_per_block;
+        pbf_writer::node& n = block.nodes.emplace_back(pbf_writer::make_node(id, id * 10, -id * 20));
+        n.version = static_cast<int32_t>(1 + i % 3);
+        n.timestamp = 1600000000 + id;
+        n.changeset = 1000 + id;
+        if (i % 10 == 0) n.tags = {{"amenity", "cafe"}, {"name", "node " + std::to_string(id)}};
+        if (i + 1 < k_nodes_per_block) return;
+        pbf_writer::way& w = block.ways.emplace_back(
+            pbf_writer::make_way(100000 + b, {id - 2, id - 1, id}, {{"highway", "residential"}}));
+        w.version = 2;
+        w.timestamp = 1600000000;
+        w.changeset = 77;
+        block.relations.push_back(
+            pbf_writer::make_relation(200000 + b, {{0, id, "stop"}, {1, w.id, "route"}}, {{"type", "route"}}));
+    });
+}
+
+bool check_file(const std::filesystem::path& path, bool decode_metadata)
+{
+    std::mutex mtx;
+    std::vector<int64_t> node_ids;
+    std::vector<int64_t> way_ids;
+    std::vector<int64_t> relation_ids;
+    std::atomic<bool> ok{true};
+    auto fail = [&ok](const std::string& message) {
+        std::cerr << message << '\n';
+        ok = false;
+        return false;
+    };
+
+    const bool parse_ok = input_osm::input_file(
+        path.string().c_str(),
+        decode_metadata,
+        [&](input_osm::span_t<input_osm::node_t> batch) {
+            if (batch.size() != k_nodes_per_block) return fail("Unexpected node batch size");
+            for (const auto& n : batch)
+            {
+                if (n.raw_latitude != n.id * 10 || n.raw_longitude != -n.id * 20) return fail("Unexpected coordinates");
+                if (input_osm::block_index != static_cast<size_t>((n.id - 1) / k_nodes_per_block + 1))
+                    return fail("Unexpected block index");
+                if (decode_metadata && (n.timestamp != 1600000000 + n.id || n.changeset != 1000 + n.id))
+                    return fail("Unexpected node metadata");
+                if (!decode_metadata && (n.timestamp || n.changeset || n.version))
+                    return fail("Node metadata decoded without request");
+                const size_t expected_tags = ((n.id - 1) % k_nodes_per_block) % 10 == 0 ? 2 : 0;
+                if (n.tags.size() != expected_tags) return fail("Unexpected node tag count");
+                if (expected_tags && (std::string(n.tags[1].value) != "node " + std::to_string(n.id)))
+                    return fail("Unexpected node tag value");
+                for (const auto& tag : n.tags)
+                    if (tag.key_length != strlen(tag.key) || tag.value_length != strlen(tag.value))
+                        return fail("Unexpected node tag length");
+            }
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& n : batch) node_ids.push_back(n.id);
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::way_t> batch) {
+            for (const auto& w : batch)
+            {
+                const int64_t last = (w.id - 100000 + 1) * k_nodes_per_block;
+                if (w.node_refs.size() != 3 || w.node_refs[0] != last - 2 || w.node_refs[2] != last)
+                    return fail("Unexpected way node refs");
+                if (w.tags.size() != 1 || std::string(w.tags[0].key) != "highway" || w.tags[0].key_length != 7 ||
+                    w.tags[0].value_length != 11)
+                    return fail("Unexpected way tags");
+                if (decode_metadata && (w.version != 2 || w.changeset != 77)) return fail("Unexpected way metadata");
+            }
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& w : batch) way_ids.push_back(w.id);
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::relation_t> batch) {
+            for (const auto& r : batch)
+            {
+                if (r.members.size() != 2 || std::string(r.members[0].role) != "stop" || r.members[1].type != 1 ||
+                    r.members[1].id != 100000 + (r.id - 200000))
+                    return fail("Unexpected relation members");
+            }
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& r : batch) relation_ids.push_back(r.id);
+            return true;
+        });
+
+    if (!parse_ok) return fail("input_file returned failure");
+    if (!ok) return false;
+
+    std::sort(node_ids.begin(), node_ids.end());
+    if (node_ids.size() != k_block_count * k_nodes_per_block) return fail("Missing nodes");
+    for (size_t i = 0; i < node_ids.size(); i++)
+        if (node_ids[i] != static_cast<int64_t>(i + 1)) return fail("Node ids not delivered exactly once");
+    if (way_ids.size() != k_block_count || relation_ids.size() != k_block_count) return fail("Missing ways/relations");
+    return true;
+}
+// the columnar API delivers the same nodes as check_file expects
+bool check_columnar(const std::filesystem::path& path, bool decode_metadata)
+{
+    std::mutex mtx;
+    std::vector<int64_t> node_ids;
+    bool ok = true;
+    const bool parse_ok = input_osm::input_file_columnar(
+        path.string().c_str(),
+        decode_metadata,
+        [&](const input_osm::node_columns_t& batch) {
+            bool batch_ok = batch.size() == k_nodes_per_block && batch.raw_latitude.size() == batch.size() &&
+                            batch.raw_longitude.size() == batch.size() &&
+                            batch.tag_offsets.size() == batch.size() + 1 &&
+                            batch.version.size() == (decode_metadata ? batch.size() : 0);
+            for (size_t i = 0; batch_ok && i < batch.size(); i++)
+            {
+                const int64_t id = batch.id[i];
+                const size_t expected_tags = ((id - 1) % k_nodes_per_block) % 10 == 0 ? 2 : 0;
+                batch_ok = batch.raw_latitude[i] == id * 10 && batch.raw_longitude[i] == -id * 20 &&
+                           batch.tag_offsets[i + 1] - batch.tag_offsets[i] == expected_tags &&
+                           (!expected_tags || std::string(batch.tags[batch.tag_offsets[i] + 1].value) ==
+                                                  "node " + std::to_string(id)) &&
+                           (!decode_metadata ||
+                            (batch.timestamp[i] == 1600000000 + id && batch.changeset[i] == 1000 + id &&
+                             batch.version[i] == uint64_t(1 + (id - 1) % k_nodes_per_block % 3)));
+            }
+            std::lock_guard<std::mutex> lck(mtx);
+            ok = ok && batch_ok;
+            node_ids.insert(node_ids.end(), batch.id.begin(), batch.id.end());
+            return true;
+        },
+        nullptr,
+        nullptr);
+    std::sort(node_ids.begin(), node_ids.end());
+    if (!parse_ok || !ok || node_ids.size() != k_block_count * k_nodes_per_block ||
+        node_ids.back() != k_block_count * k_nodes_per_block)
+    {
+        std::cerr << "Unexpected columnar nodes\n";
+        return false;
+    }
+    return true;
+}
+// the compact layout delivers the same nodes as check_file expects, without metadata
+bool check_compact(const std::filesystem::path& path)
+{
+    std::mutex mtx;
+    std::vector<int64_t> node_ids;
+    bool ok = true;
+    const bool parse_ok = input_osm::input_file_as<input_osm::compact_node_t>(
+        path.string().c_str(),
+        true,
+        [&](input_osm::span_t<input_osm::compact_node_t> batch) {
+            bool batch_ok = batch.size() == k_nodes_per_block;
+            for (const auto& n : batch)
+            {
+                const size_t expected_tags = ((n.id - 1) % k_nodes_per_block) % 10 == 0 ? 2 : 0;
+                batch_ok = batch_ok && n.raw_latitude == n.id * 10 && n.raw_longitude == -n.id * 20 &&
+                           n.tags.size() == expected_tags &&
+                           (!expected_tags || std::string(n.tags[1].value) == "node " + std::to_string(n.id));
+            }
+            std::lock_guard<std::mutex> lck(mtx);
+            ok = ok && batch_ok;
+            for (const auto& n : batch) node_ids.push_back(n.id);
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::way_t> batch) {
+            // decode_metadata still applies to ways
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& w : batch) ok = ok && w.version == 2 && w.changeset == 77;
+            return true;
+        },
+        nullptr);
+    std::sort(node_ids.begin(), node_ids.end());
+    if (!parse_ok || !ok || node_ids.size() != k_block_count * k_nodes_per_block ||
+        node_ids.back() != k_block_count * k_nodes_per_block)
+    {
+        std::cerr << "Unexpected compact nodes\n";
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto zlib_path = dir / "inputosm_read_pbf_test_zlib.osm.pbf";
+    const auto raw_path = dir / "inputosm_read_pbf_test_raw.osm.pbf";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(zlib_path, pbf_writer::encode_file(blocks, pbf_writer::compression::zlib)) ||
+        !pbf_writer::write_file(raw_path, pbf_writer::encode_file(blocks, pbf_writer::compression::raw)))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    for (auto scheduler :
+         {input_osm::scheduler_t::queue, input_osm::scheduler_t::work_stealing, input_osm::scheduler_t::largest_first})
+    {
+        input_osm::set_scheduler(scheduler);
+        for (size_t threads : {size_t{1}, size_t{4}})
+        {
+            input_osm::set_thread_count(threads);
+            ok = ok && check_file(zlib_path, true);
+            // one idle time per worker of a multi-threaded read
+            const size_t idle_times = input_osm::decode_statistics().idle_seconds.size();
+            if (idle_times != (input_osm::thread_count() > 1 ? input_osm::thread_count() : 0))
+            {
+                std::cerr << "Unexpected idle times: " << idle_times << "\n";
+                ok = false;
+            }
+            ok = ok && check_file(zlib_path, false);
+            ok = ok && check_file(raw_path, true);
+            ok = ok && check_columnar(zlib_path, true);
+            ok = ok && check_columnar(raw_path, false);
+            ok = ok && check_compact(zlib_path);
+        }
+    }
+
+    // every built in decompressor inflates the same blocks, unavailable ones are rejected
+    const auto default_decompressor = input_osm::decompressor();
+    for (auto decompressor : {input_osm::decompressor_t::zlib,
+                              input_osm::decompressor_t::zlib_ng,
+                              input_osm::decompressor_t::libdeflate,
+                              input_osm::decompressor_t::isal})
+    {
+        if (input_osm::set_decompressor(decompressor) != input_osm::decompressor_available(decompressor))
+        {
+            std::cerr << "Unexpected set_decompressor result\n";
+            ok = false;
+        }
+        if (!input_osm::decompressor_available(decompressor)) continue;
+        for (size_t threads : {size_t{1}, size_t{4}})
+        {
+            input_osm::set_thread_count(threads);
+            ok = ok && check_file(zlib_path, true);
+        }
+    }
+    input_osm::set_decompressor(default_decompressor);
+
+    // the decompressor is an option of its reader
+    {
+        input_osm::reader_t reader;
+        if (!reader.set_decompressor(input_osm::decompressor_t::zlib) ||
+            reader.decompressor() != input_osm::decompressor_t::zlib ||
+            input_osm::decompressor() != default_decompressor)
+        {
+            std::cerr << "Decompressor shared between readers\n";
+            ok = false;
+        }
+        size_t nodes = 0;
+        if (!reader.input_file(
+                zlib_path.string().c_str(),
+                false,
+                [&nodes](input_osm::span_t<input_osm::node_t> batch) {
+                    nodes += batch.size();
+                    return true;
+                },
+                nullptr,
+                nullptr) ||
+            !nodes)
+        {
+            std::cerr << "Read with the reader's decompressor failed\n";
+            ok = false;
+        }
+    }
+
+    // ordered delivery: block indices reach the handlers in ascending order
+    input_osm::set_ordered_delivery(true);
+    for (size_t threads : {size_t{1}, size_t{4}})
+    {
+        input_osm::set_thread_count(threads);
+        ok = ok && check_file(zlib_path, true);
+        std::vector<size_t> delivered;
+        ok = ok && input_osm::input_file(
+                       zlib_path.string().c_str(),
+                       false,
+                       [&delivered](input_osm::span_t<input_osm::node_t>) {
+                           delivered.push_back(input_osm::block_index);
+                           return true;
+                       },
+                       nullptr,
+                       [&delivered](input_osm::span_t<input_osm::relation_t> batch) {
+                           if (!batch.empty()) delivered.push_back(input_osm::block_index);
+                           return true;
+                       });
+        if (delivered.size() != 2 * k_block_count || !std::is_sorted(delivered.begin(), delivered.end()))
+        {
+            std::cerr << "Ordered delivery out of order\n";
+            ok = false;
+        }
+    }
+    input_osm::set_ordered_delivery(false);
+
+    // projection: fields left out stay empty
+    input_osm::set_thread_count(4);
+    input_osm::set_projection(input_osm::ENTITY_ALL, input_osm::PROJECT_ID);
+    input_osm::set_projection(input_osm::ENTITY_NODES, input_osm::PROJECT_COORDINATES | input_osm::PROJECT_VERSION);
+    {
+        std::atomic<size_t> nodes{0}, ways{0}, relations{0};
+        std::atomic<bool> projected{true};
+        ok = ok && input_osm::input_file(
+                       zlib_path.string().c_str(),
+                       true,
+                       [&](input_osm::span_t<input_osm::node_t> batch) {
+                           for (const auto& n : batch)
+                               if (n.raw_latitude != n.id * 10 || !n.version || n.timestamp || n.changeset ||
+                                   !n.tags.empty())
+                                   projected = false;
+                           nodes += batch.size();
+                           return true;
+                       },
+                       [&](input_osm::span_t<input_osm::way_t> batch) {
+                           for (const auto& w : batch)
+                               if (!w.id || !w.node_refs.empty() || !w.tags.empty() || w.version) projected = false;
+                           ways += batch.size();
+                           return true;
+                       },
+                       [&](input_osm::span_t<input_osm::relation_t> batch) {
+                           for (const auto& r : batch)
+                               if (!r.id || !r.members.empty() || !r.tags.empty()) projected = false;
+                           relations += batch.size();
+                           return true;
+                       });
+        ok = ok && input_osm::input_file_columnar(
+                       raw_path.string().c_str(),
+                       true,
+                       [&](const input_osm::node_columns_t& batch) {
+                           if (batch.raw_latitude.size() != batch.size() || batch.version.size() != batch.size() ||
+                               !batch.timestamp.empty() || !batch.tag_offsets.empty() || !batch.tags.empty())
+                               projected = false;
+                           return true;
+                       },
+                       nullptr,
+                       nullptr);
+        input_osm::set_projection(input_osm::ENTITY_NODES, input_osm::PROJECT_ID);
+        ok = ok && input_osm::input_file_columnar(
+                       raw_path.string().c_str(),
+                       true,
+                       [&](const input_osm::node_columns_t& batch) {
+                           if (batch.size() != k_nodes_per_block || !batch.raw_latitude.empty() ||
+                               !batch.version.empty())
+                               projected = false;
+                           return true;
+                       },
+                       nullptr,
+                       nullptr);
+        if (!projected || nodes != k_block_count * k_nodes_per_block || ways != k_block_count ||
+            relations != k_block_count)
+        {
+            std::cerr << "Unexpected projected fields\n";
+            ok = false;
+        }
+    }
+    input_osm::set_projection(input_osm::ENTITY_ALL, input_osm::PROJECT_ALL);
+
+    // granularities and offsets are applied: fixed point 1e-7 degrees, seconds, and doubles on request
+    {
+        auto scaled_blocks = blocks;
+        for (int b = 0; b < k_block_count; b++)
+        {
+            auto& block = scaled_blocks[b];
+            if (b % 3 == 1)
+            {
+                // coarser than 1e-7 degrees, no division needed for the coordinates
+                block.granularity = 1000;
+                block.lat_offset = 5000;
+                block.lon_offset = -3000;
+                block.date_granularity = 500;
+            }
+            if (b % 3 == 2)
+            {
+                // odd granularity, millisecond timestamps
+                block.granularity = 123;
+                block.lat_offset = 77;
+                block.date_granularity = 1;
+            }
+            for (auto& n : block.nodes) n.timestamp = (1600000000 + n.id) * 1000 / block.date_granularity;
+            for (auto& w : block.ways) w.timestamp = int64_t{1600000000} * 1000 / block.date_granularity;
+        }
+        const auto scaled_path = dir / "inputosm_read_pbf_test_scaled.osm.pbf";
+        ok = ok && pbf_writer::write_file(scaled_path, pbf_writer::encode_file(scaled_blocks));
+        auto expected = [&scaled_blocks](int64_t id, int64_t raw, bool latitude) {
+            const auto& block = scaled_blocks[(id - 1) / k_nodes_per_block];
+            return ((latitude ? block.lat_offset : block.lon_offset) + block.granularity * raw) / 100;
+        };
+
+        std::atomic<bool> scaled{true};
+        std::atomic<size_t> nodes{0};
+        input_osm::set_projection(input_osm::ENTITY_NODES, input_osm::PROJECT_ALL | input_osm::PROJECT_DEGREES);
+        for (size_t threads : {size_t{1}, size_t{4}})
+        {
+            input_osm::set_thread_count(threads);
+            ok = ok && input_osm::input_file(
+                           scaled_path.string().c_str(),
+                           true,
+                           [&](input_osm::span_t<input_osm::node_t> batch) {
+                               for (const auto& n : batch)
+                                   if (n.raw_latitude != expected(n.id, n.id * 10, true) ||
+                                       n.raw_longitude != expected(n.id, -n.id * 20, false) ||
+                                       n.timestamp != 1600000000 + n.id)
+                                       scaled = false;
+                               nodes += batch.size();
+                               return true;
+                           },
+                           [&](input_osm::span_t<input_osm::way_t> batch) {
+                               for (const auto& w : batch)
+                                   if (w.timestamp != 1600000000) scaled = false;
+                               return true;
+                           },
+                           nullptr);
+            ok = ok && input_osm::input_file_columnar(
+                           scaled_path.string().c_str(),
+                           true,
+                           [&](const input_osm::node_columns_t& batch) {
+                               if (batch.latitude.size() != batch.size() || batch.longitude.size() != batch.size())
+                                   scaled = false;
+                               for (size_t i = 0; scaled && i < batch.size(); i++)
+                                   if (batch.raw_latitude[i] != expected(batch.id[i], batch.id[i] * 10, true) ||
+                                       batch.latitude[i] != double(batch.raw_latitude[i]) * 1e-7 ||
+                                       batch.longitude[i] != double(batch.raw_longitude[i]) * 1e-7 ||
+                                       batch.timestamp[i] != 1600000000 + batch.id[i])
+                                       scaled = false;
+                               nodes += batch.size();
+                               return true;
+                           },
+                           nullptr,
+                           nullptr);
+        }
+        input_osm::set_projection(input_osm::ENTITY_NODES, input_osm::PROJECT_ALL);
+        std::filesystem::remove(scaled_path);
+        if (!scaled || nodes != 4 * k_block_count * k_nodes_per_block)
+        {
+            std::cerr << "Granularity or offsets not applied\n";
+            ok = false;
+        }
+    }
+
+    // the coordinate range ends fit the 32 bit coordinates of compact_node_t
+    {
+        pbf_writer::block block;
+        int64_t id = 1;
+        for (int64_t lat : {-900000000, 900000000})
+            for (int64_t lon : {-1800000000, 1800000000})
+            {
+                pbf_writer::node n;
+                n.id = id++;
+                n.lat = lat;
+                n.lon = lon;
+                block.nodes.push_back(n);
+            }
+        const auto extremes_path = dir / "inputosm_read_pbf_test_extremes.osm.pbf";
+        ok = ok && pbf_writer::write_file(extremes_path, pbf_writer::encode_file({block}));
+        std::vector<input_osm::compact_node_t> extremes;
+        ok = ok && input_osm::input_file_as<input_osm::compact_node_t>(
+                       extremes_path.string().c_str(),
+                       false,
+                       [&extremes](input_osm::span_t<input_osm::compact_node_t> batch) {
+                           extremes.insert(extremes.end(), batch.begin(), batch.end());
+                           return true;
+                       },
+                       nullptr,
+                       nullptr);
+        std::filesystem::remove(extremes_path);
+        if (extremes.size() != 4 || extremes[0].raw_latitude != -900000000 ||
+            extremes[0].raw_longitude != -1800000000 || extremes[3].raw_latitude != 900000000 ||
+            extremes[3].raw_longitude != 1800000000)
+        {
+            std::cerr << "Compact coordinates out of range\n";
+            ok = false;
+        }
+    }
+
+    // zstd and lz4 blobs decode to the same blocks as zlib ones, when they are built in
+    std::vector<pbf_writer::compression> compressions;
+#ifdef INPUTOSM_HAVE_ZSTD
+    compressions.push_back(pbf_writer::compression::zstd);
+#endif
+#ifdef INPUTOSM_HAVE_LZ4
+    compressions.push_back(pbf_writer::compression::lz4);
+#endif
+    const auto compressed_path = dir / "inputosm_read_pbf_test_compressed.osm.pbf";
+    for (auto compression : compressions)
+    {
+        if (!pbf_writer::write_file(compressed_path, pbf_writer::encode_file(blocks, compression)))
+        {
+            std::cerr << "Failed to write the compressed fixture\n";
+            ok = false;
+            continue;
+        }
+        for (size_t threads : {size_t{1}, size_t{4}})
+        {
+            input_osm::set_thread_count(threads);
+            ok = ok && check_file(compressed_path, true);
+            ok = ok && check_columnar(compressed_path, false);
+        }
+    }
+    std::filesystem::remove(compressed_path);
+
+    // blobs this build cannot decompress fail the read instead of being skipped
+    const auto unsupported_path = dir / "inputosm_read_pbf_test_unsupported.osm.pbf";
+    for (uint32_t field : {4u, 5u, 6u, 7u})
+    {
+        pbf_writer::bytes_t file;
+        const auto payload = pbf_writer::encode_block(blocks.front());
+        pbf_writer::append_fileblock(
+            file, "OSMHeader", pbf_writer::encode_blob(pbf_writer::bytes_t(), pbf_writer::compression::raw));
+        pbf_writer::append_fileblock(
+            file, "OSMData", pbf_writer::encode_blob_field(field, "not compressed", payload.size()));
+        size_t nodes = 0;
+        if (!pbf_writer::write_file(unsupported_path, file) ||
+            input_osm::input_file(unsupported_path.string().c_str(),
+                                  false,
+                                  [&nodes](input_osm::span_t<input_osm::node_t> batch) {
+                                      nodes += batch.size();
+                                      return true;
+                                  },
+                                  nullptr,
+                                  nullptr) ||
+            nodes)
+        {
+            std::cerr << "Blob field " << field << " not reported as error\n";
+            ok = false;
+        }
+    }
+    std::filesystem::remove(unsupported_path);
+
+    // ways and relations larger than the initial decode buffers grow them in the middle of a group, the earlier
+    // entities of that group still see their own node refs, members and tags
+    const auto large_path = dir / "inputosm_read_pbf_test_large.osm.pbf";
+    {
+        pbf_writer::block block;
+        // "v" + std::to_string() trips a -Wrestrict false positive of gcc 12 in release builds
+        auto prefixed = [](char prefix, int64_t number) {
+            std::string s = std::to_string(number);
+            s.insert(0, 1, prefix);
+            return s;
+        };
+        for (int64_t w = 1; w <= 3; w++)
+        {
+            pbf_writer::way way;
+            way.id = w;
+            for (int64_t i = 0; i < 600000; i++) way.refs.push_back(w * 10000000 + i);
+            for (int i = 0; i < 100000; i++) way.tags.push_back({prefixed('k', i % 100), prefixed('v', w)});
+            block.ways.push_back(way);
+        }
+        for (int64_t r = 1; r <= 3; r++)
+        {
+            pbf_writer::relation relation;
+            relation.id = r;
+            for (int64_t i = 0; i < 100000; i++)
+                relation.members.push_back({2, r * 10000000 + i, prefixed('r', r)});
+            block.relations.push_back(relation);
+        }
+        size_t ways = 0, relations = 0;
+        input_osm::set_thread_count(1);
+        if (!pbf_writer::write_file(large_path, pbf_writer::encode_file({block})) ||
+            !input_osm::input_file(
+                large_path.string().c_str(),
+                false,
+                nullptr,
+                [&ways, &prefixed](input_osm::span_t<input_osm::way_t> batch) {
+                    for (const auto& w : batch)
+                    {
+                        const std::string value = prefixed('v', w.id);
+                        if (w.node_refs.size() == 600000 && w.node_refs[0] == w.id * 10000000 &&
+                            w.node_refs[599999] == w.id * 10000000 + 599999 && w.tags.size() == 100000 &&
+                            value == w.tags[0].value && value == w.tags[99999].value)
+                            ways++;
+                    }
+                    return true;
+                },
+                [&relations, &prefixed](input_osm::span_t<input_osm::relation_t> batch) {
+                    for (const auto& r : batch)
+                    {
+                        const std::string role = prefixed('r', r.id);
+                        if (r.members.size() == 100000 && r.members[0].id == r.id * 10000000 &&
+                            r.members[99999].id == r.id * 10000000 + 99999 && r.members[99999].type == 2 &&
+                            role == r.members[99999].role)
+                            relations++;
+                    }
+                    return true;
+                }) ||
+            ways != 3 || relations != 3)
+        {
+            std::cerr << "Large ways or relations not decoded\n";
+            ok = false;
+        }
+        const auto statistics = input_osm::decode_statistics();
+        if (statistics.blocks != 1 || statistics.groups != 2 || !statistics.buffer_grows)
+        {
+            std::cerr << "Unexpected decode statistics\n";
+            ok = false;
+        }
+    }
+    std::filesystem::remove(large_path);
+
+    std::filesystem::remove(zlib_path);
+    std::filesystem::remove(raw_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
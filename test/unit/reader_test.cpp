@@ -0,0 +1,209 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr int k_block_count = 10;
+constexpr int64_t k_entities_per_block = 100;
+constexpr int64_t k_entity_count = k_block_count * k_entities_per_block;
+constexpr int k_rounds = 5;
+
+const char* parity(int64_t id)
+{
+    return id % 2 ? "odd" : "even";
+}
+
+// block b holds the nodes and ways with ids 1 + b * 100 .. (b + 1) * 100
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_entities_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id, id, -id, {{"parity", parity(id)}}));
+        block.ways.push_back(pbf_writer::make_way(id, {id}, {{"parity", parity(id)}}));
+    });
+}
+
+struct result_t
+{
+    std::vector<int64_t> nodes;
+    size_t node_tags = 0;
+    size_t ways = 0;
+    size_t way_tags = 0;
+};
+
+bool read(input_osm::reader_t& reader, const std::filesystem::path& path, result_t& result)
+{
+    std::mutex mtx;
+    const bool ok = reader.input_file(
+        path.string().c_str(),
+        false,
+        [&](input_osm::span_t<input_osm::node_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& n : batch)
+            {
+                result.nodes.push_back(n.id);
+                result.node_tags += n.tags.size();
+            }
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::way_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& w : batch)
+            {
+                result.ways++;
+                result.way_tags += w.tags.size();
+            }
+            return true;
+        },
+        nullptr);
+    std::sort(result.nodes.begin(), result.nodes.end());
+    return ok;
+}
+
+bool is_one(int i)
+{
+    return i == 1;
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto pbf_path = dir / "inputosm_reader_test.osm.pbf";
+    const auto xml_path = dir / "inputosm_reader_test.osm";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(pbf_path, pbf_writer::encode_file(blocks)) || !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+
+    // even nodes without their tags
+    input_osm::reader_t even;
+    even.set_max_thread_count();
+    even.set_tag_filter(input_osm::tag_filter_t::key_value("parity", "even"), input_osm::ENTITY_NODES);
+    even.set_projection(input_osm::ENTITY_NODES, input_osm::PROJECT_ALL & ~uint32_t{input_osm::PROJECT_TAGS});
+    std::vector<int64_t> even_ids;
+    for (int64_t id = 2; id <= k_entity_count; id += 2) even_ids.push_back(id);
+
+    // the first 50 nodes, in file order, on the work stealing scheduler
+    input_osm::reader_t first;
+    first.set_thread_count(2);
+    first.set_scheduler(input_osm::scheduler_t::work_stealing);
+    first.set_ordered_delivery(true);
+    std::vector<int64_t> first_ids;
+    for (int64_t id = 1; id <= 50; id++) first_ids.push_back(id);
+    first.set_id_filter(input_osm::ENTITY_NODES, input_osm::id_set_t(first_ids));
+
+    // both readers read both files at the same time, each round checks what the other's options would break
+    std::atomic<bool> ok{true};
+    auto run = [&](input_osm::reader_t& reader, const std::vector<int64_t>& ids, size_t node_tags, const char* name) {
+        for (int round = 0; round < k_rounds; round++)
+        {
+            for (const auto& path : {pbf_path, xml_path})
+            {
+                result_t result;
+                const std::string what = std::string(name) + " reading " + path.filename().string();
+                if (!check(read(reader, path, result), what + " failed") ||
+                    !check(result.nodes == ids && result.node_tags == node_tags, what + ": unexpected nodes") ||
+                    !check(result.ways == size_t(k_entity_count) && result.way_tags == size_t(k_entity_count),
+                           what + ": unexpected ways"))
+                    ok = false;
+                if (path == pbf_path)
+                    ok = check(reader.decode_statistics().blocks == k_block_count, what + ": unexpected statistics") &&
+                         ok;
+            }
+        }
+    };
+    std::thread even_thread(run, std::ref(even), std::cref(even_ids), 0, "even");
+    std::thread first_thread(run, std::ref(first), std::cref(first_ids), first_ids.size(), "first");
+    even_thread.join();
+    first_thread.join();
+
+    // the readers' options are their own
+    ok = check(even.projection(input_osm::ENTITY_NODES) != input_osm::PROJECT_ALL &&
+                   first.projection(input_osm::ENTITY_NODES) == input_osm::PROJECT_ALL &&
+                   input_osm::projection(input_osm::ENTITY_NODES) == input_osm::PROJECT_ALL,
+               "projection shared between readers") &&
+         ok;
+    ok = check(first.thread_count() <= 2 && first.scheduler() == input_osm::scheduler_t::work_stealing &&
+                   first.ordered_delivery() && input_osm::thread_count() == 1 &&
+                   input_osm::scheduler() == input_osm::scheduler_t::queue && !input_osm::ordered_delivery(),
+               "thread options shared between readers") &&
+         ok;
+
+    // the default reader has no filters
+    {
+        result_t result;
+        std::vector<int64_t> all_ids;
+        for (int64_t id = 1; id <= k_entity_count; id++) all_ids.push_back(id);
+        ok = check(input_osm::input_file(pbf_path.string().c_str(),
+                                         false,
+                                         [&](input_osm::span_t<input_osm::node_t> batch) {
+                                             for (const auto& n : batch) result.nodes.push_back(n.id);
+                                             return true;
+                                         },
+                                         nullptr,
+                                         nullptr) &&
+                       result.nodes == all_ids,
+                   "default reader filtered") &&
+             ok;
+    }
+
+    // input_file_ref calls the lambdas through function_ref_t, an empty std::function skips its kind
+    for (const auto& path : {pbf_path, xml_path})
+    {
+        std::atomic<size_t> nodes{0}, ways{0};
+        const std::function<bool(input_osm::span_t<input_osm::relation_t>)> no_relations;
+        const bool read_ok = input_osm::input_file_ref(
+            path.string().c_str(),
+            false,
+            [&](input_osm::span_t<input_osm::node_t> batch) {
+                nodes += batch.size();
+                return true;
+            },
+            [&](input_osm::span_t<input_osm::way_t> batch) {
+                ways += batch.size();
+                return true;
+            },
+            no_relations);
+        ok = check(read_ok && nodes == size_t(k_entity_count) && ways == size_t(k_entity_count),
+                   "input_file_ref reading " + path.filename().string() + " failed") &&
+             ok;
+    }
+    ok = check(!input_osm::function_ref_t<bool(int)>(std::function<bool(int)>()) &&
+                   input_osm::function_ref_t<bool(int)>([](int i) { return i == 1; })(1),
+               "function_ref_t emptiness") &&
+         ok;
+    // function pointers are held by value, also temporary ones, and a null one is empty
+    {
+        bool (*no_function)(int) = nullptr;
+        const input_osm::function_ref_t<bool(int)> named = is_one;
+        const input_osm::function_ref_t<bool(int)> temporary = +[](int i) { return i == 2; };
+        ok = check(!input_osm::function_ref_t<bool(int)>(no_function) && named(1) && !named(2) && temporary(2),
+                   "function_ref_t function pointers") &&
+             ok;
+    }
+
+    std::filesystem::remove(pbf_path);
+    std::filesystem::remove(xml_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
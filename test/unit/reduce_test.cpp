@@ -0,0 +1,165 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr int k_block_count = 8;
+constexpr int64_t k_entities_per_block = 100;
+constexpr int64_t k_entity_count = k_block_count * k_entities_per_block;
+constexpr int64_t k_id_sum = k_entity_count * (k_entity_count + 1) / 2;
+
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_entities_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id, id));
+        block.ways.push_back(pbf_writer::make_way(id, {id, id + 1}));
+    });
+}
+
+struct sums_t
+{
+    int64_t nodes = 0;
+    int64_t ways = 0; // sum of the ids
+    int64_t way_refs = 0;
+    size_t merged = 0;   // states merged into this one
+    size_t unaligned = 0; // states not on their own cache line
+};
+
+std::atomic<size_t> states_made{0};
+
+input_osm::reduction_t<sums_t> make_reduction()
+{
+    return {
+        .make_state =
+            [] {
+                states_made++;
+                return sums_t{};
+            },
+        .node_handler =
+            [](sums_t& sums, input_osm::span_t<input_osm::node_t> list) {
+                for (const auto& n : list) sums.nodes += n.id;
+                sums.unaligned = reinterpret_cast<uintptr_t>(&sums) % 64 != 0;
+                return true;
+            },
+        .way_handler =
+            [](sums_t& sums, input_osm::span_t<input_osm::way_t> list) {
+                for (const auto& w : list)
+                {
+                    sums.ways += w.id;
+                    sums.way_refs += w.node_refs.size();
+                }
+                return true;
+            },
+        .merge =
+            [](sums_t& total, sums_t& sums) {
+                total.nodes += sums.nodes;
+                total.ways += sums.ways;
+                total.way_refs += sums.way_refs;
+                total.unaligned += sums.unaligned;
+                total.merged++;
+            },
+    };
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto pbf_path = dir / "inputosm_reduce_test.osm.pbf";
+    const auto xml_path = dir / "inputosm_reduce_test.osm";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(pbf_path, pbf_writer::encode_file(blocks)) || !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    input_osm::set_max_thread_count();
+    for (const auto& path : {pbf_path, xml_path})
+    {
+        const std::string what = path.filename().string();
+        states_made = 0;
+        sums_t total;
+        ok = check(input_osm::input_file_reduce(path.string().c_str(), false, make_reduction(), total),
+                   what + ": read failed") &&
+             ok;
+        ok = check(total.nodes == k_id_sum && total.ways == k_id_sum && total.way_refs == 2 * k_entity_count,
+                   what + ": wrong sums") &&
+             ok;
+        ok = check(total.merged == states_made && total.merged >= 1 && total.merged <= input_osm::thread_count(),
+                   what + ": " + std::to_string(states_made) + " states made, " + std::to_string(total.merged) +
+                       " merged") &&
+             ok;
+        ok = check(!total.unaligned, what + ": state not cache line aligned") && ok;
+    }
+
+    // columnar nodes, on a reader of its own that only decodes the ids
+    {
+        input_osm::reader_t reader;
+        reader.set_max_thread_count();
+        reader.set_projection(input_osm::ENTITY_ALL, input_osm::PROJECT_ID);
+        input_osm::reduction_t<int64_t> reduction{
+            .node_columns_handler =
+                [](int64_t& sum, const input_osm::node_columns_t& nodes) {
+                    for (int64_t id : nodes.id) sum += id;
+                    return nodes.raw_latitude.empty();
+                },
+            .merge = [](int64_t& total, int64_t& sum) { total += sum; },
+        };
+        int64_t total = 0;
+        ok = check(reader.input_file_reduce(pbf_path.string().c_str(), false, reduction, total) && total == k_id_sum,
+                   "columnar: wrong sum") &&
+             ok;
+    }
+
+    // a handler returning false fails the read, the result is left as it was
+    {
+        auto reduction = make_reduction();
+        reduction.way_handler = [](sums_t&, input_osm::span_t<input_osm::way_t>) { return false; };
+        sums_t total;
+        total.nodes = -1;
+        ok = check(!input_osm::input_file_reduce(pbf_path.string().c_str(), false, reduction, total) &&
+                       total.nodes == -1 && !total.merged,
+                   "failed read merged") &&
+             ok;
+    }
+
+    // a missing make_state or merge, and exceptions from them, fail the read instead of terminating
+    {
+        sums_t total;
+        auto no_merge = make_reduction();
+        no_merge.merge = nullptr;
+        auto no_state = make_reduction();
+        no_state.make_state = nullptr;
+        auto throwing_state = make_reduction();
+        throwing_state.make_state = []() -> sums_t { throw std::runtime_error("make_state"); };
+        auto throwing_merge = make_reduction();
+        throwing_merge.merge = [](sums_t&, sums_t&) { throw std::runtime_error("merge"); };
+        for (const auto* reduction : {&no_merge, &no_state, &throwing_state, &throwing_merge})
+            ok = check(!input_osm::input_file_reduce(pbf_path.string().c_str(), false, *reduction, total),
+                       "broken reduction did not fail") &&
+                 ok;
+        ok = check(!total.merged, "broken reduction merged") && ok;
+    }
+
+    std::filesystem::remove(pbf_path);
+    std::filesystem::remove(xml_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,255 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+using input_osm::spatial_filter_t;
+using input_osm::tag_filter_t;
+
+// 1/8 degree, exact in binary so the XML coordinates parse back to the same raw values
+constexpr int64_t k_step = 1250000;
+constexpr int k_block_count = 8;
+constexpr int k_rows_per_block = 8;
+constexpr int k_columns = 9;
+
+// block b holds the rows b * 8 .. b * 8 + 7 of a grid, so every block covers its own latitude band
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(
+        k_block_count, k_rows_per_block * k_columns, [](pbf_writer::block& block, int64_t id) {
+            const int64_t row = (id - 1) / k_columns, column = (id - 1) % k_columns;
+            block.nodes.push_back(pbf_writer::make_node(id, (row - 32) * k_step, (column - 4) * k_step));
+            if (id % 3 == 0) block.nodes.back().tags = {{"amenity", "cafe"}};
+            // one way per block
+            if (block.ways.empty()) block.ways.push_back(pbf_writer::make_way(row / k_rows_per_block + 1, {1, 2}));
+        });
+}
+
+struct delivery_t
+{
+    std::mutex mtx;
+    std::vector<int64_t> node_ids;
+    std::vector<int64_t> way_ids;
+    bool coordinates_match = true;
+};
+
+bool read(const std::filesystem::path& path, delivery_t& delivery, bool ways = true)
+{
+    const bool ok = input_osm::input_file(
+        path.string().c_str(),
+        false,
+        [&delivery](input_osm::span_t<input_osm::node_t> batch) {
+            std::lock_guard<std::mutex> lck(delivery.mtx);
+            for (const auto& n : batch)
+            {
+                delivery.node_ids.push_back(n.id);
+                // ids are assigned row by row
+                const int64_t row = (n.id - 1) / k_columns, column = (n.id - 1) % k_columns;
+                if (n.raw_latitude != (row - 32) * k_step || n.raw_longitude != (column - 4) * k_step)
+                    delivery.coordinates_match = false;
+            }
+            return true;
+        },
+        ways ? std::function<bool(input_osm::span_t<input_osm::way_t>)>(
+                   [&delivery](input_osm::span_t<input_osm::way_t> batch) {
+                       std::lock_guard<std::mutex> lck(delivery.mtx);
+                       for (const auto& w : batch) delivery.way_ids.push_back(w.id);
+                       return true;
+                   })
+             : std::function<bool(input_osm::span_t<input_osm::way_t>)>(),
+        nullptr);
+    std::sort(delivery.node_ids.begin(), delivery.node_ids.end());
+    std::sort(delivery.way_ids.begin(), delivery.way_ids.end());
+    return ok;
+}
+
+// nodes the filters should deliver, decided one by one with contains() and matches()
+std::vector<int64_t> expected_nodes(const std::vector<pbf_writer::block>& blocks,
+                                    const spatial_filter_t& area,
+                                    const tag_filter_t& tags)
+{
+    std::vector<int64_t> ids;
+    for (const auto& block : blocks)
+    {
+        for (const auto& n : block.nodes)
+        {
+            std::vector<input_osm::tag_t> list;
+            for (const auto& t : n.tags)
+                list.push_back({t.key.c_str(), t.value.c_str(), uint32_t(t.key.size()), uint32_t(t.value.size())});
+            if (area.contains(n.lat, n.lon) && tags.matches({list.data(), list.size()})) ids.push_back(n.id);
+        }
+    }
+    return ids;
+}
+
+spatial_filter_t::point_t grid(double row, double column)
+{
+    return {int64_t((row - 32) * k_step), int64_t((column - 4) * k_step)};
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    bool ok = true;
+
+    // geometry
+    {
+        const auto box = spatial_filter_t::box(-10, -20, 10, 20);
+        ok = check(box.contains(0, 0) && box.contains(-10, 20) && !box.contains(11, 0) && !box.contains(0, -21),
+                   "box contains") &&
+             ok;
+        ok = check(spatial_filter_t().contains(900000000, 1800000000), "empty filter rejects") && ok;
+        // a square with a square hole, the outer ring closed, the hole open
+        const auto holed = spatial_filter_t::polygon({{{0, 0}, {0, 100}, {100, 100}, {100, 0}, {0, 0}},
+                                                      {{25, 25}, {25, 75}, {75, 75}, {75, 25}}});
+        ok = check(holed.contains(10, 10) && holed.contains(90, 50) && !holed.contains(50, 50) &&
+                       !holed.contains(150, 50) && !holed.contains(50, -1),
+                   "polygon with hole") &&
+             ok;
+        const auto triangle = spatial_filter_t::polygon({{{0, 0}, {100, 0}, {0, 100}}});
+        ok = check(triangle.contains(10, 10) && triangle.contains(49, 49) && !triangle.contains(51, 51),
+                   "triangle") &&
+             ok;
+        ok = check(!spatial_filter_t::polygon({}).contains(0, 0), "polygon without rings contains points") && ok;
+
+        input_osm::block_summary_t summary;
+        summary.kinds = input_osm::BLOCK_HAS_NODES;
+        summary.min_latitude = 50, summary.max_latitude = 60, summary.min_longitude = 0, summary.max_longitude = 5;
+        ok = check(holed.intersects(summary), "block bbox overlap missed") && ok;
+        summary.min_latitude = 200, summary.max_latitude = 300;
+        ok = check(!holed.intersects(summary), "disjoint block bbox") && ok;
+        summary.kinds = input_osm::BLOCK_HAS_WAYS;
+        ok = check(!holed.intersects(summary), "block without nodes") && ok;
+    }
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto zlib_path = dir / "inputosm_spatial_filter_test_zlib.osm.pbf";
+    const auto raw_path = dir / "inputosm_spatial_filter_test_raw.osm.pbf";
+    const auto xml_path = dir / "inputosm_spatial_filter_test.osm";
+    const auto index_path = dir / "inputosm_spatial_filter_test_zlib.osm.pbf.idx";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(zlib_path, pbf_writer::encode_file(blocks, pbf_writer::compression::zlib)) ||
+        !pbf_writer::write_file(raw_path, pbf_writer::encode_file(blocks, pbf_writer::compression::raw)) ||
+        !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+    const std::vector<int64_t> all_ways = {1, 2, 3, 4, 5, 6, 7, 8};
+
+    struct case_t
+    {
+        const char* name;
+        spatial_filter_t area;
+        tag_filter_t tags;
+        size_t count; // expected number of nodes, 0 if not worked out by hand
+    };
+    const case_t cases[] = {
+        // rows 10..20, columns 2..6, boundaries included
+        {"box", spatial_filter_t::box(grid(10, 2).latitude, grid(10, 2).longitude, grid(20, 6).latitude,
+                                      grid(20, 6).longitude),
+         tag_filter_t(), 11 * 5},
+        // rows 4..60 without 20..40, vertices between grid points
+        {"polygon with hole",
+         spatial_filter_t::polygon({{grid(3.5, -1), grid(60.5, -1), grid(60.5, 9), grid(3.5, 9)},
+                                    {grid(19.5, 2.5), grid(40.5, 2.5), grid(40.5, 5.5), grid(19.5, 5.5)}}),
+         tag_filter_t(), 57 * 9 - 21 * 3},
+        {"triangle", spatial_filter_t::polygon({{grid(0.5, -0.5), grid(63.5, 4), grid(0.5, 8.5)}}), tag_filter_t(), 0},
+        {"box and tags", spatial_filter_t::box(grid(30, 0).latitude, grid(30, 0).longitude, grid(50, 8).latitude,
+                                               grid(50, 8).longitude),
+         tag_filter_t::key_value("amenity", "cafe"), 0},
+        {"outside", spatial_filter_t::box(grid(70, 0).latitude, grid(70, 0).longitude, grid(80, 8).latitude,
+                                          grid(80, 8).longitude),
+         tag_filter_t(), 0},
+    };
+    for (const auto& c : cases)
+    {
+        const auto expected = expected_nodes(blocks, c.area, c.tags);
+        ok = check(!c.count || expected.size() == c.count, std::string("contains miscounts: ") + c.name) && ok;
+        input_osm::set_spatial_filter(c.area);
+        input_osm::set_tag_filter(c.tags, input_osm::ENTITY_NODES);
+        for (size_t threads : {size_t{1}, size_t{4}})
+        {
+            input_osm::set_thread_count(threads);
+            for (const auto& path : {zlib_path, raw_path, xml_path})
+            {
+                delivery_t delivery;
+                ok = check(read(path, delivery) && delivery.node_ids == expected && delivery.coordinates_match &&
+                               delivery.way_ids == all_ways,
+                           std::string("unexpected nodes: ") + c.name + " in " + path.filename().string()) &&
+                     ok;
+            }
+        }
+    }
+    input_osm::set_tag_filter(tag_filter_t());
+    input_osm::set_thread_count(1);
+
+    // the filter needs the coordinates even when they are not projected
+    const auto band = spatial_filter_t::box(grid(0, 0).latitude, grid(0, 0).longitude, grid(7, 8).latitude,
+                                            grid(7, 8).longitude);
+    input_osm::set_spatial_filter(band);
+    input_osm::set_projection(input_osm::ENTITY_NODES, input_osm::PROJECT_ID);
+    {
+        size_t count = 0;
+        bool coordinates_empty = true;
+        ok = check(input_osm::input_file_columnar(
+                       zlib_path.string().c_str(),
+                       false,
+                       [&](const input_osm::node_columns_t& columns) {
+                           count += columns.size();
+                           coordinates_empty = coordinates_empty && columns.raw_latitude.empty();
+                           return true;
+                       },
+                       nullptr,
+                       nullptr) &&
+                       count == size_t(k_rows_per_block * k_columns) && coordinates_empty,
+                   "unexpected nodes without projected coordinates") &&
+             ok;
+    }
+    input_osm::set_projection(input_osm::ENTITY_NODES, input_osm::PROJECT_ALL);
+
+    // with a block index only the block of the band is inflated
+    input_osm::set_use_block_index(true);
+    ok = check(input_osm::build_block_index(zlib_path.string().c_str()), "build_block_index failed") && ok;
+    {
+        delivery_t delivery;
+        ok = check(read(zlib_path, delivery, false) &&
+                       delivery.node_ids == expected_nodes(blocks, band, tag_filter_t()),
+                   "unexpected nodes with block index") &&
+             ok;
+        ok = check(input_osm::decode_statistics().blocks == 1, "blocks outside the filter were decoded") && ok;
+    }
+    input_osm::set_use_block_index(false);
+
+    // removing the filter delivers everything again
+    input_osm::set_spatial_filter(spatial_filter_t());
+    {
+        delivery_t delivery;
+        ok = check(read(raw_path, delivery) && delivery.node_ids.size() == size_t(8 * k_rows_per_block * k_columns),
+                   "filter not removed") &&
+             ok;
+    }
+
+    std::filesystem::remove(zlib_path);
+    std::filesystem::remove(raw_path);
+    std::filesystem::remove(xml_path);
+    std::filesystem::remove(index_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
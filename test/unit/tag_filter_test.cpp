@@ -0,0 +1,208 @@
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+using input_osm::tag_filter_t;
+
+constexpr int k_block_count = 12;
+constexpr int k_entities_per_block = 60;
+
+// tags of entity i; every fourth block has none of the keys the filters below look for
+std::vector<pbf_writer::tag> make_tags(int block, int64_t i)
+{
+    if (block % 4 == 3) return i % 2 ? std::vector<pbf_writer::tag>{{"note", "x"}} : std::vector<pbf_writer::tag>{};
+    switch (i % 7)
+    {
+        case 0:
+            return {{"amenity", "cafe"}, {"name", "cafe " + std::to_string(i)}};
+        case 1:
+            return {{"amenity", "bench"}};
+        case 2:
+            return {{"shop", "bakery"}, {"name", "bakery"}};
+        case 3:
+            return {{"highway", "residential"}};
+        case 4:
+            return {{"route", "ferry"}, {"name", "ferry " + std::to_string(i)}};
+        case 5:
+            return {{"route", "bus"}, {"highway", "service"}};
+        default:
+            return {};
+    }
+}
+
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_entities_per_block, [](pbf_writer::block& block, int64_t id) {
+        const int b = static_cast<int>((id - 1) / k_entities_per_block);
+        block.nodes.push_back(pbf_writer::make_node(id, 0, 0, make_tags(b, id)));
+        block.ways.push_back(pbf_writer::make_way(id, {id, id + 1}, make_tags(b, id)));
+        block.relations.push_back(pbf_writer::make_relation(id, {{0, id, "stop"}}, make_tags(b, id)));
+    });
+}
+
+struct ids_t
+{
+    std::vector<int64_t> nodes;
+    std::vector<int64_t> ways;
+    std::vector<int64_t> relations;
+    bool operator==(const ids_t&) const = default;
+};
+
+// what set_tag_filter(filter, kinds) should deliver, decided with tag_filter_t::matches
+ids_t expected_ids(const std::vector<pbf_writer::block>& blocks, const tag_filter_t& filter, uint32_t kinds)
+{
+    ids_t ids;
+    auto pass = [&](const std::vector<pbf_writer::tag>& tags, uint32_t kind) {
+        std::vector<input_osm::tag_t> list;
+        for (const auto& t : tags)
+            list.push_back({t.key.c_str(), t.value.c_str(), uint32_t(t.key.size()), uint32_t(t.value.size())});
+        return !(kinds & kind) || filter.matches({list.data(), list.size()});
+    };
+    for (const auto& block : blocks)
+    {
+        for (const auto& n : block.nodes)
+            if (pass(n.tags, input_osm::ENTITY_NODES)) ids.nodes.push_back(n.id);
+        for (const auto& w : block.ways)
+            if (pass(w.tags, input_osm::ENTITY_WAYS)) ids.ways.push_back(w.id);
+        for (const auto& r : block.relations)
+            if (pass(r.tags, input_osm::ENTITY_RELATIONS)) ids.relations.push_back(r.id);
+    }
+    return ids;
+}
+
+bool read_ids(const std::filesystem::path& path, ids_t& ids)
+{
+    std::mutex mtx;
+    const bool ok = input_osm::input_file(
+        path.string().c_str(),
+        false,
+        [&](input_osm::span_t<input_osm::node_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& n : batch) ids.nodes.push_back(n.id);
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::way_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& w : batch)
+                if (w.node_refs.size() == 2 && w.node_refs[0] == w.id) ids.ways.push_back(w.id);
+            return true;
+        },
+        [&](input_osm::span_t<input_osm::relation_t> batch) {
+            std::lock_guard<std::mutex> lck(mtx);
+            for (const auto& r : batch)
+                if (r.members.size() == 1 && r.members[0].id == r.id) ids.relations.push_back(r.id);
+            return true;
+        });
+    std::sort(ids.nodes.begin(), ids.nodes.end());
+    std::sort(ids.ways.begin(), ids.ways.end());
+    std::sort(ids.relations.begin(), ids.relations.end());
+    return ok;
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    bool ok = true;
+
+    // predicate logic on tag lists
+    {
+        const input_osm::tag_t cafe[] = {{"amenity", "cafe", 7, 4}, {"name", "x", 4, 1}};
+        const input_osm::span_t<input_osm::tag_t> tags{cafe, 2};
+        ok = check(tag_filter_t().matches(tags), "empty filter rejects") && ok;
+        ok = check(tag_filter_t::has_key("amenity").matches(tags), "has_key") && ok;
+        ok = check(!tag_filter_t::has_key("shop").matches(tags), "has_key absent") && ok;
+        ok = check(tag_filter_t::key_value("amenity", "cafe").matches(tags), "key_value") && ok;
+        ok = check(!tag_filter_t::key_value("amenity", "bench").matches(tags), "key_value mismatch") && ok;
+        ok = check(tag_filter_t::key_in("amenity", {"bench", "cafe"}).matches(tags), "key_in") && ok;
+        ok = check(!(!tag_filter_t::has_key("name")).matches(tags), "negation") && ok;
+        ok = check(tag_filter_t::all_of({tag_filter_t::has_key("name"), !tag_filter_t::has_key("shop")}).matches(tags),
+                   "all_of") &&
+             ok;
+        ok = check(!tag_filter_t::any_of({tag_filter_t::has_key("shop"), tag_filter_t::has_key("highway")})
+                        .matches(tags),
+                   "any_of") &&
+             ok;
+        ok = check(!tag_filter_t::any_of({}).matches(tags) && tag_filter_t::all_of({}).matches(tags),
+                   "empty any_of/all_of") &&
+             ok;
+        std::vector<tag_filter_t> many;
+        for (int i = 0; i < 65; i++) many.push_back(tag_filter_t::has_key(std::to_string(i)));
+        ok = check(!input_osm::set_tag_filter(tag_filter_t::any_of(many)), "too many terms accepted") && ok;
+    }
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto zlib_path = dir / "inputosm_tag_filter_test_zlib.osm.pbf";
+    const auto raw_path = dir / "inputosm_tag_filter_test_raw.osm.pbf";
+    const auto xml_path = dir / "inputosm_tag_filter_test.osm";
+    const auto blocks = make_blocks();
+    if (!pbf_writer::write_file(zlib_path, pbf_writer::encode_file(blocks, pbf_writer::compression::zlib)) ||
+        !pbf_writer::write_file(raw_path, pbf_writer::encode_file(blocks, pbf_writer::compression::raw)) ||
+        !pbf_writer::write_xml(xml_path, blocks))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+
+    struct case_t
+    {
+        const char* name;
+        tag_filter_t filter;
+        uint32_t kinds;
+    };
+    const case_t cases[] = {
+        {"ferry ways", tag_filter_t::key_value("route", "ferry"), input_osm::ENTITY_WAYS},
+        {"amenity or shop",
+         tag_filter_t::any_of({tag_filter_t::key_in("amenity", {"cafe", "bench"}), tag_filter_t::has_key("shop")}),
+         input_osm::ENTITY_ALL},
+        {"no highway", !tag_filter_t::has_key("highway"), input_osm::ENTITY_NODES | input_osm::ENTITY_RELATIONS},
+        {"named, not a bench",
+         tag_filter_t::all_of({tag_filter_t::has_key("name"), !tag_filter_t::key_value("amenity", "bench")}),
+         input_osm::ENTITY_ALL},
+    };
+    for (const auto& c : cases)
+    {
+        const ids_t expected = expected_ids(blocks, c.filter, c.kinds);
+        ok = check(input_osm::set_tag_filter(c.filter, c.kinds), std::string("set_tag_filter failed: ") + c.name) && ok;
+        for (size_t threads : {size_t{1}, size_t{4}})
+        {
+            input_osm::set_thread_count(threads);
+            for (const auto& path : {zlib_path, raw_path, xml_path})
+            {
+                ids_t ids;
+                ok = check(read_ids(path, ids) && ids == expected,
+                           std::string("unexpected entities: ") + c.name + " in " + path.filename().string()) &&
+                     ok;
+            }
+        }
+    }
+
+    // removing the filter delivers everything again
+    input_osm::set_tag_filter(tag_filter_t());
+    {
+        ids_t ids;
+        ok = check(read_ids(zlib_path, ids) && ids == expected_ids(blocks, tag_filter_t(), 0), "filter not removed") &&
+             ok;
+    }
+
+    std::filesystem::remove(zlib_path);
+    std::filesystem::remove(raw_path);
+    std::filesystem::remove(xml_path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+#include "varint.h"
+
+#include "pbf_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+// values with a mix of encoded lengths, including 9 and 10 byte varints and long runs of single byte ones
+std::vector<int64_t> make_values(std::mt19937_64& rng, size_t count)
+{
+    std::vector<int64_t> values;
+    int64_t value = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        // deltas up to 60 bits, values kept within 2^61 so the encoder never overflows
+        const unsigned bits = (i / 64) % 4 == 0 ? 6 : 1 + static_cast<unsigned>(rng() % 60);
+        int64_t delta = static_cast<int64_t>(rng() >> (64 - bits));
+        if (rng() & 1) delta = -delta;
+        value += delta;
+        if (value > (int64_t(1) << 61) || value < -(int64_t(1) << 61)) value = delta;
+        values.push_back(value);
+    }
+    return values;
+}
+
+template <typename T>
+bool check(const char* kernel,
+           const char* what,
+           size_t size,
+           const std::vector<T>& expected,
+           const T* actual,
+           size_t count)
+{
+    if (count == expected.size() && std::equal(expected.begin(), expected.end(), actual)) return true;
+    std::cerr << kernel << " " << what << " mismatch for " << size << " values (decoded " << count << ")\n";
+    return false;
+}
+} // namespace
+
+int main()
+{
+    std::mt19937_64 rng(42);
+    bool ok = true;
+    for (const char* name : {"scalar", "sse4.1", "avx2"})
+    {
+        const input_osm::varint_kernels_t* kernels = input_osm::find_varint_kernels(name);
+        if (!kernels)
+        {
+            std::cout << name << " not supported, skipped\n";
+            continue;
+        }
+        // sizes around the window and tail lengths of the SIMD loops
+        for (size_t size : {0, 1, 7, 15, 16, 17, 23, 24, 31, 32, 33, 39, 40, 41, 100, 1000, 10000})
+        {
+            const auto values = make_values(rng, size);
+            std::vector<uint64_t> unsigned_values(values.begin(), values.end());
+
+            pbf_writer::bytes_t packed_unsigned = pbf_writer::packed_uint(unsigned_values);
+            pbf_writer::bytes_t packed_delta = pbf_writer::packed_delta(values);
+
+            std::vector<uint64_t> out_unsigned(packed_unsigned.size() + 1);
+            const auto* begin = reinterpret_cast<const uint8_t*>(packed_unsigned.data());
+            size_t count = kernels->decode_uint64(begin, begin + packed_unsigned.size(), out_unsigned.data());
+            ok = check(name, "uint64", size, unsigned_values, out_unsigned.data(), count) && ok;
+
+            std::vector<int64_t> out_delta(packed_delta.size() + 1);
+            begin = reinterpret_cast<const uint8_t*>(packed_delta.data());
+            count = kernels->decode_delta_sint64(begin, begin + packed_delta.size(), out_delta.data());
+            ok = check(name, "delta", size, values, out_delta.data(), count) && ok;
+
+            // a varint cut off by the end of the field is dropped
+            if (size && (packed_delta.back() & 0x80) == 0 && packed_delta.size() > 1 &&
+                (packed_delta[packed_delta.size() - 2] & 0x80))
+            {
+                count = kernels->decode_delta_sint64(begin, begin + packed_delta.size() - 1, out_delta.data());
+                ok = check(name,
+                           "truncated",
+                           size,
+                           std::vector<int64_t>(values.begin(), values.end() - 1),
+                           out_delta.data(),
+                           count) &&
+                     ok;
+            }
+        }
+    }
+    std::cout << "selected varint kernels: " << input_osm::varint_kernels().name << "\n";
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
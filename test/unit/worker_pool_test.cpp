@@ -0,0 +1,125 @@
+#include "workerpool.h"
+
+#include <inputosm/inputosm.h>
+
+#include "pbf_writer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr int k_block_count = 20;
+constexpr int64_t k_nodes_per_block = 200;
+constexpr size_t k_node_count = k_block_count * k_nodes_per_block;
+
+std::vector<pbf_writer::block> make_blocks()
+{
+    return pbf_writer::make_blocks(k_block_count, k_nodes_per_block, [](pbf_writer::block& block, int64_t id) {
+        block.nodes.push_back(pbf_writer::make_node(id, id, -id));
+    });
+}
+
+// the nodes a read delivered, 0 if it failed
+size_t count_nodes(input_osm::reader_t& reader, const std::string& filename)
+{
+    std::atomic<size_t> nodes{0};
+    const bool ok = reader.input_file(
+        filename.c_str(),
+        false,
+        [&nodes](input_osm::span_t<input_osm::node_t> batch) {
+            nodes += batch.size();
+            return true;
+        },
+        nullptr,
+        nullptr);
+    return ok ? nodes.load() : 0;
+}
+
+// one run on count pool threads, whether each index ran exactly once
+bool run_jobs(input_osm::worker_pool_t& pool, size_t count)
+{
+    std::vector<std::atomic<int>> calls(count);
+    const std::function<void(size_t)> job = [&calls](size_t index) { calls[index]++; };
+    input_osm::worker_pool_t::run_t run;
+    pool.start(run, count, job);
+    pool.wait(run);
+    for (const auto& c : calls)
+        if (c != 1) return false;
+    return true;
+}
+
+bool check(bool condition, const std::string& message)
+{
+    if (!condition) std::cerr << message << '\n';
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    bool ok = true;
+
+    // a pool of its own: runs reuse the parked threads, concurrent runs get their own ones
+    {
+        input_osm::worker_pool_t pool;
+        ok = check(run_jobs(pool, 4) && pool.size() == 4, "first run failed") && ok;
+        ok = check(run_jobs(pool, 4) && run_jobs(pool, 2) && pool.size() == 4, "sequential runs grew the pool") && ok;
+
+        std::atomic<bool> concurrent_ok{true};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 2; t++)
+            threads.emplace_back([&] {
+                for (int round = 0; round < 50; round++)
+                    if (!run_jobs(pool, 3)) concurrent_ok = false;
+            });
+        for (auto& t : threads) t.join();
+        ok = check(concurrent_ok, "concurrent runs lost jobs") && ok;
+        ok = check(pool.size() <= 6, "concurrent runs started " + std::to_string(pool.size()) + " threads") && ok;
+    }
+
+    const auto path = std::filesystem::temp_directory_path() / "inputosm_worker_pool_test.osm.pbf";
+    if (!pbf_writer::write_file(path, pbf_writer::encode_file(make_blocks())))
+    {
+        std::cerr << "Failed to write test fixtures\n";
+        return EXIT_FAILURE;
+    }
+    const std::string filename = path.string();
+
+    // sequential reads park the workers of the first one and reuse them
+    input_osm::reader_t first, second;
+    first.set_max_thread_count();
+    second.set_max_thread_count();
+    ok = check(count_nodes(first, filename) == k_node_count, "first read failed") && ok;
+    const size_t pool_size = input_osm::worker_pool().size();
+    for (int round = 0; round < 3; round++)
+        ok = check(count_nodes(first, filename) == k_node_count && count_nodes(second, filename) == k_node_count,
+                   "sequential read failed") &&
+             ok;
+    ok = check(input_osm::worker_pool().size() == pool_size,
+               "sequential reads grew the pool from " + std::to_string(pool_size) + " to " +
+                   std::to_string(input_osm::worker_pool().size()) + " threads") &&
+         ok;
+
+    // concurrent reads on two readers both complete
+    size_t first_nodes = 0, second_nodes = 0;
+    std::thread first_thread([&] { first_nodes = count_nodes(first, filename); });
+    std::thread second_thread([&] { second_nodes = count_nodes(second, filename); });
+    first_thread.join();
+    second_thread.join();
+    ok = check(first_nodes == k_node_count && second_nodes == k_node_count, "concurrent reads failed") && ok;
+    // each read takes its own threads, parked ones first
+    ok = check(input_osm::worker_pool().size() <= first.thread_count() + second.thread_count(),
+               "concurrent reads started more threads than they use") &&
+         ok;
+
+    std::filesystem::remove(path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}